@@ -3,31 +3,64 @@
 //
 #include "cpp/engine/error-formatter.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "cpp/engine/validator_pb.h"
 #include "cpp/htmlparser/logging.h"
 #include "cpp/htmlparser/strings.h"
 #include "validator.pb.h"
-#include "re2/re2.h"  // NOLINT(build/deprecated)
 
 namespace amp::validator {
 namespace {
-int CharLenAtIndex(const std::string& str, int pos) {
+int CharLenAtIndex(std::string_view str, int pos) {
   return htmlparser::Strings::CodePointByteSequenceCount(str.at(pos));
 }
 
-// Replaces any adjacent UTF-8 encoded characters within |in| that are
-// whitespace with a single space (' ').
-std::string CollapseWhitespace(const std::string& in) {
-  static LazyRE2 match_whitespace_re = {"\\s+"};
-  std::string out(in);
-  RE2::GlobalReplace(&out, *match_whitespace_re, " ");
-  return out;
+// Whether |c| is whitespace, as in the \s of RE2.
+bool IsWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+// Appends |in| to |out|, replacing any adjacent UTF-8 encoded characters
+// within |in| that are whitespace with a single space (' ').
+void AppendCollapsedWhitespace(const std::string& in, std::string* out) {
+  for (size_t ii = 0; ii < in.size(); ++ii) {
+    if (!IsWhitespace(in[ii])) {
+      *out += in[ii];
+      continue;
+    }
+    *out += ' ';
+    while (ii + 1 < in.size() && IsWhitespace(in[ii + 1])) ++ii;
+  }
+}
+
+const std::vector<std::string>& FormatByCode() {
+  static const std::vector<std::string>* format_by_code = []() {
+    ValidatorRules rules;
+    CHECK(rules.ParseFromArray(
+        amp::validator::data::kValidatorProtoBytes,
+        amp::validator::data::kValidatorProtoBytesSize));
+    std::vector<std::string> format_by_code(ValidationError::Code_MAX + 1);
+    for (const ErrorFormat& error_format : rules.error_formats())
+      format_by_code[error_format.code()] = error_format.format();
+    return new const std::vector<std::string>(std::move(format_by_code));
+  }();
+  return *format_by_code;
 }
 }  // namespace
 
 std::string ErrorFormatter::ApplyFormat(const std::string& format,
                                         const ValidationError& error) {
   std::string message;
+  AppendFormat(format, error, &message);
+  return message;
+}
+
+void ErrorFormatter::AppendFormat(std::string_view format,
+                                  const ValidationError& error,
+                                  std::string* out) {
+  std::string& message = *out;
   int max_param_id = -1;
   for (int ii = 0, char_len = CharLenAtIndex(format, ii); ii < format.size();
        ii += char_len) {
@@ -59,7 +92,7 @@ std::string ErrorFormatter::ApplyFormat(const std::string& format,
     // into the params is 0-based.
     --param;
     if (param >= 0 && param < error.params_size()) {  // bounds check
-      message.append(CollapseWhitespace(error.params(param)));
+      AppendCollapsedWhitespace(error.params(param), &message);
       max_param_id = std::max(max_param_id, param);
       continue;
     } else {
@@ -74,24 +107,20 @@ std::string ErrorFormatter::ApplyFormat(const std::string& format,
     // This should never happen in actual code. We put it here so we have
     // some way of noticing these issues in tests.
     message.append("(unused param)");
+}
 
+std::string ErrorFormatter::FormattedMessageFor(const ValidationError& error) {
+  std::string message;
+  AppendFormattedMessageFor(error, &message);
   return message;
 }
 
-std::string ErrorFormatter::FormattedMessageFor(const ValidationError& error) {
-  static const std::vector<std::string>* format_by_code = []() {
-    ValidatorRules rules;
-    CHECK(rules.ParseFromArray(
-        amp::validator::data::kValidatorProtoBytes,
-        amp::validator::data::kValidatorProtoBytesSize));
-    std::vector<std::string> format_by_code(ValidationError::Code_MAX + 1);
-    for (const ErrorFormat& error_format : rules.error_formats())
-      format_by_code[error_format.code()] = error_format.format();
-    return new const std::vector<std::string>(std::move(format_by_code));
-  }();
-  if (error.code() < 0 || error.code() >= format_by_code->size()) {
-    return "";
-  }
-  return ErrorFormatter::ApplyFormat((*format_by_code)[error.code()], error);
+void ErrorFormatter::AppendFormattedMessageFor(const ValidationError& error,
+                                               std::string* out) {
+  const std::vector<std::string>& format_by_code = FormatByCode();
+  if (error.code() < 0 ||
+      static_cast<size_t>(error.code()) >= format_by_code.size())
+    return;
+  AppendFormat(format_by_code[error.code()], error, out);
 }
 }  // namespace amp::validator
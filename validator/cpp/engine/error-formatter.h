@@ -12,6 +12,7 @@
 #define CPP_ENGINE_ERROR_FORMATTER_H_
 
 #include <string>
+#include <string_view>
 
 #include "validator.pb.h"
 
@@ -33,6 +34,14 @@ class ErrorFormatter {
   // or the empty string if anything goes wrong.
   static std::string FormattedMessageFor(const ValidationError& error);
 
+  // Like ApplyFormat and FormattedMessageFor, but append the message to
+  // |out| rather than returning it, e.g. to write many messages into one
+  // buffer.
+  static void AppendFormat(std::string_view format,
+                           const ValidationError& error, std::string* out);
+  static void AppendFormattedMessageFor(const ValidationError& error,
+                                        std::string* out);
+
  private:
   ErrorFormatter(const ErrorFormatter&) = delete;
   ErrorFormatter& operator=(const ErrorFormatter&) = delete;
@@ -0,0 +1,342 @@
+#include "cpp/engine/result-cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include "absl/strings/str_cat.h"
+#include "cpp/engine/validator.h"
+#include "cpp/htmlparser/defer.h"
+
+namespace amp::validator {
+
+namespace {
+
+uint64_t RotateLeft(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t FinalMix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+uint64_t LoadLittleEndian64(const char* p) {
+  uint64_t k = 0;
+  for (int i = 7; i >= 0; --i) k = (k << 8) | static_cast<uint8_t>(p[i]);
+  return k;
+}
+
+// The start of the file of a MappedFileResultCacheBackend.
+struct MappedFileHeader {
+  char magic[8];
+  int32_t version;
+  int32_t num_slots;
+  int32_t slot_size;
+};
+
+constexpr char kMappedFileMagic[8] = {'A', 'M', 'P', 'R', 'E', 'S', 'L', 'T'};
+// 2 added Slot::write_start_ns, 3 Slot::checksum.
+constexpr int32_t kMappedFileVersion = 3;
+// Slots start at this offset, past the header.
+constexpr size_t kMappedFileHeaderSize = 64;
+static_assert(sizeof(MappedFileHeader) <= kMappedFileHeaderSize);
+
+// CLOCK_MONOTONIC, which, unlike std::chrono::steady_clock in general, is the
+// same clock in all processes of the machine.
+int64_t MonotonicNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+}  // namespace
+
+ResultCacheKey Fingerprint128(std::string_view data, uint64_t seed) {
+  constexpr uint64_t c1 = 0x87c37b91114253d5ULL;
+  constexpr uint64_t c2 = 0x4cf5ad432745937fULL;
+  const char* p = data.data();
+  const size_t num_blocks = data.size() / 16;
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+
+  for (size_t i = 0; i < num_blocks; ++i, p += 16) {
+    uint64_t k1 = LoadLittleEndian64(p);
+    uint64_t k2 = LoadLittleEndian64(p + 8);
+    k1 *= c1;
+    k1 = RotateLeft(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+    h1 = RotateLeft(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2;
+    k2 = RotateLeft(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    h2 = RotateLeft(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  // The remaining 0 to 15 bytes.
+  const size_t tail_size = data.size() & 15;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (size_t i = tail_size; i > 8; --i)
+    k2 = (k2 << 8) | static_cast<uint8_t>(p[i - 1]);
+  for (size_t i = std::min<size_t>(tail_size, 8); i > 0; --i)
+    k1 = (k1 << 8) | static_cast<uint8_t>(p[i - 1]);
+  if (tail_size > 8) {
+    k2 *= c2;
+    k2 = RotateLeft(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+  }
+  if (tail_size > 0) {
+    k1 *= c1;
+    k1 = RotateLeft(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+  }
+
+  h1 ^= data.size();
+  h2 ^= data.size();
+  h1 += h2;
+  h2 += h1;
+  h1 = FinalMix(h1);
+  h2 = FinalMix(h2);
+  h1 += h2;
+  h2 += h1;
+  return {h1, h2};
+}
+
+LruResultCacheBackend::LruResultCacheBackend(int max_entries)
+    : max_entries_(max_entries) {}
+
+bool LruResultCacheBackend::Lookup(const ResultCacheKey& key,
+                                   ValidationResult* result) {
+  absl::MutexLock lock(&mu_);
+  auto iter = index_.find(key);
+  if (iter == index_.end()) return false;
+  entries_.splice(entries_.begin(), entries_, iter->second);
+  *result = iter->second->second;
+  return true;
+}
+
+void LruResultCacheBackend::Store(const ResultCacheKey& key,
+                                  const ValidationResult& result) {
+  if (max_entries_ <= 0) return;
+  absl::MutexLock lock(&mu_);
+  auto iter = index_.find(key);
+  if (iter != index_.end()) {
+    iter->second->second = result;
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    return;
+  }
+  if (index_.size() >= static_cast<size_t>(max_entries_)) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.emplace_front(key, result);
+  index_[key] = entries_.begin();
+}
+
+// A slot of a MappedFileResultCacheBackend is this header, followed by the
+// serialized result.
+struct MappedFileResultCacheBackend::Slot {
+  // Odd while the slot is being written, and 0 if it never was.
+  std::atomic<uint32_t> sequence;
+  uint32_t size;
+  uint64_t high;
+  uint64_t low;
+  // When the last write started, see MonotonicNanos(). A slot which stays odd
+  // for longer than the stale write timeout was left by a writer which died.
+  std::atomic<int64_t> write_start_ns;
+  // See Checksum().
+  uint64_t checksum;
+
+  // A hash of the key and the serialized result, which tells a result apart
+  // from the interleaved writes of two writers.
+  static uint64_t Checksum(const ResultCacheKey& key,
+                           std::string_view serialized) {
+    return Fingerprint128(serialized, key.high ^ RotateLeft(key.low, 32)).low;
+  }
+
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<int64_t>::is_always_lock_free,
+              "Slots are shared between processes.");
+
+std::unique_ptr<MappedFileResultCacheBackend>
+MappedFileResultCacheBackend::Open(
+    const std::string& path, int num_slots, int slot_size,
+    std::chrono::nanoseconds stale_write_timeout) {
+  if (num_slots <= 0 || slot_size <= static_cast<int>(sizeof(Slot)) ||
+      slot_size % alignof(Slot) != 0)
+    return nullptr;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) return nullptr;
+  htmlparser::defer(close(fd));
+
+  const size_t mapping_size =
+      kMappedFileHeaderSize + static_cast<size_t>(num_slots) * slot_size;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) return nullptr;
+  if (file_stat.st_size == 0) {
+    // A new file. Processes racing to size it agree on the size.
+    if (ftruncate(fd, mapping_size) != 0) return nullptr;
+  } else if (static_cast<size_t>(file_stat.st_size) != mapping_size) {
+    return nullptr;
+  }
+
+  void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, /*offset=*/0);
+  if (mapping == MAP_FAILED) return nullptr;
+  std::unique_ptr<MappedFileResultCacheBackend> backend(
+      new MappedFileResultCacheBackend(static_cast<char*>(mapping),
+                                       mapping_size, num_slots, slot_size,
+                                       stale_write_timeout));
+
+  MappedFileHeader* header = reinterpret_cast<MappedFileHeader*>(mapping);
+  if (std::all_of(std::begin(header->magic), std::end(header->magic),
+                  [](char c) { return c == 0; })) {
+    header->version = kMappedFileVersion;
+    header->num_slots = num_slots;
+    header->slot_size = slot_size;
+    std::memcpy(header->magic, kMappedFileMagic, sizeof(kMappedFileMagic));
+  }
+  if (std::memcmp(header->magic, kMappedFileMagic, sizeof(kMappedFileMagic)) !=
+          0 ||
+      header->version != kMappedFileVersion ||
+      header->num_slots != num_slots || header->slot_size != slot_size)
+    return nullptr;
+  return backend;
+}
+
+MappedFileResultCacheBackend::MappedFileResultCacheBackend(
+    char* mapping, size_t mapping_size, int num_slots, int slot_size,
+    std::chrono::nanoseconds stale_write_timeout)
+    : mapping_(mapping),
+      mapping_size_(mapping_size),
+      num_slots_(num_slots),
+      slot_size_(slot_size),
+      stale_write_timeout_ns_(stale_write_timeout.count()) {}
+
+MappedFileResultCacheBackend::~MappedFileResultCacheBackend() {
+  munmap(mapping_, mapping_size_);
+}
+
+MappedFileResultCacheBackend::Slot* MappedFileResultCacheBackend::SlotFor(
+    const ResultCacheKey& key) {
+  return reinterpret_cast<Slot*>(mapping_ + kMappedFileHeaderSize +
+                                 (key.low % num_slots_) * slot_size_);
+}
+
+bool MappedFileResultCacheBackend::Lookup(const ResultCacheKey& key,
+                                          ValidationResult* result) {
+  Slot* slot = SlotFor(key);
+  uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+  if (sequence == 0 || sequence % 2 == 1) return false;
+  if (slot->high != key.high || slot->low != key.low) return false;
+  uint32_t size = slot->size;
+  if (size > slot_size_ - sizeof(Slot)) return false;
+  std::string serialized(slot->data(), size);
+  uint64_t checksum = slot->checksum;
+  // Whatever was copied is only consistent if no writer got in between.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->sequence.load(std::memory_order_relaxed) != sequence) return false;
+  // A writer which was taken for dead may still have written over the result.
+  if (checksum != Slot::Checksum(key, serialized)) return false;
+  return result->ParseFromString(serialized);
+}
+
+void MappedFileResultCacheBackend::Store(const ResultCacheKey& key,
+                                         const ValidationResult& result) {
+  std::string serialized;
+  if (!result.SerializeToString(&serialized) ||
+      serialized.size() > slot_size_ - sizeof(Slot))
+    return;
+  Slot* slot = SlotFor(key);
+  uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  // Leave the slot to whoever is writing it already, unless that writer has
+  // been at it for so long that it must have died. Claiming the slot keeps
+  // it odd, so readers go on seeing a miss.
+  uint32_t claimed = sequence + 1;
+  if (sequence % 2 == 1) {
+    if (MonotonicNanos() -
+            slot->write_start_ns.load(std::memory_order_relaxed) <
+        stale_write_timeout_ns_)
+      return;
+    claimed = sequence + 2;
+  }
+  if (!slot->sequence.compare_exchange_strong(sequence, claimed,
+                                              std::memory_order_acquire))
+    return;
+  slot->write_start_ns.store(MonotonicNanos(), std::memory_order_relaxed);
+  slot->size = serialized.size();
+  slot->high = key.high;
+  slot->low = key.low;
+  slot->checksum = Slot::Checksum(key, serialized);
+  std::memcpy(slot->data(), serialized.data(), serialized.size());
+  // A writer whose slot was reclaimed in the meantime leaves it to the one
+  // which reclaimed it.
+  slot->sequence.compare_exchange_strong(claimed, claimed + 1,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed);
+}
+
+ResultCache::ResultCache()
+    : ResultCache(std::make_unique<LruResultCacheBackend>()) {}
+
+ResultCache::ResultCache(std::unique_ptr<ResultCacheBackend> backend)
+    : backend_(std::move(backend)) {}
+
+ResultCacheKey ResultCache::Key(std::string_view html,
+                                HtmlFormat_Code html_format, int max_errors) {
+  // Results depend on the arguments, the rules and the validator as much as
+  // on the html.
+  static const uint64_t version_seed =
+      Fingerprint128(absl::StrCat(EmbeddedRulesFingerprint(), ":",
+                                  ValidatorBuildStamp()))
+          .low;
+  uint64_t seed =
+      Fingerprint128(absl::StrCat(html_format, ":", max_errors), version_seed)
+          .low;
+  return Fingerprint128(html, seed);
+}
+
+ValidationResult ResultCache::Validate(std::string_view html,
+                                       HtmlFormat_Code html_format,
+                                       int max_errors) {
+  ResultCacheKey key = Key(html, html_format, max_errors);
+  ValidationResult result;
+  if (backend_->Lookup(key, &result)) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return result;
+  }
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  result = amp::validator::Validate(html, html_format, max_errors);
+  backend_->Store(key, result);
+  return result;
+}
+
+ResultCacheStats ResultCache::stats() const {
+  ResultCacheStats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace amp::validator
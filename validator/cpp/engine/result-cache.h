@@ -0,0 +1,168 @@
+// An opt-in cache of validation results for byte-identical documents, e.g.
+// publishers pushing unchanged pages again.
+//
+// Usage:
+//   amp::validator::ResultCache cache;  // In memory, see the backends below.
+//   auto result = cache.Validate(my_html, amp::validator::HtmlFormat::AMP);
+//
+// A result is cached under a 128-bit hash of the document, the html format,
+// max_errors, EmbeddedRulesFingerprint() and ValidatorBuildStamp(), so
+// results are never shared between different rules or builds of the
+// validator.
+
+#ifndef CPP_ENGINE_RESULT_CACHE_H_
+#define CPP_ENGINE_RESULT_CACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "validator.pb.h"
+
+namespace amp::validator {
+
+struct ResultCacheKey {
+  uint64_t high = 0;
+  uint64_t low = 0;
+
+  bool operator==(const ResultCacheKey& other) const {
+    return high == other.high && low == other.low;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const ResultCacheKey& key) {
+    return H::combine(std::move(h), key.high, key.low);
+  }
+};
+
+// A 128-bit hash of |data| (MurmurHash3 x64_128), which is the same in every
+// process, so that keys may be shared through a MappedFileResultCacheBackend.
+ResultCacheKey Fingerprint128(std::string_view data, uint64_t seed = 0);
+
+// The storage of a ResultCache. Implementations must be thread-safe.
+class ResultCacheBackend {
+ public:
+  virtual ~ResultCacheBackend() = default;
+
+  // Sets |result| to the result stored under |key| and returns true, or
+  // returns false if there is none.
+  virtual bool Lookup(const ResultCacheKey& key, ValidationResult* result) = 0;
+
+  // Stores |result| under |key|, replacing whatever was stored there. A
+  // backend may drop results, e.g. to stay within its capacity.
+  virtual void Store(const ResultCacheKey& key,
+                     const ValidationResult& result) = 0;
+};
+
+// Keeps up to |max_entries| results in memory, dropping the least recently
+// used ones.
+class LruResultCacheBackend : public ResultCacheBackend {
+ public:
+  explicit LruResultCacheBackend(int max_entries = 10000);
+
+  bool Lookup(const ResultCacheKey& key, ValidationResult* result) override;
+  void Store(const ResultCacheKey& key,
+             const ValidationResult& result) override;
+
+ private:
+  using Entry = std::pair<ResultCacheKey, ValidationResult>;
+
+  const int max_entries_;
+  absl::Mutex mu_;
+  // Most recently used first.
+  std::list<Entry> entries_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<ResultCacheKey, std::list<Entry>::iterator> index_
+      ABSL_GUARDED_BY(mu_);
+};
+
+// Keeps results in a memory mapped file, which all the processes that open
+// the same file share, e.g. a local pool of validator processes. The file is
+// a table of |num_slots| slots of |slot_size| bytes, and a key's slot is
+// determined by its hash, so a result replaces any other result in its slot.
+// Results which don't fit into a slot are not stored.
+//
+// Slots are guarded by lock-free sequence counters: a reader that races with
+// a writer of the same slot sees a miss, and of two racing writers one drops
+// its result. A slot left mid-write by a process which died reads as a miss,
+// and is taken over by the first writer after |stale_write_timeout|. As the
+// writer may only have been slow, both may then write the slot at once, so
+// each result is stored with a checksum of its key and bytes, and a torn
+// result reads as a miss.
+class MappedFileResultCacheBackend : public ResultCacheBackend {
+ public:
+  // Opens |path|, creating it if needed. Returns null if the file can't be
+  // opened or mapped, or was created with a different |num_slots| or
+  // |slot_size|.
+  static std::unique_ptr<MappedFileResultCacheBackend> Open(
+      const std::string& path, int num_slots = 4096, int slot_size = 4096,
+      std::chrono::nanoseconds stale_write_timeout = std::chrono::seconds(1));
+  ~MappedFileResultCacheBackend() override;
+
+  MappedFileResultCacheBackend(const MappedFileResultCacheBackend&) = delete;
+  MappedFileResultCacheBackend& operator=(
+      const MappedFileResultCacheBackend&) = delete;
+
+  bool Lookup(const ResultCacheKey& key, ValidationResult* result) override;
+  void Store(const ResultCacheKey& key,
+             const ValidationResult& result) override;
+
+ private:
+  struct Slot;
+
+  MappedFileResultCacheBackend(char* mapping, size_t mapping_size,
+                               int num_slots, int slot_size,
+                               std::chrono::nanoseconds stale_write_timeout);
+  Slot* SlotFor(const ResultCacheKey& key);
+
+  char* const mapping_;
+  const size_t mapping_size_;
+  const int num_slots_;
+  const int slot_size_;
+  const int64_t stale_write_timeout_ns_;
+};
+
+struct ResultCacheStats {
+  // Documents whose result was found in the cache.
+  int64_t hits = 0;
+  // Documents which were validated, and whose result was then stored.
+  int64_t misses = 0;
+};
+
+// Validates documents like Validate() in validator.h, returning the stored
+// result for documents that were validated before. Thread-safe.
+class ResultCache {
+ public:
+  // Uses an LruResultCacheBackend with the default capacity.
+  ResultCache();
+  explicit ResultCache(std::unique_ptr<ResultCacheBackend> backend);
+
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  ValidationResult Validate(std::string_view html,
+                            HtmlFormat_Code html_format = HtmlFormat::AMP,
+                            int max_errors = -1);
+
+  // The key under which the result for these arguments is cached.
+  static ResultCacheKey Key(std::string_view html, HtmlFormat_Code html_format,
+                            int max_errors);
+
+  ResultCacheStats stats() const;
+
+ private:
+  std::unique_ptr<ResultCacheBackend> backend_;
+  std::atomic<int64_t> hits_{0};
+  std::atomic<int64_t> misses_{0};
+};
+
+}  // namespace amp::validator
+
+#endif  // CPP_ENGINE_RESULT_CACHE_H_
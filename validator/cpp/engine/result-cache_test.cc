@@ -0,0 +1,175 @@
+#include "cpp/engine/result-cache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "cpp/engine/testing-utils.h"
+#include "cpp/engine/validator.h"
+#include "validator.pb.h"
+
+namespace amp::validator {
+namespace {
+
+using testing::TestCase;
+using testing::TestCases;
+
+ValidationResult ResultWithErrors(int num_errors) {
+  ValidationResult result;
+  result.set_status(ValidationResult::FAIL);
+  for (int i = 0; i < num_errors; ++i) {
+    ValidationError* error = result.add_errors();
+    error->set_code(ValidationError::DISALLOWED_TAG);
+    error->set_line(i + 1);
+    error->add_params("foo");
+  }
+  return result;
+}
+
+TEST(ResultCacheTest, Fingerprint128) {
+  // Reference values of MurmurHash3_x64_128.
+  ResultCacheKey key = Fingerprint128("hello");
+  EXPECT_EQ(0xcbd8a7b341bd9b02ULL, key.high);
+  EXPECT_EQ(0x5b1e906a48ae1d19ULL, key.low);
+  EXPECT_EQ(Fingerprint128(""), ResultCacheKey());
+
+  std::string html(1000, 'x');
+  EXPECT_EQ(Fingerprint128(html), Fingerprint128(html));
+  EXPECT_EQ(Fingerprint128(html, 1), Fingerprint128(html, 1));
+  EXPECT_FALSE(Fingerprint128(html) == Fingerprint128(html, 1));
+  EXPECT_FALSE(Fingerprint128(html) == Fingerprint128(html.substr(1)));
+}
+
+TEST(ResultCacheTest, ValidatesOnlyOnce) {
+  const TestCase& test_case =
+      TestCases().at("feature_tests/css_errors.html");
+  ValidationResult expected =
+      Validate(test_case.input_content, test_case.html_format);
+
+  ResultCache cache;
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(expected.DebugString(),
+              cache.Validate(test_case.input_content, test_case.html_format)
+                  .DebugString());
+  }
+  EXPECT_EQ(2, cache.stats().hits);
+  EXPECT_EQ(1, cache.stats().misses);
+
+  // The result depends on max_errors and the html format.
+  EXPECT_EQ(1, cache.Validate(test_case.input_content, test_case.html_format,
+                              /*max_errors=*/1)
+                   .errors_size());
+  cache.Validate(test_case.input_content, HtmlFormat::AMP4EMAIL);
+  EXPECT_EQ(3, cache.stats().misses);
+}
+
+TEST(ResultCacheTest, LruBackendDropsLeastRecentlyUsed) {
+  LruResultCacheBackend backend(/*max_entries=*/2);
+  ValidationResult result;
+  backend.Store(Fingerprint128("a"), ResultWithErrors(1));
+  backend.Store(Fingerprint128("b"), ResultWithErrors(2));
+  EXPECT_TRUE(backend.Lookup(Fingerprint128("a"), &result));
+  EXPECT_EQ(1, result.errors_size());
+  backend.Store(Fingerprint128("c"), ResultWithErrors(3));
+  EXPECT_FALSE(backend.Lookup(Fingerprint128("b"), &result));
+  EXPECT_TRUE(backend.Lookup(Fingerprint128("a"), &result));
+  EXPECT_TRUE(backend.Lookup(Fingerprint128("c"), &result));
+  EXPECT_EQ(3, result.errors_size());
+}
+
+TEST(ResultCacheTest, MappedFileBackendIsShared) {
+  std::string path = ::testing::TempDir() + "/result-cache_test.cache";
+  std::remove(path.c_str());
+  auto writer = MappedFileResultCacheBackend::Open(path, /*num_slots=*/16,
+                                                   /*slot_size=*/1024);
+  auto reader = MappedFileResultCacheBackend::Open(path, /*num_slots=*/16,
+                                                   /*slot_size=*/1024);
+  ASSERT_NE(nullptr, writer);
+  ASSERT_NE(nullptr, reader);
+  EXPECT_EQ(nullptr, MappedFileResultCacheBackend::Open(
+                         path, /*num_slots=*/32, /*slot_size=*/1024));
+
+  ValidationResult result;
+  EXPECT_FALSE(reader->Lookup(Fingerprint128("a"), &result));
+  writer->Store(Fingerprint128("a"), ResultWithErrors(2));
+  ASSERT_TRUE(reader->Lookup(Fingerprint128("a"), &result));
+  EXPECT_EQ(ResultWithErrors(2).DebugString(), result.DebugString());
+
+  // Results which don't fit into a slot aren't stored.
+  writer->Store(Fingerprint128("b"), ResultWithErrors(100));
+  EXPECT_FALSE(reader->Lookup(Fingerprint128("b"), &result));
+
+  // A cache in the file outlives its processes.
+  writer.reset();
+  reader = MappedFileResultCacheBackend::Open(path, /*num_slots=*/16,
+                                              /*slot_size=*/1024);
+  ASSERT_NE(nullptr, reader);
+  EXPECT_TRUE(reader->Lookup(Fingerprint128("a"), &result));
+  std::remove(path.c_str());
+}
+
+TEST(ResultCacheTest, MappedFileBackendReclaimsSlotsOfDeadWriters) {
+  std::string path = ::testing::TempDir() + "/result-cache_test.cache";
+  std::remove(path.c_str());
+  auto backend = MappedFileResultCacheBackend::Open(path, /*num_slots=*/16,
+                                                    /*slot_size=*/1024);
+  ASSERT_NE(nullptr, backend);
+  ResultCacheKey key = Fingerprint128("a");
+  backend->Store(key, ResultWithErrors(2));
+
+  // Leave the slot as a writer which died mid-Store would: with an odd
+  // sequence counter, the first field of the slot, past the 64 byte header.
+  FILE* file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(nullptr, file);
+  uint32_t sequence = 3;
+  std::fseek(file, 64 + (key.low % 16) * 1024, SEEK_SET);
+  std::fwrite(&sequence, sizeof(sequence), 1, file);
+  std::fclose(file);
+
+  ValidationResult result;
+  EXPECT_FALSE(backend->Lookup(key, &result));
+  // The write may still be in progress.
+  backend->Store(key, ResultWithErrors(2));
+  EXPECT_FALSE(backend->Lookup(key, &result));
+
+  backend = MappedFileResultCacheBackend::Open(
+      path, /*num_slots=*/16, /*slot_size=*/1024,
+      /*stale_write_timeout=*/std::chrono::nanoseconds(0));
+  ASSERT_NE(nullptr, backend);
+  backend->Store(key, ResultWithErrors(2));
+  ASSERT_TRUE(backend->Lookup(key, &result));
+  EXPECT_EQ(ResultWithErrors(2).DebugString(), result.DebugString());
+  std::remove(path.c_str());
+}
+
+TEST(ResultCacheTest, MappedFileBackendMissesTornResults) {
+  std::string path = ::testing::TempDir() + "/result-cache_test.cache";
+  std::remove(path.c_str());
+  auto backend = MappedFileResultCacheBackend::Open(path, /*num_slots=*/16,
+                                                    /*slot_size=*/1024);
+  ASSERT_NE(nullptr, backend);
+  ResultCacheKey key = Fingerprint128("a");
+  backend->Store(key, ResultWithErrors(2));
+  ValidationResult result;
+  ASSERT_TRUE(backend->Lookup(key, &result));
+
+  // Leave the slot as a writer which was taken for dead, but went on to
+  // write after the slot was published, would: with a changed byte of the
+  // result, past the 64 byte file header and the 40 byte slot header.
+  FILE* file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(nullptr, file);
+  long offset = 64 + (key.low % 16) * 1024 + 40;
+  std::fseek(file, offset, SEEK_SET);
+  int byte = std::fgetc(file);
+  std::fseek(file, offset, SEEK_SET);
+  std::fputc(byte ^ 1, file);
+  std::fclose(file);
+
+  EXPECT_FALSE(backend->Lookup(key, &result));
+  std::remove(path.c_str());
+}
+
+}  // namespace
+}  // namespace amp::validator
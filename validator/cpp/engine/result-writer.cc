@@ -0,0 +1,509 @@
+#include "cpp/engine/result-writer.h"
+
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+#include "cpp/engine/error-formatter.h"
+#include "cpp/htmlparser/logging.h"
+
+namespace amp::validator {
+
+namespace {
+
+constexpr char kCompactMagic[4] = {'A', 'M', 'P', 'R'};
+constexpr char kCompactVersion = 1;
+constexpr uint64_t kCompactHasMessages = 1;
+// Messages are formatted in place, after a varint for their length which is
+// padded to this many bytes.
+constexpr int kPaddedVarintSize = 5;
+
+void AppendVarint(uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    *out += static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  *out += static_cast<char>(value);
+}
+
+void AppendZigZag(int32_t value, std::string* out) {
+  AppendVarint((static_cast<uint32_t>(value) << 1) ^
+                   static_cast<uint32_t>(value >> 31),
+               out);
+}
+
+void AppendString(std::string_view value, std::string* out) {
+  AppendVarint(value.size(), out);
+  out->append(value);
+}
+
+void SetFixed32(uint32_t value, char* out) {
+  for (int i = 0; i < 4; ++i) out[i] = static_cast<char>(value >> (8 * i));
+}
+
+// Reads what the Append functions above wrote, checking that it stays
+// within |data|.
+class CompactDecoder {
+ public:
+  explicit CompactDecoder(std::string_view data, size_t pos = 0)
+      : data_(data), pos_(pos) {}
+
+  bool Varint(uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && pos_ < data_.size(); shift += 7) {
+      uint8_t byte = data_[pos_++];
+      *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+
+  bool Int32(int32_t* value) {
+    uint64_t varint;
+    if (!Varint(&varint) || varint > UINT32_MAX) return false;
+    *value = static_cast<int32_t>(varint);
+    return true;
+  }
+
+  bool ZigZag(int32_t* value) {
+    uint64_t varint;
+    if (!Varint(&varint) || varint > UINT32_MAX) return false;
+    *value = static_cast<int32_t>(varint >> 1) ^
+             -static_cast<int32_t>(varint & 1);
+    return true;
+  }
+
+  bool Fixed32(uint32_t* value) {
+    if (data_.size() - pos_ < 4) return false;
+    *value = 0;
+    for (int i = 3; i >= 0; --i)
+      *value = (*value << 8) | static_cast<uint8_t>(data_[pos_ + i]);
+    pos_ += 4;
+    return true;
+  }
+
+  bool String(std::string_view* value) {
+    uint64_t size;
+    if (!Varint(&size) || size > data_.size() - pos_) return false;
+    *value = data_.substr(pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  size_t pos() const { return pos_; }
+
+ private:
+  std::string_view data_;
+  size_t pos_;
+};
+
+void AppendCompactError(const ValidationError& error,
+                        const ResultWriterOptions& options, std::string* out) {
+  AppendVarint(error.severity(), out);
+  AppendVarint(error.code(), out);
+  AppendZigZag(error.line(), out);
+  AppendZigZag(error.col(), out);
+  AppendVarint(error.category(), out);
+  AppendString(error.spec_url(), out);
+  AppendVarint(error.params_size(), out);
+  for (const std::string& param : error.params()) AppendString(param, out);
+  AppendString(error.data_amp_report_test_value(), out);
+  if (options.include_messages) {
+    size_t size_pos = out->size();
+    out->append(kPaddedVarintSize, '\0');
+    ErrorFormatter::AppendFormattedMessageFor(error, out);
+    uint64_t size = out->size() - size_pos - kPaddedVarintSize;
+    for (int i = 0; i < kPaddedVarintSize; ++i) {
+      (*out)[size_pos + i] = static_cast<char>(
+          (size & 0x7f) | (i + 1 < kPaddedVarintSize ? 0x80 : 0));
+      size >>= 7;
+    }
+  }
+}
+
+// Appends |value| to |out| as the contents of a JSON string, escaped like
+// google::protobuf::util::MessageToJsonString() does, which besides what
+// JSON requires escapes '<', '>' and invisible characters. Drops invalid
+// UTF-8.
+void AppendJsonEscaped(std::string_view value, std::string* out) {
+  auto append_escape = [out](uint32_t code_unit) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    char escape[6] = {'\\',
+                      'u',
+                      kHex[(code_unit >> 12) & 0xf],
+                      kHex[(code_unit >> 8) & 0xf],
+                      kHex[(code_unit >> 4) & 0xf],
+                      kHex[code_unit & 0xf]};
+    out->append(escape, sizeof(escape));
+  };
+  for (size_t i = 0; i < value.size();) {
+    uint8_t byte = value[i];
+    if (byte < 0x80) {
+      switch (byte) {
+        case '"':
+          out->append("\\\"");
+          break;
+        case '\\':
+          out->append("\\\\");
+          break;
+        case '\b':
+          out->append("\\b");
+          break;
+        case '\f':
+          out->append("\\f");
+          break;
+        case '\n':
+          out->append("\\n");
+          break;
+        case '\r':
+          out->append("\\r");
+          break;
+        case '\t':
+          out->append("\\t");
+          break;
+        default:
+          if (byte < 0x20 || byte == '<' || byte == '>' || byte == 0x7f) {
+            append_escape(byte);
+          } else {
+            *out += static_cast<char>(byte);
+          }
+      }
+      ++i;
+      continue;
+    }
+
+    int size = byte >= 0xf8   ? 0
+               : byte >= 0xf0 ? 4
+               : byte >= 0xe0 ? 3
+               : byte >= 0xc0 ? 2
+                              : 0;
+    uint32_t code_point = size == 4   ? byte & 0x07
+                          : size == 3 ? byte & 0x0f
+                                      : byte & 0x1f;
+    bool valid = size > 0 && i + size <= value.size();
+    for (int j = 1; valid && j < size; ++j) {
+      uint8_t continuation = value[i + j];
+      valid = (continuation & 0xc0) == 0x80;
+      code_point = (code_point << 6) | (continuation & 0x3f);
+    }
+    // Overlong encodings, surrogates and what is past Unicode.
+    valid = valid &&
+            code_point >= (size == 2 ? 0x80 : size == 3 ? 0x800 : 0x10000) &&
+            (code_point < 0xd800 || code_point > 0xdfff) &&
+            code_point <= 0x10ffff;
+    if (!valid) {
+      ++i;
+      continue;
+    }
+    bool escaped = (code_point >= 0x80 && code_point <= 0x9f) ||
+                   code_point == 0xad ||
+                   (code_point >= 0x600 && code_point <= 0x603) ||
+                   code_point == 0x6dd || code_point == 0x70f ||
+                   (code_point >= 0x17b4 && code_point <= 0x17b5) ||
+                   (code_point >= 0x200b && code_point <= 0x200f) ||
+                   (code_point >= 0x2028 && code_point <= 0x202e) ||
+                   (code_point >= 0x2060 && code_point <= 0x2064) ||
+                   (code_point >= 0x206a && code_point <= 0x206f) ||
+                   code_point == 0xfeff ||
+                   (code_point >= 0xfff9 && code_point <= 0xfffb) ||
+                   (code_point >= 0x1d173 && code_point <= 0x1d17a) ||
+                   code_point == 0xe0001 ||
+                   (code_point >= 0xe0020 && code_point <= 0xe007f);
+    if (!escaped) {
+      out->append(value.substr(i, size));
+    } else if (code_point < 0x10000) {
+      append_escape(code_point);
+    } else {
+      code_point -= 0x10000;
+      append_escape(0xd800 + (code_point >> 10));
+      append_escape(0xdc00 + (code_point & 0x3ff));
+    }
+    i += size;
+  }
+}
+
+// Writes JSON to an OutputSink through a buffer, which also holds on to the
+// storage of formatted messages between errors.
+class JsonWriter {
+ public:
+  JsonWriter(OutputSink* sink, const ResultWriterOptions& options)
+      : sink_(sink), options_(options) {}
+
+  void Result(const ValidationResult& result) {
+    bool first = true;
+    buffer_ += '{';
+    if (result.errors_size() > 0) {
+      Field("errors", &first);
+      buffer_ += '[';
+      for (int i = 0; i < result.errors_size(); ++i) {
+        if (i > 0) buffer_ += ',';
+        Error(result.errors(i));
+        MaybeFlush();
+      }
+      buffer_ += ']';
+    }
+    if (result.has_status()) {
+      Field("status", &first);
+      Enum(ValidationResult::Status_Name(result.status()), result.status());
+    }
+    if (result.type_identifier_size() > 0) {
+      Field("typeIdentifier", &first);
+      buffer_ += '[';
+      for (int i = 0; i < result.type_identifier_size(); ++i) {
+        if (i > 0) buffer_ += ',';
+        String(result.type_identifier(i));
+      }
+      buffer_ += ']';
+    }
+    if (result.has_transformer_version()) {
+      Field("transformerVersion", &first);
+      absl::StrAppend(&buffer_, result.transformer_version());
+    }
+    if (result.value_set_provisions_size() > 0) {
+      Field("valueSetProvisions", &first);
+      buffer_ += '[';
+      for (int i = 0; i < result.value_set_provisions_size(); ++i) {
+        if (i > 0) buffer_ += ',';
+        Provision(result.value_set_provisions(i));
+      }
+      buffer_ += ']';
+    }
+    if (result.value_set_requirements_size() > 0) {
+      Field("valueSetRequirements", &first);
+      buffer_ += '[';
+      for (int i = 0; i < result.value_set_requirements_size(); ++i) {
+        if (i > 0) buffer_ += ',';
+        Requirement(result.value_set_requirements(i));
+        MaybeFlush();
+      }
+      buffer_ += ']';
+    }
+    buffer_ += '}';
+    sink_->Write(buffer_);
+    buffer_.clear();
+  }
+
+ private:
+  // Flushes the buffer to the sink at this size.
+  static constexpr size_t kFlushSize = 4096;
+
+  void MaybeFlush() {
+    if (buffer_.size() < kFlushSize) return;
+    sink_->Write(buffer_);
+    buffer_.clear();
+  }
+
+  // Starts the field |name| of an object, |first| tracking whether a comma
+  // is needed.
+  void Field(std::string_view name, bool* first) {
+    if (!*first) buffer_ += ',';
+    *first = false;
+    buffer_ += '"';
+    buffer_.append(name);
+    buffer_.append("\":");
+  }
+
+  void String(std::string_view value) {
+    buffer_ += '"';
+    AppendJsonEscaped(value, &buffer_);
+    buffer_ += '"';
+  }
+
+  // Unknown enum values are written as numbers.
+  void Enum(const std::string& name, int value) {
+    if (name.empty()) {
+      absl::StrAppend(&buffer_, value);
+    } else {
+      String(name);
+    }
+  }
+
+  void Error(const ValidationError& error) {
+    bool first = true;
+    buffer_ += '{';
+    if (error.has_code()) {
+      Field("code", &first);
+      Enum(ValidationError::Code_Name(error.code()), error.code());
+    }
+    if (error.has_line()) {
+      Field("line", &first);
+      absl::StrAppend(&buffer_, error.line());
+    }
+    if (error.has_col()) {
+      Field("col", &first);
+      absl::StrAppend(&buffer_, error.col());
+    }
+    if (error.has_spec_url()) {
+      Field("specUrl", &first);
+      String(error.spec_url());
+    }
+    if (error.has_severity()) {
+      Field("severity", &first);
+      Enum(ValidationError::Severity_Name(error.severity()), error.severity());
+    }
+    if (error.params_size() > 0) {
+      Field("params", &first);
+      buffer_ += '[';
+      for (int i = 0; i < error.params_size(); ++i) {
+        if (i > 0) buffer_ += ',';
+        String(error.params(i));
+      }
+      buffer_ += ']';
+    }
+    if (error.has_category()) {
+      Field("category", &first);
+      Enum(ErrorCategory::Code_Name(error.category()), error.category());
+    }
+    if (error.has_data_amp_report_test_value()) {
+      Field("dataAmpReportTestValue", &first);
+      String(error.data_amp_report_test_value());
+    }
+    if (options_.include_messages) {
+      Field("message", &first);
+      message_.clear();
+      ErrorFormatter::AppendFormattedMessageFor(error, &message_);
+      String(message_);
+    }
+    buffer_ += '}';
+  }
+
+  void Provision(const ValueSetProvision& provision) {
+    bool first = true;
+    buffer_ += '{';
+    if (provision.has_set()) {
+      Field("set", &first);
+      Enum(AttrSpec::ValueSet_Name(provision.set()), provision.set());
+    }
+    if (provision.has_value()) {
+      Field("value", &first);
+      String(provision.value());
+    }
+    buffer_ += '}';
+  }
+
+  void Requirement(const ValueSetRequirement& requirement) {
+    bool first = true;
+    buffer_ += '{';
+    if (requirement.has_provision()) {
+      Field("provision", &first);
+      Provision(requirement.provision());
+    }
+    if (requirement.has_error_if_unsatisfied()) {
+      Field("errorIfUnsatisfied", &first);
+      Error(requirement.error_if_unsatisfied());
+    }
+    buffer_ += '}';
+  }
+
+  OutputSink* sink_;
+  const ResultWriterOptions& options_;
+  std::string buffer_;
+  std::string message_;
+};
+
+}  // namespace
+
+void WriteCompactResult(const ValidationResult& result, std::string* out,
+                        const ResultWriterOptions& options) {
+  const size_t start = out->size();
+  out->append(kCompactMagic, sizeof(kCompactMagic));
+  *out += kCompactVersion;
+  AppendVarint(options.include_messages ? kCompactHasMessages : 0, out);
+  AppendVarint(result.status(), out);
+  AppendVarint(static_cast<uint32_t>(result.transformer_version()), out);
+  AppendVarint(result.type_identifier_size(), out);
+  for (const std::string& type_identifier : result.type_identifier())
+    AppendString(type_identifier, out);
+  AppendVarint(result.errors_size(), out);
+  size_t offsets = out->size();
+  out->append(4 * result.errors_size(), '\0');
+  for (int i = 0; i < result.errors_size(); ++i) {
+    SetFixed32(out->size() - start, &(*out)[offsets + 4 * i]);
+    AppendCompactError(result.errors(i), options, out);
+  }
+}
+
+std::string_view CompactErrorView::params(int index) const {
+  CHECK(index >= 0 && index < params_size_) << index;
+  CompactDecoder decoder(params_);
+  std::string_view param;
+  for (int i = 0; i <= index; ++i) decoder.String(&param);
+  return param;
+}
+
+bool CompactErrorView::Decode(std::string_view data, size_t offset,
+                              bool has_messages) {
+  if (offset >= data.size()) return false;
+  CompactDecoder decoder(data, offset);
+  int32_t severity, code, category;
+  if (!decoder.Int32(&severity) ||
+      !ValidationError::Severity_IsValid(severity) || !decoder.Int32(&code) ||
+      !ValidationError::Code_IsValid(code) || !decoder.ZigZag(&line_) ||
+      !decoder.ZigZag(&col_) || !decoder.Int32(&category) ||
+      !ErrorCategory::Code_IsValid(category) || !decoder.String(&spec_url_) ||
+      !decoder.Int32(&params_size_) || params_size_ < 0)
+    return false;
+  severity_ = static_cast<ValidationError::Severity>(severity);
+  code_ = static_cast<ValidationError::Code>(code);
+  category_ = static_cast<ErrorCategory::Code>(category);
+  size_t params_start = decoder.pos();
+  std::string_view param;
+  for (int i = 0; i < params_size_; ++i)
+    if (!decoder.String(&param)) return false;
+  params_ = data.substr(params_start, decoder.pos() - params_start);
+  if (!decoder.String(&data_amp_report_test_value_)) return false;
+  return !has_messages || decoder.String(&message_);
+}
+
+std::optional<CompactResultView> CompactResultView::Parse(
+    std::string_view data) {
+  if (data.size() < sizeof(kCompactMagic) + 1 ||
+      std::memcmp(data.data(), kCompactMagic, sizeof(kCompactMagic)) != 0 ||
+      data[sizeof(kCompactMagic)] != kCompactVersion)
+    return std::nullopt;
+  CompactResultView view;
+  view.data_ = data;
+  CompactDecoder decoder(data, sizeof(kCompactMagic) + 1);
+  uint64_t flags, num_type_identifiers, num_errors;
+  int32_t status;
+  if (!decoder.Varint(&flags) || !decoder.Int32(&status) ||
+      !ValidationResult::Status_IsValid(status) ||
+      !decoder.Int32(&view.transformer_version_) ||
+      !decoder.Varint(&num_type_identifiers) ||
+      num_type_identifiers > data.size())
+    return std::nullopt;
+  view.has_messages_ = flags & kCompactHasMessages;
+  view.status_ = static_cast<ValidationResult::Status>(status);
+  view.type_identifiers_.resize(num_type_identifiers);
+  for (std::string_view& type_identifier : view.type_identifiers_)
+    if (!decoder.String(&type_identifier)) return std::nullopt;
+
+  if (!decoder.Varint(&num_errors) ||
+      num_errors > (data.size() - decoder.pos()) / 4)
+    return std::nullopt;
+  view.num_errors_ = num_errors;
+  view.error_offsets_ = decoder.pos();
+  // Check all the errors once, so that error() needn't.
+  for (uint64_t i = 0; i < num_errors; ++i) {
+    uint32_t offset = 0;
+    if (!decoder.Fixed32(&offset) ||
+        !CompactErrorView().Decode(data, offset, view.has_messages_))
+      return std::nullopt;
+  }
+  return view;
+}
+
+CompactErrorView CompactResultView::error(int index) const {
+  CHECK(index >= 0 && index < num_errors_) << index;
+  uint32_t offset = 0;
+  CHECK(CompactDecoder(data_, error_offsets_ + 4 * index).Fixed32(&offset));
+  CompactErrorView error;
+  CHECK(error.Decode(data_, offset, has_messages_));
+  return error;
+}
+
+void WriteJsonResult(const ValidationResult& result, OutputSink* sink,
+                     const ResultWriterOptions& options) {
+  JsonWriter(sink, options).Result(result);
+}
+
+}  // namespace amp::validator
@@ -0,0 +1,162 @@
+// Writers of ValidationResults for clients which would rather not go through
+// the proto, e.g. for documents with thousands of errors:
+//
+// - A compact binary encoding, which CompactResultView reads in place.
+// - JSON, as google::protobuf::util::MessageToJsonString() prints it, written
+//   to an OutputSink as it goes.
+//
+// Both may include the formatted message of each error, which is written by
+// the ErrorFormatter straight into the output.
+//
+// Usage:
+//   std::string compact;
+//   amp::validator::WriteCompactResult(result, &compact);
+//   auto view = amp::validator::CompactResultView::Parse(compact);
+//   for (int i = 0; i < view->errors_size(); ++i)
+//     std::cout << view->error(i).line() << ": " << view->error(i).code();
+//
+//   amp::validator::StringOutputSink sink(&json);
+//   amp::validator::WriteJsonResult(result, &sink);
+
+#ifndef CPP_ENGINE_RESULT_WRITER_H_
+#define CPP_ENGINE_RESULT_WRITER_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "validator.pb.h"
+
+namespace amp::validator {
+
+// Where WriteJsonResult() writes to.
+class OutputSink {
+ public:
+  virtual ~OutputSink() = default;
+
+  virtual void Write(std::string_view data) = 0;
+};
+
+// Appends to a string.
+class StringOutputSink : public OutputSink {
+ public:
+  explicit StringOutputSink(std::string* out) : out_(out) {}
+
+  void Write(std::string_view data) override { out_->append(data); }
+
+ private:
+  std::string* out_;
+};
+
+struct ResultWriterOptions {
+  // Whether to write the formatted message of each error, see
+  // ErrorFormatter::FormattedMessageFor. In JSON, this is the "message"
+  // field of each error, which the proto doesn't have.
+  bool include_messages = false;
+};
+
+// Appends the compact encoding of |result| to |out|. This has the status,
+// transformer_version, type identifiers and errors of |result|, but not its
+// value set provisions and requirements, which only matter while
+// validating.
+//
+// The encoding starts with the magic "AMPR" and a version byte, then
+// varints for the flags (1 if messages are included), the status, the
+// transformer_version and the number of type identifiers, followed by
+// these. Then comes a varint for the number of errors, a table of the
+// fixed32 (little endian) offsets of the errors from the start of the
+// encoding, and the errors. An error is varints for its severity, code,
+// line, col (the latter two zigzag encoded) and category, then its
+// spec_url, the number of its params, the params, its
+// data_amp_report_test_value and its message if included. Strings are a
+// varint for their length, followed by their bytes. The length of messages
+// is padded to 5 bytes, so that they can be formatted in place.
+void WriteCompactResult(const ValidationResult& result, std::string* out,
+                        const ResultWriterOptions& options = {});
+
+// An error of a CompactResultView. Strings point into the encoding.
+class CompactErrorView {
+ public:
+  ValidationError::Severity severity() const { return severity_; }
+  ValidationError::Code code() const { return code_; }
+  int32_t line() const { return line_; }
+  int32_t col() const { return col_; }
+  ErrorCategory::Code category() const { return category_; }
+  std::string_view spec_url() const { return spec_url_; }
+  int params_size() const { return params_size_; }
+  // Decodes the params up to the |index|th on every call, so iterating over
+  // params is quadratic in their number, which is small.
+  std::string_view params(int index) const;
+  std::string_view data_amp_report_test_value() const {
+    return data_amp_report_test_value_;
+  }
+  // Empty unless the encoding includes messages.
+  std::string_view message() const { return message_; }
+
+ private:
+  friend class CompactResultView;
+
+  CompactErrorView() = default;
+
+  // Decodes the error at |offset| of |data|. Returns false if it is not
+  // well-formed.
+  bool Decode(std::string_view data, size_t offset, bool has_messages);
+
+  ValidationError::Severity severity_ = ValidationError::ERROR;
+  ValidationError::Code code_ = ValidationError::UNKNOWN_CODE;
+  int32_t line_ = 1;
+  int32_t col_ = 0;
+  ErrorCategory::Code category_ = ErrorCategory::UNKNOWN;
+  std::string_view spec_url_;
+  int params_size_ = 0;
+  // The encoded params.
+  std::string_view params_;
+  std::string_view data_amp_report_test_value_;
+  std::string_view message_;
+};
+
+// Reads the encoding of WriteCompactResult() in place, without copying its
+// strings. The encoding must outlive the view.
+class CompactResultView {
+ public:
+  // Returns nullopt if |data| is not a well-formed encoding. Accessors of
+  // a view that is returned can't fail.
+  static std::optional<CompactResultView> Parse(std::string_view data);
+
+  ValidationResult::Status status() const { return status_; }
+  int32_t transformer_version() const { return transformer_version_; }
+  int type_identifier_size() const { return type_identifiers_.size(); }
+  std::string_view type_identifier(int index) const {
+    return type_identifiers_[index];
+  }
+  bool has_messages() const { return has_messages_; }
+  int errors_size() const { return num_errors_; }
+  // Decodes the |index|th error.
+  CompactErrorView error(int index) const;
+
+ private:
+  CompactResultView() = default;
+
+  std::string_view data_;
+  ValidationResult::Status status_ = ValidationResult::UNKNOWN;
+  int32_t transformer_version_ = 0;
+  std::vector<std::string_view> type_identifiers_;
+  bool has_messages_ = false;
+  int num_errors_ = 0;
+  // Where the table of error offsets starts in |data_|.
+  size_t error_offsets_ = 0;
+};
+
+// Writes |result| to |sink| as JSON, in the format of
+// google::protobuf::util::MessageToJsonString() with its default options,
+// through a small buffer. Invalid UTF-8 is dropped from strings. The
+// deprecated validator_revision and spec_file_revision fields, which the
+// validator doesn't set, are not written.
+void WriteJsonResult(const ValidationResult& result, OutputSink* sink,
+                     const ResultWriterOptions& options = {});
+
+}  // namespace amp::validator
+
+#endif  // CPP_ENGINE_RESULT_WRITER_H_
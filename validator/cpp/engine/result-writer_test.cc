@@ -0,0 +1,181 @@
+#include "cpp/engine/result-writer.h"
+
+#include <string>
+#include <vector>
+
+#include "google/protobuf/util/json_util.h"
+#include "gtest/gtest.h"
+#include "cpp/engine/error-formatter.h"
+#include "cpp/engine/testing-utils.h"
+#include "cpp/engine/validator.h"
+#include "validator.pb.h"
+
+namespace amp::validator {
+namespace {
+
+using testing::TestCases;
+
+std::string ProtobufJson(const ValidationResult& result) {
+  std::string json;
+  EXPECT_TRUE(google::protobuf::util::MessageToJsonString(result, &json).ok());
+  return json;
+}
+
+std::string Json(const ValidationResult& result,
+                 const ResultWriterOptions& options = {}) {
+  std::string json;
+  StringOutputSink sink(&json);
+  WriteJsonResult(result, &sink, options);
+  return json;
+}
+
+// Keeps every write separately.
+class ChunkOutputSink : public OutputSink {
+ public:
+  void Write(std::string_view data) override { chunks.emplace_back(data); }
+
+  std::vector<std::string> chunks;
+};
+
+void ExpectCompactEquals(const ValidationResult& result,
+                         const CompactResultView& view, bool has_messages) {
+  EXPECT_EQ(result.status(), view.status());
+  EXPECT_EQ(result.transformer_version(), view.transformer_version());
+  ASSERT_EQ(result.type_identifier_size(), view.type_identifier_size());
+  for (int i = 0; i < result.type_identifier_size(); ++i)
+    EXPECT_EQ(result.type_identifier(i), view.type_identifier(i));
+  EXPECT_EQ(has_messages, view.has_messages());
+  ASSERT_EQ(result.errors_size(), view.errors_size());
+  for (int i = 0; i < result.errors_size(); ++i) {
+    const ValidationError& error = result.errors(i);
+    CompactErrorView error_view = view.error(i);
+    EXPECT_EQ(error.severity(), error_view.severity());
+    EXPECT_EQ(error.code(), error_view.code());
+    EXPECT_EQ(error.line(), error_view.line());
+    EXPECT_EQ(error.col(), error_view.col());
+    EXPECT_EQ(error.category(), error_view.category());
+    EXPECT_EQ(error.spec_url(), error_view.spec_url());
+    ASSERT_EQ(error.params_size(), error_view.params_size());
+    for (int j = 0; j < error.params_size(); ++j)
+      EXPECT_EQ(error.params(j), error_view.params(j));
+    EXPECT_EQ(error.data_amp_report_test_value(),
+              error_view.data_amp_report_test_value());
+    EXPECT_EQ(has_messages ? ErrorFormatter::FormattedMessageFor(error) : "",
+              error_view.message());
+  }
+}
+
+ValidationResult ResultWithEverything() {
+  ValidationResult result;
+  result.set_status(ValidationResult::FAIL);
+  result.set_transformer_version(-1);
+  result.add_type_identifier("⚡");
+  result.add_type_identifier("transformed");
+  ValidationError* error = result.add_errors();
+  error->set_code(ValidationError::DISALLOWED_TAG);
+  error->set_line(-3);
+  error->set_col(1 << 20);
+  error->add_params("<a href=\"x\">\t&'\\\x01\x7f é \U0001D173 ⚡");
+  error->set_spec_url("https://amp.dev/?a=b&c");
+  error->set_data_amp_report_test_value("test");
+  error = result.add_errors();
+  error->set_severity(ValidationError::WARNING);
+  error->set_category(ErrorCategory::UNKNOWN);
+  ValueSetRequirement* requirement = result.add_value_set_requirements();
+  requirement->mutable_provision()->set_set(AttrSpec::TEMPLATE_IDS);
+  requirement->mutable_provision()->set_value("id");
+  requirement->mutable_error_if_unsatisfied()->set_code(
+      ValidationError::VALUE_SET_MISMATCH);
+  result.add_value_set_provisions()->set_value("id");
+  return result;
+}
+
+TEST(ResultWriterTest, CompactResultRoundTrips) {
+  for (bool include_messages : {false, true}) {
+    ResultWriterOptions options;
+    options.include_messages = include_messages;
+    for (const auto& [name, test_case] : TestCases()) {
+      ValidationResult result =
+          Validate(test_case.input_content, test_case.html_format);
+      std::string compact;
+      WriteCompactResult(result, &compact, options);
+      std::optional<CompactResultView> view = CompactResultView::Parse(compact);
+      ASSERT_TRUE(view.has_value()) << name;
+      ExpectCompactEquals(result, *view, include_messages);
+    }
+
+    ValidationResult result = ResultWithEverything();
+    std::string compact = "prefix";
+    WriteCompactResult(result, &compact, options);
+    std::optional<CompactResultView> view =
+        CompactResultView::Parse(std::string_view(compact).substr(6));
+    ASSERT_TRUE(view.has_value());
+    ExpectCompactEquals(result, *view, include_messages);
+  }
+}
+
+TEST(ResultWriterTest, ParseRejectsMalformedCompactResults) {
+  ResultWriterOptions options;
+  options.include_messages = true;
+  std::string compact;
+  WriteCompactResult(ResultWithEverything(), &compact, options);
+  for (size_t size = 0; size < compact.size(); ++size)
+    EXPECT_FALSE(CompactResultView::Parse(compact.substr(0, size)).has_value())
+        << size;
+  std::string bad_magic = compact;
+  bad_magic[0] = 'X';
+  EXPECT_FALSE(CompactResultView::Parse(bad_magic).has_value());
+  std::string bad_version = compact;
+  bad_version[4] = 2;
+  EXPECT_FALSE(CompactResultView::Parse(bad_version).has_value());
+}
+
+TEST(ResultWriterTest, JsonMatchesProtobuf) {
+  for (const auto& [name, test_case] : TestCases()) {
+    ValidationResult result =
+        Validate(test_case.input_content, test_case.html_format);
+    EXPECT_EQ(ProtobufJson(result), Json(result)) << name;
+  }
+  EXPECT_EQ(ProtobufJson(ResultWithEverything()),
+            Json(ResultWithEverything()));
+  EXPECT_EQ(ProtobufJson(ValidationResult()), Json(ValidationResult()));
+}
+
+TEST(ResultWriterTest, JsonDropsInvalidUtf8) {
+  ValidationResult result;
+  result.add_type_identifier("a\xff" "b\xc3" "c\xed\xa0\x80" "d\xc0\x80");
+  EXPECT_EQ(R"({"typeIdentifier":["abcd"]})", Json(result));
+}
+
+TEST(ResultWriterTest, JsonIncludesMessages) {
+  ValidationResult result;
+  ValidationError* error = result.add_errors();
+  error->set_code(ValidationError::DISALLOWED_TAG);
+  error->add_params("foo");
+  ResultWriterOptions options;
+  options.include_messages = true;
+  EXPECT_EQ(
+      R"({"errors":[{"code":"DISALLOWED_TAG","params":["foo"],)"
+      R"("message":"The tag 'foo' is disallowed."}]})",
+      Json(result, options));
+}
+
+TEST(ResultWriterTest, JsonIsWrittenAsItGoes) {
+  ValidationResult result;
+  result.set_status(ValidationResult::FAIL);
+  for (int i = 0; i < 1000; ++i) {
+    ValidationError* error = result.add_errors();
+    error->set_code(ValidationError::DISALLOWED_TAG);
+    error->set_line(i + 1);
+    error->add_params("foo");
+  }
+  ChunkOutputSink sink;
+  WriteJsonResult(result, &sink);
+  EXPECT_GT(sink.chunks.size(), 1);
+  std::string json;
+  for (const std::string& chunk : sink.chunks) json += chunk;
+  EXPECT_EQ(ProtobufJson(result), json);
+}
+
+}  // namespace
+}  // namespace amp::validator
@@ -1,8 +1,14 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <unordered_map>
 #include <unordered_set>
 
@@ -14,8 +20,10 @@
 #include "absl/container/node_hash_map.h"
 #include "absl/container/node_hash_set.h"
 #include "absl/flags/flag.h"
+#include "absl/hash/hash.h"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/match.h"
 #include "absl/strings/numbers.h"
@@ -25,12 +33,14 @@
 #include "absl/strings/strip.h"
 #include "absl/strings/substitute.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "cpp/engine/keyframes-parse-css.h"
 #include "cpp/engine/parse-layout.h"
 #include "cpp/engine/parse-srcset.h"
 #include "cpp/engine/parse-viewport.h"
 #include "cpp/engine/type-identifier.h"
 #include "cpp/engine/utf8-util.h"
+#include "cpp/engine/validator.h"
 #include "cpp/engine/validator_pb.h"
 #include "cpp/htmlparser/atom.h"
 #include "cpp/htmlparser/atomutil.h"
@@ -47,6 +57,7 @@
 #include "cpp/htmlparser/validators/json.h"
 #include "validator.pb.h"
 #include "re2/re2.h"  // NOLINT(build/deprecated)
+#include "re2/set.h"
 
 using absl::AsciiStrToLower;
 using absl::AsciiStrToUpper;
@@ -88,8 +99,152 @@ ABSL_FLAG(int, max_node_recursion_depth, 200,
           "Maximum recursion depth of nodes, if stack of nodes grow beyond this"
           "validator will stop parsing with FAIL result");
 
+ABSL_FLAG(int, attr_value_cache_size, 0,
+          "Maximum number of attribute values which passed validation against "
+          "their attribute spec to remember across documents, so that they "
+          "needn't be validated again. 0 disables the cache.");
+
+ABSL_FLAG(int, css_validation_threads, 0,
+          "Number of worker threads which parse the stylesheets of <style> "
+          "tags while the validator goes on with the rest of the document. "
+          "Only used when all errors are reported (max_errors of -1). 0 "
+          "parses stylesheets where they are encountered.");
+
 namespace amp::validator {
 
+#ifdef AMP_VALIDATOR_STATS
+// The statistics of the validation running on this thread, if any.
+static thread_local ValidationStats* current_validation_stats = nullptr;
+
+// Adds the wall time of its scope to |*total|, unless |total| is null.
+class ScopedStatsTimer {
+ public:
+  explicit ScopedStatsTimer(std::chrono::nanoseconds* total)
+      : total_(total),
+        start_(total ? std::chrono::steady_clock::now()
+                     : std::chrono::steady_clock::time_point()) {}
+  ~ScopedStatsTimer() {
+    if (total_) *total_ += std::chrono::steady_clock::now() - start_;
+  }
+
+ private:
+  std::chrono::nanoseconds* total_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Adds |n| to the counter |field| of the current ValidationStats.
+#define VALIDATION_STATS_ADD(field, n)                           \
+  do {                                                           \
+    if (current_validation_stats)                                \
+      current_validation_stats->field += (n);                    \
+  } while (0)
+// Adds the time of the enclosing scope to |field| of the current
+// ValidationStats.
+#define VALIDATION_STATS_TIMER(field)                                        \
+  ScopedStatsTimer stats_timer_##field(                                      \
+      current_validation_stats ? &current_validation_stats->field : nullptr)
+#else
+#define VALIDATION_STATS_ADD(field, n) \
+  do {                                 \
+  } while (0)
+#define VALIDATION_STATS_TIMER(field)
+#endif  // AMP_VALIDATOR_STATS
+
+// Whether statistics are being collected for the validation running on this
+// thread.
+static bool CollectingValidationStats() {
+#ifdef AMP_VALIDATOR_STATS
+  return current_validation_stats != nullptr;
+#else
+  return false;
+#endif
+}
+
+// Per spec counters of the rules for an html format, see GetRulesProfiles().
+// They are shared by the validations on all threads.
+class RulesProfiler {
+ public:
+  struct TagSpecCounters {
+    std::atomic<int64_t> attempts{0};
+    std::atomic<int64_t> wins{0};
+    std::atomic<int64_t> time_ns{0};
+    std::atomic<int64_t> attribute_time_ns{0};
+  };
+  struct AttrSpecCounters {
+    std::atomic<int64_t> regex_evaluations{0};
+    std::atomic<int64_t> regex_time_ns{0};
+    // Values found in the AttrValueCache, which weren't evaluated again.
+    std::atomic<int64_t> cache_hits{0};
+  };
+
+  // Adds the wall time of its scope to |*total_ns|, unless it is null.
+  class ScopedTimer {
+   public:
+    explicit ScopedTimer(std::atomic<int64_t>* total_ns)
+        : total_ns_(total_ns),
+          start_(total_ns ? std::chrono::steady_clock::now()
+                          : std::chrono::steady_clock::time_point()) {}
+    ~ScopedTimer() {
+      if (!total_ns_) return;
+      total_ns_->fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count(),
+          std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<int64_t>* total_ns_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  RulesProfiler(int num_tag_specs, int num_attr_specs)
+      : tag_specs_(num_tag_specs), attr_specs_(num_attr_specs) {}
+
+  TagSpecCounters& tag_spec(int32_t id) { return tag_specs_[id]; }
+  AttrSpecCounters& attr_spec(int32_t id) { return attr_specs_[id]; }
+  const TagSpecCounters& tag_spec(int32_t id) const { return tag_specs_[id]; }
+  const AttrSpecCounters& attr_spec(int32_t id) const {
+    return attr_specs_[id];
+  }
+  int num_tag_specs() const { return tag_specs_.size(); }
+  int num_attr_specs() const { return attr_specs_.size(); }
+
+ private:
+  vector<TagSpecCounters> tag_specs_;
+  vector<AttrSpecCounters> attr_specs_;
+};
+
+// Evaluates |match|, a regex of the rules, counting it in ValidationStats,
+// and for the attribute spec |attr_spec_id| in |profiler| if set.
+template <typename Match>
+static bool EvaluateRuleRegex(const Match& match, RulesProfiler* profiler,
+                              int32_t attr_spec_id) {
+  VALIDATION_STATS_ADD(regex_evaluations, 1);
+  VALIDATION_STATS_TIMER(regex_time);
+  if (!profiler) return match();
+  RulesProfiler::AttrSpecCounters& counters =
+      profiler->attr_spec(attr_spec_id);
+  counters.regex_evaluations.fetch_add(1, std::memory_order_relaxed);
+  RulesProfiler::ScopedTimer timer(&counters.regex_time_ns);
+  return match();
+}
+
+// RE2::FullMatch() and RE2::PartialMatch() for the regexes of the rules.
+static bool RuleRegexFullMatch(string_view text, const RE2& re,
+                               RulesProfiler* profiler = nullptr,
+                               int32_t attr_spec_id = -1) {
+  return EvaluateRuleRegex([&] { return RE2::FullMatch(text, re); }, profiler,
+                           attr_spec_id);
+}
+
+static bool RuleRegexPartialMatch(string_view text, const RE2& re,
+                                  RulesProfiler* profiler = nullptr,
+                                  int32_t attr_spec_id = -1) {
+  return EvaluateRuleRegex([&] { return RE2::PartialMatch(text, re); },
+                           profiler, attr_spec_id);
+}
+
 // Standard and Nomodule JavaScript:
 // v0.js
 // v0/amp-ad-0.1.js
@@ -194,7 +349,24 @@ ValidationError PopulateError(ValidationError::Severity severity,
   return error;
 }
 
+// A validation error found while validating a tag against a single tag spec.
+// ValidateTag tries many candidate tag specs for each tag and keeps only the
+// best attempt, so errors are recorded in this form and only converted into
+// ValidationError protos for the attempt that ends up in the result.
+struct ErrorRecord {
+  ValidationError::Severity severity;
+  ValidationError::Code code;
+  LineCol line_col;
+  vector<std::string> params;
+  std::string spec_url;
+
+  ValidationError ToValidationError() const {
+    return PopulateError(severity, code, line_col, params, spec_url);
+  }
+};
+
 class ParsedTagSpec;
+class TagValidationResult;
 
 std::string TagSpecName(const TagSpec& spec);
 std::string TagDescriptiveName(const TagSpec& spec);
@@ -232,6 +404,8 @@ class ParsedHtmlTagAttr {
  public:
   const std::string& name() const { return attr_name_; }
   const std::string& value() const { return attr_value_; }
+  // The interned id of name(), see AttrNameIds.
+  int32_t name_id() const { return name_id_; }
 
   ParsedHtmlTagAttr(ParsedHtmlTagAttr&&) = default;
   ParsedHtmlTagAttr(const ParsedHtmlTagAttr&) = default;
@@ -239,11 +413,15 @@ class ParsedHtmlTagAttr {
 
  private:
   friend class ParsedHtmlTag;
-  ParsedHtmlTagAttr(const std::string& name, const std::string& value)
-      : attr_name_(AsciiStrToLower(name)), attr_value_(value) {}
+  ParsedHtmlTagAttr(std::string lower_name, const std::string& value,
+                    int32_t name_id)
+      : attr_name_(std::move(lower_name)),
+        attr_value_(value),
+        name_id_(name_id) {}
 
   std::string attr_name_;   // Stored lower-cased, regardless of original case.
   std::string attr_value_;  // Stored unescaped.
+  int32_t name_id_;
 };                          // class ParsedHtmlTagAttr
 
 // If any script in the page uses a specific release version, then all scripts
@@ -287,7 +465,7 @@ struct ScriptTag {
   ScriptReleaseVersion release_version = ScriptReleaseVersion::UNKNOWN;
 };
 
-ScriptTag ParseScriptTag(htmlparser::Node* node) {
+ScriptTag ParseScriptTag(const htmlparser::Node* node) {
   ScriptTag script_tag;
   bool has_async_attr = false;
   bool has_module_attr = false;
@@ -372,47 +550,144 @@ ScriptTag ParseScriptTag(htmlparser::Node* node) {
   return script_tag;
 }
 
+struct AtomNames {
+  std::string lower;
+  std::string upper;
+};
+
+// The lower and upper case names of all known atoms, computed once so that
+// tags and attributes with a known atom don't need any case conversion.
+const absl::flat_hash_map<htmlparser::Atom, AtomNames>& NamesByAtom() {
+  static const auto* const names_by_atom = [] {
+    auto* names_by_atom = new absl::flat_hash_map<htmlparser::Atom, AtomNames>;
+    for (uint32_t atom_value : htmlparser::kNamesHashTable) {
+      if (atom_value == 0) continue;
+      auto atom = static_cast<htmlparser::Atom>(atom_value);
+      std::string name = htmlparser::AtomUtil::ToString(atom);
+      names_by_atom->emplace(
+          atom, AtomNames{AsciiStrToLower(name), AsciiStrToUpper(name)});
+    }
+    return names_by_atom;
+  }();
+  return *names_by_atom;
+}
+
+// Interned ids for the attribute names which appear in the validator rules.
+// The attributes of an encountered tag are resolved to these ids once, via
+// their atom if they have one, so that looking them up in each candidate
+// TagSpec is an integer lookup rather than a string lookup.
+class AttrNameIds {
+ public:
+  // The id of all attribute names which don't appear in the rules.
+  static constexpr int32_t kUnknown = -1;
+
+  // Returns the id for |lower_name|, adding it if needed. Must not be called
+  // after IndexAtoms().
+  int32_t Intern(const std::string& lower_name) {
+    auto [it, inserted] = ids_by_name_.emplace(lower_name, ids_by_name_.size());
+    return it->second;
+  }
+
+  // Records the ids of all atoms with an interned name. Called once all names
+  // have been interned.
+  void IndexAtoms() {
+    for (const auto& [atom, names] : NamesByAtom()) {
+      if (auto it = ids_by_name_.find(names.lower); it != ids_by_name_.end())
+        ids_by_atom_[atom] = it->second;
+    }
+  }
+
+  int32_t Find(htmlparser::Atom atom) const {
+    auto it = ids_by_atom_.find(atom);
+    return it == ids_by_atom_.end() ? kUnknown : it->second;
+  }
+
+  int32_t Find(const std::string& lower_name) const {
+    auto it = ids_by_name_.find(lower_name);
+    return it == ids_by_name_.end() ? kUnknown : it->second;
+  }
+
+ private:
+  flat_hash_map<std::string, int32_t> ids_by_name_;
+  flat_hash_map<htmlparser::Atom, int32_t> ids_by_atom_;
+};
+
+// A tag as the validator sees it. The node is only read, so that one document
+// can be validated by several validators at once; what the validator derives
+// from it, such as the sorted attributes, is kept here.
 class ParsedHtmlTag {
  public:
-  explicit ParsedHtmlTag(htmlparser::Node* node) : node_(node) {
+  ParsedHtmlTag(const htmlparser::Node* node,
+                const AttrNameIds& attr_name_ids)
+      : node_(node) {
+    sorted_attrs_.reserve(node->Attributes().size() + 1);
+    for (const auto& attr : node->Attributes()) sorted_attrs_.push_back(&attr);
     if (node->Type() == htmlparser::NodeType::DOCTYPE_NODE) {
+      // <!doctype html> is validated as the tag !DOCTYPE with the attribute
+      // html.
       if (node->Data() == "html") {
-        node_->AddAttribute({.key = "html", .value = ""});
+        doctype_html_attr_.key = "html";
+        sorted_attrs_.push_back(&doctype_html_attr_);
       }
-
-      node_->SetData("!DOCTYPE");
-      lower_tag_name_ = "!doctype";
-      upper_tag_name_ = "!DOCTYPE";
+      own_lower_tag_name_ = "!doctype";
+      own_upper_tag_name_ = "!DOCTYPE";
+    } else if (auto it = NamesByAtom().find(node_->DataAtom());
+               it != NamesByAtom().end()) {
+      atom_ = it->first;
+      lower_tag_name_ = &it->second.lower;
+      upper_tag_name_ = &it->second.upper;
     } else {
       std::string tagname =
           htmlparser::AtomUtil::ToString(node_->DataAtom(), node_->Data());
-      lower_tag_name_ = AsciiStrToLower(tagname);
-      upper_tag_name_ = AsciiStrToUpper(tagname);
-    }
-    node_->SortAttributes(false);
-    for (const auto& attr : node_->Attributes()) {
-      attributes_.push_back(ParsedHtmlTagAttr{attr.KeyPart(), attr.value});
+      own_lower_tag_name_ = AsciiStrToLower(tagname);
+      own_upper_tag_name_ = AsciiStrToUpper(tagname);
+    }
+    // In the order of htmlparser::Node::SortAttributes().
+    std::stable_sort(sorted_attrs_.begin(), sorted_attrs_.end(),
+                     [](const htmlparser::Attribute* left,
+                        const htmlparser::Attribute* right) {
+                       if (left->name_space.empty() &&
+                           right->name_space.empty())
+                         return left->key < right->key;
+                       return left->KeyPart() < right->KeyPart();
+                     });
+    attributes_.reserve(sorted_attrs_.size());
+    for (const htmlparser::Attribute* attr : sorted_attrs_) {
+      if (auto it = NamesByAtom().find(attr->atom);
+          it != NamesByAtom().end()) {
+        attributes_.push_back(ParsedHtmlTagAttr{
+            it->second.lower, attr->value, attr_name_ids.Find(attr->atom)});
+      } else {
+        std::string name = AsciiStrToLower(attr->KeyPart());
+        int32_t name_id = attr_name_ids.Find(name);
+        attributes_.push_back(
+            ParsedHtmlTagAttr{std::move(name), attr->value, name_id});
+      }
     }
     if (node_->DataAtom() == htmlparser::Atom::SCRIPT)
       script_tag_ = ParseScriptTag(node);
   }
 
   // New Methods
-  const std::string& LowerName() const { return lower_tag_name_; }
+  const std::string& LowerName() const { return *lower_tag_name_; }
+
+  const std::string& UpperName() const { return *upper_tag_name_; }
 
-  const std::string& UpperName() const { return upper_tag_name_; }
+  // The atom of the tag name, or Atom::UNKNOWN for custom elements such as
+  // amp-img and for the doctype.
+  htmlparser::Atom atom() const { return atom_; }
 
   std::optional<std::string> HasDuplicateAttrs() const {
     // Attributes were sorted in constructor.
     std::string last_attr_name;
     std::string last_attr_value;
-    for (const auto& attr_it : node_->Attributes()) {
-      if (EqualsIgnoreCase(last_attr_name, attr_it.KeyPart()) &&
-          last_attr_value != attr_it.value) {
-        return attr_it.KeyPart();
+    for (const htmlparser::Attribute* attr_it : sorted_attrs_) {
+      if (EqualsIgnoreCase(last_attr_name, attr_it->KeyPart()) &&
+          last_attr_value != attr_it->value) {
+        return attr_it->KeyPart();
       }
-      last_attr_name = attr_it.KeyPart();
-      last_attr_value = attr_it.value;
+      last_attr_name = attr_it->KeyPart();
+      last_attr_value = attr_it->value;
     }
     return std::nullopt;
   }
@@ -427,7 +702,11 @@ class ParsedHtmlTag {
            node_->IsManufactured();
   }
 
-  bool IsEmpty() const { return node_->Data().empty(); }
+  // The doctype is named !DOCTYPE, whatever its data.
+  bool IsEmpty() const {
+    return node_->Type() != htmlparser::NodeType::DOCTYPE_NODE &&
+           node_->Data().empty();
+  }
 
   bool IsExtensionScript() const { return script_tag_.is_extension; }
 
@@ -472,9 +751,18 @@ class ParsedHtmlTag {
   }
 
  private:
-  htmlparser::Node* node_;
-  std::string lower_tag_name_;
-  std::string upper_tag_name_;
+  const htmlparser::Node* node_;
+  // The attributes of |node_|, and |doctype_html_attr_| if it applies, in
+  // the order of attributes_.
+  vector<const htmlparser::Attribute*> sorted_attrs_;
+  htmlparser::Attribute doctype_html_attr_;
+  htmlparser::Atom atom_ = htmlparser::Atom::UNKNOWN;
+  // The names in NamesByAtom() if the tag has an atom, so that they aren't
+  // copied for each tag, and the names below otherwise.
+  const std::string* lower_tag_name_ = &own_lower_tag_name_;
+  const std::string* upper_tag_name_ = &own_upper_tag_name_;
+  std::string own_lower_tag_name_;
+  std::string own_upper_tag_name_;
   ScriptTag script_tag_;
   vector<ParsedHtmlTagAttr> attributes_;
   ParsedHtmlTag(const ParsedHtmlTag&) = delete;
@@ -500,6 +788,77 @@ class ParsedUrlSpec {
   node_hash_set<std::string> allowed_protocols_;
 };
 
+// Compiles the regular expressions of the validator rules once per distinct
+// pattern and case sensitivity, and keeps them for the lifetime of the
+// process. The same patterns recur across tagspecs and html formats.
+class RegexRegistry {
+ public:
+  static const RE2& Get(const std::string& pattern,
+                        bool case_sensitive = true) {
+    std::pair<std::string, bool> key(pattern, case_sensitive);
+    {
+      absl::MutexLock lock(&mu_);
+      ++stats_.lookups;
+      auto iter = regexes_->find(key);
+      if (iter != regexes_->end()) return *iter->second;
+    }
+    // Compile without holding the lock, so that formats can be built in
+    // parallel, see Warmup().
+    auto start = std::chrono::steady_clock::now();
+    RE2::Options options;
+    options.set_case_sensitive(case_sensitive);
+    auto regex = make_unique<RE2>(pattern, options);
+    auto compile_time = std::chrono::steady_clock::now() - start;
+
+    absl::MutexLock lock(&mu_);
+    stats_.compile_time +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(compile_time);
+    auto [iter, inserted] = regexes_->try_emplace(std::move(key));
+    if (inserted) {
+      iter->second = std::move(regex);
+      ++stats_.patterns;
+    }
+    return *iter->second;
+  }
+
+  static RegexStats Stats() {
+    absl::MutexLock lock(&mu_);
+    return stats_;
+  }
+
+ private:
+  ABSL_CONST_INIT static absl::Mutex mu_;
+  // Never destroyed, as the rules which refer to the regexes aren't either.
+  static flat_hash_map<std::pair<std::string, bool>, unique_ptr<const RE2>>*
+      regexes_ ABSL_GUARDED_BY(mu_);
+  static RegexStats stats_ ABSL_GUARDED_BY(mu_);
+};
+
+ABSL_CONST_INIT absl::Mutex RegexRegistry::mu_(absl::kConstInit);
+flat_hash_map<std::pair<std::string, bool>, unique_ptr<const RE2>>*
+    RegexRegistry::regexes_ =
+        new flat_hash_map<std::pair<std::string, bool>, unique_ptr<const RE2>>;
+RegexStats RegexRegistry::stats_;
+
+// The compiled value_regex_casei of CssDeclarations, looked up by
+// declaration rather than compiled for every declaration in a document.
+class CssDeclarationValueRegexes {
+ public:
+  void Add(const CssDeclaration& declaration) {
+    if (declaration.has_value_regex_casei())
+      regexes_[&declaration] = &RegexRegistry::Get(
+          declaration.value_regex_casei(), /*case_sensitive=*/false);
+  }
+
+  // |declaration| must have been added, and have a value_regex_casei.
+  const RE2& Get(const CssDeclaration& declaration) const {
+    return *regexes_.at(&declaration);
+  }
+
+ private:
+  flat_hash_map<const CssDeclaration*, const RE2*> regexes_;
+};
+
 // ParsedAttrTriggerSpec is used by ParsedAttrSpec to determine which
 // attributes also require another attribute for some given set of
 // conditions.
@@ -509,7 +868,7 @@ class ParsedAttrTriggerSpec {
   explicit ParsedAttrTriggerSpec(const AttrSpec* attr_spec)
       : spec_(&attr_spec->trigger()), attr_name_(attr_spec->name()) {
     if (spec_->has_if_value_regex())
-      if_value_regex_ = make_unique<RE2>(spec_->if_value_regex());
+      if_value_regex_ = &RegexRegistry::Get(spec_->if_value_regex());
   }
 
   bool has_if_value_regex() const { return if_value_regex_ != nullptr; }
@@ -522,7 +881,7 @@ class ParsedAttrTriggerSpec {
  private:
   const AttrTriggerSpec* spec_;
   const std::string attr_name_;
-  unique_ptr<RE2> if_value_regex_;
+  const RE2* if_value_regex_ = nullptr;
 };
 
 // This wrapper class provides access to an AttrSpec and
@@ -543,20 +902,18 @@ class ParsedAttrSpec {
       enabled_by_.push_back(GetTypeIdentifier(enabled_by));
     }
     if (spec_->has_value_regex())
-      value_regex_ = make_unique<RE2>(spec_->value_regex());
+      value_regex_ = &RegexRegistry::Get(spec_->value_regex());
     if (spec_->has_value_regex_casei()) {
-      RE2::Options options;
-      options.set_case_sensitive(false);
-      value_regex_ = make_unique<RE2>(spec_->value_regex_casei(), options);
+      value_regex_ = &RegexRegistry::Get(spec_->value_regex_casei(),
+                                         /*case_sensitive=*/false);
     }
     if (spec_->has_disallowed_value_regex()) {
-      RE2::Options options;
-      options.set_case_sensitive(false);
-      disallowed_value_regex_ =
-          make_unique<RE2>(spec_->disallowed_value_regex(), options);
+      disallowed_value_regex_ = &RegexRegistry::Get(
+          spec_->disallowed_value_regex(), /*case_sensitive=*/false);
     }
     for (auto& css_declaration : spec_->css_declaration()) {
       css_declaration_by_name_[css_declaration.name()] = &css_declaration;
+      css_declaration_value_regexes_.Add(css_declaration);
     }
     for (int ii = 0; ii < spec_->value_properties().properties_size(); ++ii) {
       const PropertySpec& property_spec =
@@ -600,6 +957,11 @@ class ParsedAttrSpec {
     return css_declaration_by_name_;
   }
 
+  // The value_regex_casei of one of css_declaration_by_name().
+  const RE2& CssDeclarationValueRegex(const CssDeclaration& declaration) const {
+    return css_declaration_value_regexes_.Get(declaration);
+  }
+
   const vector<const PropertySpec*>& mandatory_value_properties() const {
     return mandatory_value_properties_;
   }
@@ -615,12 +977,13 @@ class ParsedAttrSpec {
  private:
   const AttrSpec* spec_;
   int32_t id_;
-  unique_ptr<RE2> value_regex_;
-  unique_ptr<RE2> disallowed_value_regex_;
+  const RE2* value_regex_ = nullptr;
+  const RE2* disallowed_value_regex_ = nullptr;
   // Name lookup for spec().value_properties().properties().
   unordered_map<std::string, const PropertySpec*> value_property_by_name_;
   // Name lookup for spec().css_declaration().
   unordered_map<std::string, const CssDeclaration*> css_declaration_by_name_;
+  CssDeclarationValueRegexes css_declaration_value_regexes_;
   // The mandatory spec().value_properties().properties().
   vector<const PropertySpec*> mandatory_value_properties_;
   vector<TypeIdentifier> disabled_by_;
@@ -718,9 +1081,11 @@ class ParsedDocCssSpec {
     for (const CssDeclaration& declaration : spec.declaration()) {
       css_declaration_by_name_[declaration.name()] = &declaration;
       css_declaration_svg_by_name_[declaration.name()] = &declaration;
+      css_declaration_value_regexes_.Add(declaration);
     }
     for (const CssDeclaration& declaration : spec.declaration_svg()) {
       css_declaration_svg_by_name_[declaration.name()] = &declaration;
+      css_declaration_value_regexes_.Add(declaration);
     }
     // Expand the list of declarations tracked by this spec by merging in any
     // declarations mentioned in declaration_lists referenced by this spec. This
@@ -732,6 +1097,7 @@ class ParsedDocCssSpec {
           for (const CssDeclaration& declaration : decl_list.declaration()) {
             css_declaration_by_name_[declaration.name()] = &declaration;
             css_declaration_svg_by_name_[declaration.name()] = &declaration;
+            css_declaration_value_regexes_.Add(declaration);
           }
         }
       }
@@ -741,6 +1107,7 @@ class ParsedDocCssSpec {
         if (decl_list.name() == decl_list_name) {
           for (const CssDeclaration& declaration : decl_list.declaration()) {
             css_declaration_svg_by_name_[declaration.name()] = &declaration;
+            css_declaration_value_regexes_.Add(declaration);
           }
         }
       }
@@ -779,6 +1146,12 @@ class ParsedDocCssSpec {
     return nullptr;
   }
 
+  // The value_regex_casei of a CssDeclaration returned by
+  // CssDeclarationByName() or CssDeclarationSvgByName().
+  const RE2& CssDeclarationValueRegex(const CssDeclaration& declaration) const {
+    return css_declaration_value_regexes_.Get(declaration);
+  }
+
   const ParsedUrlSpec& image_url_spec() const { return *image_url_spec_; }
 
   const ParsedUrlSpec& font_url_spec() const { return *font_url_spec_; }
@@ -791,6 +1164,7 @@ class ParsedDocCssSpec {
   unordered_map<std::string, const CssDeclaration*> css_declaration_by_name_;
   unordered_map<std::string, const CssDeclaration*>
       css_declaration_svg_by_name_;
+  CssDeclarationValueRegexes css_declaration_value_regexes_;
   unique_ptr<ParsedUrlSpec> image_url_spec_;
   unique_ptr<ParsedUrlSpec> font_url_spec_;
 };
@@ -876,8 +1250,14 @@ class ParsedAttrSpecs {
     return *parsed_attr_specs_[id];
   }
 
+  int32_t size() const { return parsed_attr_specs_.size(); }
+
+  const AttrNameIds& attr_name_ids() const { return attr_name_ids_; }
+  AttrNameIds* mutable_attr_name_ids() { return &attr_name_ids_; }
+
  private:
   vector<unique_ptr<ParsedAttrSpec>> parsed_attr_specs_;
+  AttrNameIds attr_name_ids_;
   unordered_map<std::string, vector<const ParsedAttrSpec*>> attr_lists_by_name_;
 };
 
@@ -889,18 +1269,28 @@ class ParsedCdataSpec {
       : spec_(&CHECK_NOTNULL(parent_tag_spec)->cdata()),
         parent_tag_spec_(parent_tag_spec),
         css_parsing_config_(GenCssParsingConfig()) {
-    RE2::Options options;
-    options.set_case_sensitive(false);
     for (const auto& denylist : spec_->disallowed_cdata_regex()) {
       denylists_with_error_msgs_.emplace_back(
-          make_unique<RE2>(denylist.regex(), options),
+          &RegexRegistry::Get(denylist.regex(), /*case_sensitive=*/false),
           denylist.error_message());
     }
+    if (!denylists_with_error_msgs_.empty()) {
+      RE2::Options options;
+      options.set_case_sensitive(false);
+      denylist_set_ = std::make_unique<RE2::Set>(options, RE2::UNANCHORED);
+      for (const auto& denylist : spec_->disallowed_cdata_regex()) {
+        if (denylist_set_->Add(denylist.regex(), /*error=*/nullptr) < 0) {
+          denylist_set_.reset();
+          break;
+        }
+      }
+      if (denylist_set_ && !denylist_set_->Compile()) denylist_set_.reset();
+    }
     for (const std::string& declaration : spec_->css_spec().declaration()) {
       allowed_declarations_.emplace_back(declaration);
     }
     if (spec_->has_cdata_regex()) {
-      cdata_regex_ = make_unique<RE2>(spec_->cdata_regex());
+      cdata_regex_ = &RegexRegistry::Get(spec_->cdata_regex());
     }
     if (spec_->has_css_spec()) {
       for (const AtRuleSpec& at_rule_spec : spec_->css_spec().at_rule_spec())
@@ -911,10 +1301,31 @@ class ParsedCdataSpec {
   const CdataSpec& Spec() const { return *spec_; }
   const TagSpec& ParentTagSpec() const { return *parent_tag_spec_; }
 
-  const vector<pair<unique_ptr<RE2>, std::string>>& DenylistsWithErrorMsgs()
+  const vector<pair<const RE2*, std::string>>& DenylistsWithErrorMsgs()
       const {
     return denylists_with_error_msgs_;
   }
+
+  // Sets `indices` to the positions within DenylistsWithErrorMsgs() of the
+  // denylists which match somewhere in `cdata`, in ascending order. All
+  // denylists are evaluated in a single pass over `cdata` where possible.
+  void MatchDenylists(string_view cdata, vector<int>* indices) const {
+    indices->clear();
+    if (denylist_set_) {
+      RE2::Set::ErrorInfo error_info;
+      if (denylist_set_->Match(cdata, indices, &error_info)) {
+        std::sort(indices->begin(), indices->end());
+        return;
+      }
+      if (error_info.kind == RE2::Set::kNoError) return;
+      // The DFA ran out of memory; fall back to one regex at a time.
+      indices->clear();
+    }
+    for (size_t i = 0; i < denylists_with_error_msgs_.size(); ++i) {
+      if (RE2::PartialMatch(cdata, *denylists_with_error_msgs_[i].first))
+        indices->push_back(i);
+    }
+  }
   // Be sure to check Spec().has_cdata_regex() before accessing.
   const RE2& CdataRegex() const { return *cdata_regex_; }
 
@@ -969,8 +1380,11 @@ class ParsedCdataSpec {
   const CdataSpec* spec_;
   const TagSpec* parent_tag_spec_;
   const CssParsingConfig css_parsing_config_;
-  unique_ptr<RE2> cdata_regex_;
-  vector<pair<unique_ptr<RE2>, std::string>> denylists_with_error_msgs_;
+  const RE2* cdata_regex_ = nullptr;
+  vector<pair<const RE2*, std::string>> denylists_with_error_msgs_;
+  // All of the denylist regexes above, in the same order. Null if there are
+  // none or if the set could not be compiled.
+  std::unique_ptr<RE2::Set> denylist_set_;
   node_hash_set<std::string> allowed_at_rules_;
   vector<std::string> allowed_declarations_;
 };
@@ -984,26 +1398,72 @@ class ParsedCdataSpec {
 // keys for an HTML tag matches that of a TagSpec, we validate that HTML tag
 // against only this one TagSpec. Otherwise, this TagSpec is not eligible for
 // validation against this HTML tag.
-std::string DispatchKey(AttrSpec::DispatchKeyType dispatch_key_type,
-                        const std::string& attr_name,
-                        const std::string& attr_value,
-                        const std::string& mandatory_parent) {
-  // Constructing a string using foo("\0") constructs an empty string, since
-  // the char array is considered null-terminated.
-  const std::string sep("\0", 1);
-  CHECK_EQ(1, sep.length());
-
-  switch (dispatch_key_type) {
-    case AttrSpec::NONE_DISPATCH:
-      LOG(FATAL) << dispatch_key_type;
-    case AttrSpec::NAME_DISPATCH:
-      return attr_name;
-    case AttrSpec::NAME_VALUE_DISPATCH:
-      return StrCat(attr_name, sep, attr_value);
-    case AttrSpec::NAME_VALUE_PARENT_DISPATCH:
-      return StrCat(attr_name, sep, attr_value, sep, mandatory_parent);
+struct DispatchKey {
+  DispatchKey(AttrSpec::DispatchKeyType type, const std::string& attr_name,
+              const std::string& attr_value,
+              const std::string& mandatory_parent)
+      : type(type),
+        attr_name(attr_name),
+        attr_value(type == AttrSpec::NAME_DISPATCH
+                       ? ""
+                       : AsciiStrToLower(attr_value)),
+        mandatory_parent(type == AttrSpec::NAME_VALUE_PARENT_DISPATCH
+                             ? mandatory_parent
+                             : "") {
+    CHECK_NE(AttrSpec::NONE_DISPATCH, type);
+  }
+
+  AttrSpec::DispatchKeyType type;
+  std::string attr_name;
+  std::string attr_value;  // Lower-cased.
+  std::string mandatory_parent;
+};
+
+// A view of the strings of a DispatchKey, or of an attribute of an
+// encountered tag and its parent. The attribute value is hashed and compared
+// ASCII case-insensitively, so lookups don't need to lower-case it.
+struct DispatchKeyView {
+  DispatchKeyView(string_view attr_name, string_view attr_value,
+                  string_view parent)
+      : attr_name(attr_name), attr_value(attr_value), parent(parent) {}
+  DispatchKeyView(const DispatchKey& key)  // NOLINT(runtime/explicit)
+      : attr_name(key.attr_name),
+        attr_value(key.attr_value),
+        parent(key.mandatory_parent) {}
+
+  friend bool operator==(const DispatchKeyView& lhs,
+                         const DispatchKeyView& rhs) {
+    return lhs.attr_name == rhs.attr_name && lhs.parent == rhs.parent &&
+           EqualsIgnoreCase(lhs.attr_value, rhs.attr_value);
   }
-}
+
+  template <typename H>
+  friend H AbslHashValue(H h, const DispatchKeyView& key) {
+    h = H::combine(std::move(h), key.attr_name, key.parent);
+    for (char c : key.attr_value)
+      h = H::combine(std::move(h), absl::ascii_tolower(c));
+    return H::combine(std::move(h), key.attr_value.size());
+  }
+
+  string_view attr_name;
+  string_view attr_value;
+  string_view parent;
+};
+
+struct DispatchKeyHash {
+  using is_transparent = void;
+  size_t operator()(const DispatchKeyView& key) const {
+    return absl::Hash<DispatchKeyView>()(key);
+  }
+};
+
+struct DispatchKeyEq {
+  using is_transparent = void;
+  bool operator()(const DispatchKeyView& lhs,
+                  const DispatchKeyView& rhs) const {
+    return lhs == rhs;
+  }
+};
 
 class CdataMatcher;
 class ChildTagMatcher;
@@ -1081,9 +1541,15 @@ class ParsedTagSpec {
         mandatory_anyofs_.push_back(parsed_attr_spec->spec().mandatory_anyof());
       attr_ids_by_name_[parsed_attr_spec->spec().name()] =
           parsed_attr_spec->id();
+      attr_ids_by_name_id_[parsed_attr_specs->mutable_attr_name_ids()->Intern(
+          parsed_attr_spec->spec().name())] = parsed_attr_spec->id();
       for (const std::string& name :
-           parsed_attr_spec->spec().alternative_names())
+           parsed_attr_spec->spec().alternative_names()) {
         attr_ids_by_name_.emplace(std::make_pair(name, parsed_attr_spec->id()));
+        attr_ids_by_name_id_.emplace(std::make_pair(
+            parsed_attr_specs->mutable_attr_name_ids()->Intern(name),
+            parsed_attr_spec->id()));
+      }
       if (parsed_attr_spec->spec().dispatch_key() != AttrSpec::NONE_DISPATCH)
         dispatch_key_attr_specs_.push_back(parsed_attr_spec);
       if (parsed_attr_spec->spec().implicit())
@@ -1166,20 +1632,19 @@ class ParsedTagSpec {
   // returns unique dispatch keys for the TagSpec, if any. If the attribute
   // value is used (either value or value_casei), uses the first value from the
   // protoascii.
-  std::vector<std::string> GetDispatchKeys() const {
-    std::vector<std::string> out;
+  std::vector<DispatchKey> GetDispatchKeys() const {
+    std::vector<DispatchKey> out;
     out.reserve(dispatch_key_attr_specs_.size());
     for (const auto* dispatch_key_attr_spec : dispatch_key_attr_specs_) {
       const ParsedAttrSpec& parsed_attr_spec = *dispatch_key_attr_spec;
-      out.push_back(
-          DispatchKey(parsed_attr_spec.spec().dispatch_key(),
-                      parsed_attr_spec.spec().name(),
-                      parsed_attr_spec.spec().value_size() > 0
-                          ? AsciiStrToLower(parsed_attr_spec.spec().value(0))
-                          : (parsed_attr_spec.spec().value_casei_size() > 0
-                                 ? parsed_attr_spec.spec().value_casei(0)
-                                 : ""),
-                      spec_->mandatory_parent()));
+      out.emplace_back(parsed_attr_spec.spec().dispatch_key(),
+                       parsed_attr_spec.spec().name(),
+                       parsed_attr_spec.spec().value_size() > 0
+                           ? parsed_attr_spec.spec().value(0)
+                           : (parsed_attr_spec.spec().value_casei_size() > 0
+                                  ? parsed_attr_spec.spec().value_casei(0)
+                                  : ""),
+                       spec_->mandatory_parent());
     }
     return out;
   }
@@ -1212,8 +1677,8 @@ class ParsedTagSpec {
     return attrs_can_satisfy_extension_;
   }
 
-  const bool HasAttrWithName(const std::string& name) const {
-    return attr_ids_by_name_.find(name) != attr_ids_by_name_.end();
+  const bool HasAttrWithNameId(int32_t name_id) const {
+    return attr_ids_by_name_id_.find(name_id) != attr_ids_by_name_id_.end();
   }
 
   const set<int32_t>& implicit_attrspecs() const { return implicit_attrspecs_; }
@@ -1222,6 +1687,11 @@ class ParsedTagSpec {
     return attr_ids_by_name_;
   }
 
+  // Same as attr_ids_by_name(), keyed by ParsedHtmlTagAttr::name_id().
+  const absl::flat_hash_map<int32_t, int32_t>& attr_ids_by_name_id() const {
+    return attr_ids_by_name_id_;
+  }
+
   const vector<std::string>& mandatory_oneofs() const {
     return mandatory_oneofs_;
   }
@@ -1241,6 +1711,7 @@ class ParsedTagSpec {
   bool is_type_json_ = false;
   bool contains_url_ = false;
   absl::flat_hash_map<std::string, int32_t> attr_ids_by_name_;
+  absl::flat_hash_map<int32_t, int32_t> attr_ids_by_name_id_;
   vector<TypeIdentifier> disabled_by_;
   vector<TypeIdentifier> enabled_by_;
   vector<int32_t> mandatory_attr_ids_;
@@ -1310,7 +1781,7 @@ class ChildTagMatcher {
 
   void MatchChildTagName(const ParsedHtmlTag& encountered_tag,
                          const Context& context,
-                         ValidationResult* result) const;
+                         TagValidationResult* result) const;
   void ExitTag(const Context& context, ValidationResult* result) const;
 
  private:
@@ -1324,72 +1795,152 @@ class ChildTagMatcher {
 // second is a list of all remaining non-dispatchable tagspecs.
 class TagSpecDispatch {
  public:
-  void RegisterDispatchKey(const std::string& dispatch_key,
+  void RegisterDispatchKey(const DispatchKey& dispatch_key,
                            int32_t tag_spec_id) {
     // Multiple TagSpecs may have the same dispatch key. These are added in the
     // order in which they are found.
-    tagspecs_by_dispatch_[dispatch_key].push_back(tag_spec_id);
+    TagSpecIdsByKey* tagspecs_by_key = nullptr;
+    switch (dispatch_key.type) {
+      case AttrSpec::NONE_DISPATCH:
+        LOG(FATAL) << dispatch_key.type;
+      case AttrSpec::NAME_DISPATCH:
+        tagspecs_by_key = &tagspecs_by_name_;
+        break;
+      case AttrSpec::NAME_VALUE_DISPATCH:
+        tagspecs_by_key = &tagspecs_by_name_value_;
+        break;
+      case AttrSpec::NAME_VALUE_PARENT_DISPATCH:
+        tagspecs_by_key = &tagspecs_by_name_value_parent_;
+        break;
+    }
+    (*tagspecs_by_key)[dispatch_key].push_back(tag_spec_id);
   }
   void RegisterTagSpec(int32_t tag_spec_id) {
     all_tag_specs_.push_back(tag_spec_id);
   }
 
+  // Computes the results of MatchingDispatchKey for all registered dispatch
+  // keys. Must be called after all dispatch keys have been registered.
+  void PrecomputeMatches() {
+    matches_by_name_value_parent_.clear();
+    matches_by_name_value_.clear();
+    matches_by_name_.clear();
+    max_value_length_ = 0;
+    set<std::string> attr_names;
+    for (const auto& [key, unused] : tagspecs_by_name_value_parent_) {
+      AddMatches(&matches_by_name_value_parent_, key.attr_name, key.attr_value,
+                 &key.mandatory_parent);
+      attr_names.insert(key.attr_name);
+      // A foo=foo attribute also matches a foo="" key, see ComputeMatches.
+      if (key.attr_value.empty())
+        AddMatches(&matches_by_name_value_parent_, key.attr_name,
+                   key.attr_name, &key.mandatory_parent);
+    }
+    for (const auto& [key, unused] : tagspecs_by_name_value_) {
+      AddMatches(&matches_by_name_value_, key.attr_name, key.attr_value,
+                 /*parent=*/nullptr);
+      attr_names.insert(key.attr_name);
+    }
+    for (const auto& [key, tag_spec_ids] : tagspecs_by_name_) {
+      matches_by_name_.emplace(key, tag_spec_ids);
+      attr_names.insert(key.attr_name);
+    }
+    for (const std::string& attr_name : attr_names)
+      AddMatches(&matches_by_name_value_, attr_name, attr_name,
+                 /*parent=*/nullptr);
+  }
+
   bool empty() const { return !HasDispatchKeys() && !HasTagSpecs(); }
 
-  bool HasDispatchKeys() const { return !tagspecs_by_dispatch_.empty(); }
+  bool HasDispatchKeys() const {
+    return !tagspecs_by_name_value_parent_.empty() ||
+           !tagspecs_by_name_value_.empty() || !tagspecs_by_name_.empty();
+  }
 
   // Looks up a dispatch key as previously registered, returning the
   // corresponding tag_spec_ids which are ordered by their specificity of match
-  // (e.g. Name/Value/Parent, then Name/Value, and then Name).
-  vector<int32_t> MatchingDispatchKey(const std::string& attr_name,
-                                      const std::string& attr_value,
-                                      const std::string& parent) const {
-    if (!HasDispatchKeys()) return {};
+  // (e.g. Name/Value/Parent, then Name/Value, and then Name). The attribute
+  // value is matched case-insensitively. Requires PrecomputeMatches().
+  absl::Span<const int32_t> MatchingDispatchKey(string_view attr_name,
+                                                string_view attr_value,
+                                                string_view parent) const {
+    // Values which are longer than any registered value can't match, and
+    // aren't worth hashing.
+    if (attr_value.size() <= max_value_length_) {
+      auto match = matches_by_name_value_parent_.find(
+          DispatchKeyView(attr_name, attr_value, parent));
+      if (match != matches_by_name_value_parent_.end()) return match->second;
+      match = matches_by_name_value_.find(
+          DispatchKeyView(attr_name, attr_value, ""));
+      if (match != matches_by_name_value_.end()) return match->second;
+    }
+    auto match = matches_by_name_.find(DispatchKeyView(attr_name, "", ""));
+    if (match != matches_by_name_.end()) return match->second;
+    return {};
+  }
 
+  bool HasTagSpecs() const { return !all_tag_specs_.empty(); }
+  const vector<int>& AllTagSpecs() const { return all_tag_specs_; }
+
+ private:
+  using TagSpecIdsByKey = flat_hash_map<DispatchKey, vector<int32_t>,
+                                        DispatchKeyHash, DispatchKeyEq>;
+
+  // Returns the tag_spec_ids matching an attribute, in order of specificity.
+  // |parent| is null for a parent which doesn't have any Name/Value/Parent
+  // dispatch key for this attribute.
+  vector<int32_t> ComputeMatches(const std::string& attr_name,
+                                 const std::string& attr_value,
+                                 const std::string* parent) const {
     vector<int32_t> tag_spec_ids;
+    auto append_matches = [&tag_spec_ids](const TagSpecIdsByKey& by_key,
+                                          const DispatchKeyView& key) {
+      auto match = by_key.find(key);
+      if (match != by_key.end())
+        tag_spec_ids.insert(tag_spec_ids.end(), match->second.begin(),
+                            match->second.end());
+    };
     // Try first to find a key with the given parent.
-    const std::string dispatch_key = DispatchKey(
-        AttrSpec::NAME_VALUE_PARENT_DISPATCH, attr_name, attr_value, parent);
-    auto match = tagspecs_by_dispatch_.find(dispatch_key);
-    if (match != tagspecs_by_dispatch_.end())
-      tag_spec_ids.insert(tag_spec_ids.end(), match->second.begin(),
-                          match->second.end());
-
+    if (parent)
+      append_matches(tagspecs_by_name_value_parent_,
+                     DispatchKeyView(attr_name, attr_value, *parent));
     // Try next to find a key that allows any parent.
-    const std::string no_parent_key =
-        DispatchKey(AttrSpec::NAME_VALUE_DISPATCH, attr_name, attr_value, "");
-    auto no_parent_match = tagspecs_by_dispatch_.find(no_parent_key);
-    if (no_parent_match != tagspecs_by_dispatch_.end())
-      tag_spec_ids.insert(tag_spec_ids.end(), no_parent_match->second.begin(),
-                          no_parent_match->second.end());
-
+    append_matches(tagspecs_by_name_value_,
+                   DispatchKeyView(attr_name, attr_value, ""));
     // Try last to find a key that matches this attribute name.
-    const std::string no_value_key =
-        DispatchKey(AttrSpec::NAME_DISPATCH, attr_name, "", "");
-    auto no_value_match = tagspecs_by_dispatch_.find(no_value_key);
-    if (no_value_match != tagspecs_by_dispatch_.end())
-      tag_spec_ids.insert(tag_spec_ids.end(), no_value_match->second.begin(),
-                          no_value_match->second.end());
+    append_matches(tagspecs_by_name_, DispatchKeyView(attr_name, "", ""));
 
     // Special case for foo=foo. We consider this a match for a dispatch key of
     // foo="" or just <tag foo>.
     DCHECK(!attr_name.empty());
     if (attr_name == attr_value) {
-      auto more_tag_spec_ids = MatchingDispatchKey(attr_name, "", parent);
+      auto more_tag_spec_ids = ComputeMatches(attr_name, "", parent);
       tag_spec_ids.insert(tag_spec_ids.end(), more_tag_spec_ids.begin(),
                           more_tag_spec_ids.end());
     }
-
     return tag_spec_ids;
   }
 
-  bool HasTagSpecs() const { return !all_tag_specs_.empty(); }
-  const vector<int>& AllTagSpecs() const { return all_tag_specs_; }
-
- private:
-  unordered_map<std::string /*dispatch key*/,
-                vector<int32_t> /* tag_spec_ids */>
-      tagspecs_by_dispatch_;
+  void AddMatches(TagSpecIdsByKey* matches, const std::string& attr_name,
+                  const std::string& attr_value, const std::string* parent) {
+    DispatchKey key(parent ? AttrSpec::NAME_VALUE_PARENT_DISPATCH
+                           : AttrSpec::NAME_VALUE_DISPATCH,
+                    attr_name, attr_value, parent ? *parent : "");
+    if (matches->contains(key)) return;
+    max_value_length_ = std::max(max_value_length_, attr_value.size());
+    matches->emplace(std::move(key),
+                     ComputeMatches(attr_name, attr_value, parent));
+  }
+
+  // The tag_spec_ids registered for each kind of dispatch key.
+  TagSpecIdsByKey tagspecs_by_name_value_parent_;
+  TagSpecIdsByKey tagspecs_by_name_value_;
+  TagSpecIdsByKey tagspecs_by_name_;
+  // The results of MatchingDispatchKey, see PrecomputeMatches.
+  TagSpecIdsByKey matches_by_name_value_parent_;
+  TagSpecIdsByKey matches_by_name_value_;
+  TagSpecIdsByKey matches_by_name_;
+  size_t max_value_length_ = 0;
   vector<int32_t> all_tag_specs_;
 };
 
@@ -1448,11 +1999,11 @@ class ParsedValidatorRules {
 
   int32_t Specificity(ValidationError::Code code) const;
 
-  int32_t MaxSpecificity(const RepeatedPtrField<ValidationError>& errors) const;
+  int32_t MaxSpecificity(const vector<ErrorRecord>& errors) const;
 
   // Returns true iff resultA is a better result than resultB.
-  bool BetterValidationResultThan(const ValidationResult& resultA,
-                                  const ValidationResult& resultB) const;
+  bool BetterValidationResultThan(const TagValidationResult& resultA,
+                                  const TagValidationResult& resultB) const;
 
   bool HasValidatedAlternativeTagSpec(Context* context,
                                       const std::string& ext_name) const;
@@ -1503,6 +2054,19 @@ class ParsedValidatorRules {
     return iter->second;
   }
 
+  // Same as DispatchForTagName(tag.UpperName()), but without hashing the
+  // tag name for tags with a known atom.
+  const TagSpecDispatch& DispatchForTag(const ParsedHtmlTag& tag) const {
+    if (tag.atom() == htmlparser::Atom::UNKNOWN)
+      return DispatchForTagName(tag.UpperName());
+    auto iter = tagspecs_by_atom_.find(tag.atom());
+    if (iter == tagspecs_by_atom_.end()) {
+      return empty_dispatch_;
+    }
+
+    return *iter->second;
+  }
+
   const ValidatorRules& rules() const { return rules_; }
 
   const ParsedAttrSpecs& parsed_attr_specs() const {
@@ -1511,12 +2075,28 @@ class ParsedValidatorRules {
 
   const HtmlFormat::Code html_format() const { return html_format_; }
 
+  // The counters of the specs of these rules, if the validator is built with
+  // AMP_VALIDATOR_STATS. Null otherwise, which the compiler sees.
+  RulesProfiler* profiler() const {
+#ifdef AMP_VALIDATOR_STATS
+    return profiler_.get();
+#else
+    return nullptr;
+#endif
+  }
+
+  // Fills |profile| from profiler(), if any.
+  void Profile(RulesProfile* profile) const;
+
  private:
   Status status_;
   ValidatorRules rules_;
   HtmlFormat::Code html_format_;
   vector<ParsedTagSpec> tagspec_by_id_;
   absl::node_hash_map<std::string, TagSpecDispatch> tagspecs_by_tagname_;
+  // Points into tagspecs_by_tagname_, for the tag names with a known atom.
+  absl::flat_hash_map<htmlparser::Atom, const TagSpecDispatch*>
+      tagspecs_by_atom_;
   absl::node_hash_map<std::string, vector<int32_t>>
       ext_tag_spec_ids_by_ext_name_;
   TagSpecDispatch empty_dispatch_;
@@ -1526,13 +2106,73 @@ class ParsedValidatorRules {
   vector<ParsedDocSpec> parsed_doc_;
   vector<ParsedDocCssSpec> parsed_css_;
   std::set<std::string> tags_with_cdata_;
+  unique_ptr<RulesProfiler> profiler_;
   ParsedValidatorRules(const ParsedValidatorRules&) = delete;
   ParsedValidatorRules& operator=(const ParsedValidatorRules&) = delete;
 };  // class ParsedValidatorRules
 
+struct ValueSetProvision {
+ public:
+  ValueSetProvision(AttrSpec::ValueSet set, std::string value)
+      : set(set), value(std::move(value)) {}
+
+  friend bool operator==(const ValueSetProvision& lhs,
+                         const ValueSetProvision& rhs) {
+    return lhs.set == rhs.set && lhs.value == rhs.value;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const ValueSetProvision& v) {
+    return H::combine(std::move(h), v.set, v.value);
+  }
+
+  AttrSpec::ValueSet set;
+  std::string value;
+};
+
+// A value set requirement from an attribute, which results in
+// |error_if_unsatisfied| if no matching value is provided in the document.
+struct ValueSetRequirement {
+  ValueSetProvision provision;
+  ErrorRecord error_if_unsatisfied;
+};
+
+// The result of validating a tag against a single tag spec. This mirrors the
+// parts of ValidationResult that are needed while selecting a tag spec, with
+// the errors kept as ErrorRecords.
+class TagValidationResult {
+ public:
+  ValidationResult::Status status() const { return status_; }
+  void set_status(ValidationResult::Status status) { status_ = status; }
+
+  int errors_size() const { return errors_.size(); }
+  const vector<ErrorRecord>& errors() const { return errors_; }
+  void add_error(ErrorRecord error) { errors_.push_back(std::move(error)); }
+
+  const vector<ValueSetProvision>& value_set_provisions() const {
+    return value_set_provisions_;
+  }
+  void add_value_set_provision(ValueSetProvision provision) {
+    value_set_provisions_.push_back(std::move(provision));
+  }
+
+  const vector<ValueSetRequirement>& value_set_requirements() const {
+    return value_set_requirements_;
+  }
+  void add_value_set_requirement(ValueSetRequirement requirement) {
+    value_set_requirements_.push_back(std::move(requirement));
+  }
+
+ private:
+  ValidationResult::Status status_ = ValidationResult::UNKNOWN;
+  vector<ErrorRecord> errors_;
+  vector<ValueSetProvision> value_set_provisions_;
+  vector<ValueSetRequirement> value_set_requirements_;
+};
+
 // Return type tuple for ValidateTag.
 struct ValidateTagResult {
-  ValidationResult validation_result;
+  TagValidationResult validation_result;
   const ParsedTagSpec* best_match_tag_spec = nullptr;
   bool dev_mode_suppress = false;
   // If the tagspec determined that there were CSS bytes in the given tag's
@@ -1682,6 +2322,14 @@ class TagStack {
     while (!stack_.empty()) PopFromStack(context, result);
   }
 
+  // Returns the stack to its initial state, holding only the root entry, so
+  // that it can be used for another document. Allocated storage is retained.
+  void Reset() {
+    stack_.clear();
+    allowed_descendants_list_.clear();
+    stack_.emplace_back(StackEntry("$ROOT"));
+  }
+
   // Update tagstack state after validating an encountered tag. Called with the
   // best matching specs, even if not a match.
   void UpdateFromTagResults(const ParsedHtmlTag& encountered_tag,
@@ -1750,7 +2398,7 @@ class TagStack {
   // need here is the one provided/specified for the tag parent.
   void MatchChildTagName(const ParsedHtmlTag& encountered_tag,
                          const Context& context,
-                         ValidationResult* result) const {
+                         TagValidationResult* result) const {
     if (ParentStackEntry().child_tag_matcher)
       ParentStackEntry().child_tag_matcher->MatchChildTagName(encountered_tag,
                                                               context, result);
@@ -1941,6 +2589,17 @@ class TagStack {
   vector<unique_ptr<DescendantConstraints>> allowed_descendants_list_;
 };
 
+// A stylesheet parsed by CdataMatcher::ParseCss(), along with what was found
+// in it before looking at the document.
+struct ParsedCss {
+  vector<char32_t> codepoints;
+  vector<unique_ptr<htmlparser::css::Token>> tokens;
+  unique_ptr<htmlparser::css::Stylesheet> stylesheet;
+  vector<unique_ptr<htmlparser::css::ParsedCssUrl>> parsed_urls;
+  vector<unique_ptr<htmlparser::css::ErrorToken>> css_errors;
+  vector<unique_ptr<htmlparser::css::ErrorToken>> css_warnings;
+};
+
 // CdataMatcher maintains a constraint to check which an opening tag
 // introduces: a tag's cdata matches constraints set by it's cdata
 // spec. Unfortunately we need to defer such checking and can't
@@ -1960,14 +2619,41 @@ class CdataMatcher {
              ValidationResult* result,
              const LineCol& content_line_col) const;
 
+  // Whether Match() parses the cdata as CSS, in which case it may be split
+  // into ParseCss() and MatchParsedCss().
+  bool MatchesCss() const;
+
+  // The part of Match() for CSS which depends on nothing but |cdata|, and
+  // the |deadline| of the validation if any. Unlike the rest of the
+  // validation, this is thread-safe, given no deadline.
+  unique_ptr<ParsedCss> ParseCss(
+      string_view cdata, const LineCol& content_line_col,
+      htmlparser::Deadline* deadline = nullptr) const;
+
+  // The rest of Match() for |css|, the result of ParseCss() for |cdata|.
+  // |count_doc_css_bytes| is TagStack::CountDocCssBytes() as of the cdata.
+  void MatchParsedCss(string_view cdata, const ParsedCss& css,
+                      bool count_doc_css_bytes, Context* context,
+                      ValidationResult* result) const;
+
+  const ParsedCdataSpec* parsed_cdata_spec() const {
+    return parsed_cdata_spec_;
+  }
+  const LineCol& line_col() const { return line_col_; }
+
  private:
   // Matches the provided cdata against a CSS specification. Helper
   // routine for match (see above). |url_bytes| contains the number of bytes
   // in the CSS string which were measured as URLs. In some validation types,
   // these bytes are not counted against byte limits.
-  void MatchCss(string_view cdata, const CssSpec& css_spec, int* url_bytes,
-                Context* context, ValidationResult* result,
-                const LineCol& content_line_col) const;
+  void MatchCss(const ParsedCss& css, const CssSpec& css_spec, int* url_bytes,
+                Context* context, ValidationResult* result) const;
+
+  // Checks the length of |cdata|, less |url_bytes| where these don't count,
+  // and the denylisted regexes. Helper routine for Match.
+  void MatchLengthAndDenylists(string_view cdata, int url_bytes,
+                               bool count_doc_css_bytes, Context* context,
+                               ValidationResult* result) const;
 
   // Matches the provided stylesheet against a MediaQuery specification.
   // Helper routine for MatchCss.
@@ -1990,7 +2676,15 @@ class CdataMatcher {
 // seen, as well as which have been used, which are required to be used, etc.
 class ExtensionsContext {
  public:
-  ExtensionsContext() {
+  ExtensionsContext() { Reset(); }
+
+  // Clears all state collected from a document, so that this context can be
+  // used for another document.
+  void Reset() {
+    extensions_loaded_.clear();
+    extensions_unused_required_.clear();
+    extensions_used_.clear();
+    extension_missing_errors_.clear();
     // AMP-AD is exempted to not require the respective extension javascript
     // file for historical reasons. We still need to mark that the extension is
     // used if we see the tags.
@@ -2101,25 +2795,6 @@ class ExtensionsContext {
   vector<ExtensionMissingError> extension_missing_errors_;
 };  // ExtensionsContext
 
-struct ValueSetProvision {
- public:
-  explicit ValueSetProvision(const amp::validator::ValueSetProvision& proto)
-      : set(proto.set()), value(proto.value()) {}
-
-  friend bool operator==(const ValueSetProvision& lhs,
-                         const ValueSetProvision& rhs) {
-    return lhs.set == rhs.set && lhs.value == rhs.value;
-  }
-
-  template <typename H>
-  friend H AbslHashValue(H h, const ValueSetProvision& v) {
-    return H::combine(std::move(h), v.set, v.value);
-  }
-
-  AttrSpec::ValueSet set;
-  std::string value;
-};
-
 // The context keeps track of the line / column that the validator is
 // in, as well as the mandatory and unique tag specs that have already
 // been validated. So, this constitutes the mutable state for the
@@ -2136,6 +2811,43 @@ class Context {
         line_col_(1, 0),
         encountered_body_line_col_(1, 0) {}
 
+  // Clears all state collected from a previous document, so that this
+  // context can be reused for another one. Container storage (e.g. the tag
+  // stack) is retained where possible.
+  void Reset(int max_errors, bool verdict_only,
+             htmlparser::Deadline* deadline) {
+    max_errors_ = verdict_only ? 0 : max_errors;
+    verdict_only_ = verdict_only;
+    deadline_ = deadline;
+    current_token_start_ = nullptr;
+    line_col_ = LineCol(1, 0);
+    extensions_.Reset();
+    tag_stack_.Reset();
+    first_url_seen_tag_ = nullptr;
+    encountered_body_line_col_ = LineCol(1, 0);
+    encountered_body_tag_.clear();
+    mandatory_alternatives_satisfied_.clear();
+    conditions_satisfied_.clear();
+    tagspecs_validated_.clear();
+    doc_byte_size_ = 0;
+    style_tag_byte_size_ = 0;
+    inline_style_byte_size_ = 0;
+    exit_early_ = false;
+    type_identifiers_.clear();
+    value_sets_provided_.clear();
+    value_sets_required_.clear();
+    script_release_version_ = ScriptReleaseVersion::UNKNOWN;
+  }
+
+  // In verdict-only mode, only the PASS/FAIL status of results is computed:
+  // AddError() and AddWarning() don't construct any ValidationError, and
+  // validation may stop as soon as the status is FAIL.
+  bool verdict_only() const { return verdict_only_; }
+
+  // The deadline of the validation, if any, which stops the tokenizing of
+  // CSS along with the traversal.
+  htmlparser::Deadline* deadline() const { return deadline_; }
+
   void StartDocument(const char* document_token_start) {
     current_token_start_ = document_token_start;
   }
@@ -2146,6 +2858,15 @@ class Context {
   };
 
   ResultProgress Progress(const ValidationResult& result) const {
+    return Progress(result.status(), result.errors_size());
+  }
+
+  ResultProgress Progress(const TagValidationResult& result) const {
+    return Progress(result.status(), result.errors_size());
+  }
+
+  ResultProgress Progress(ValidationResult::Status status,
+                          int errors_size) const {
     // If max_errors is set to -1, it means that we want to keep going no
     // matter what, because there may be more errors. The validator constructor
     // doesn't allow values less than -1 but we do here just to be safer.
@@ -2153,14 +2874,14 @@ class Context {
       return {/*complete=*/false, /*wants_more_errors=*/true};
     // For max_errors set to 0, if a status is FAIL that means we're done.
     if (max_errors_ == 0)
-      return {/*complete=*/result.status() == ValidationResult::FAIL,
+      return {/*complete=*/status == ValidationResult::FAIL,
               /*wants_more_errors=*/false};
     // For max_errors > 0, we want to keep adding errors if we're below
     // max_errors. But note that some of them (or all of them!) may be warnings,
     // so whether or not we're complete is still dependent on whether the
     // status is FAIL.
-    bool wants_more_errors = result.errors_size() < max_errors_ && !exit_early_;
-    return {/*complete=*/(result.status() == ValidationResult::FAIL &&
+    bool wants_more_errors = errors_size < max_errors_ && !exit_early_;
+    return {/*complete=*/(status == ValidationResult::FAIL &&
                           !wants_more_errors),
             /*wants_more_errors=*/wants_more_errors};
   }
@@ -2206,6 +2927,11 @@ class Context {
   }
 
   void AddError(ValidationError error, ValidationResult* result) const {
+    if (verdict_only_) {
+      if (error.severity() != ValidationError::WARNING)
+        result->set_status(ValidationResult::FAIL);
+      return;
+    }
     ResultProgress progress = Progress(*result);
     if (progress.complete) {
       if (result->status() != ValidationResult::FAIL) {
@@ -2221,9 +2947,32 @@ class Context {
     if (progress.wants_more_errors) result->add_errors()->Swap(&error);
   }
 
+  // Same as above, for the result of validating a tag against a tag spec.
+  void AddError(ErrorRecord error, TagValidationResult* result) const {
+    if (verdict_only_) {
+      if (error.severity != ValidationError::WARNING)
+        result->set_status(ValidationResult::FAIL);
+      return;
+    }
+    ResultProgress progress = Progress(*result);
+    if (progress.complete) {
+      if (result->status() != ValidationResult::FAIL) {
+        result->set_status(ValidationResult::FAIL);
+        DLOG(FATAL) << "Tag Progress complete early but not status FAIL";
+      }
+      return;
+    }
+    if (error.severity != ValidationError::WARNING) {
+      result->set_status(ValidationResult::FAIL);
+    }
+    if (progress.wants_more_errors) result->add_error(std::move(error));
+  }
+
   void AddWarning(ValidationError::Code code, LineCol line_col,
                   const vector<std::string>& params,
                   const std::string& spec_url, ValidationResult* result) const {
+    // Warnings don't affect the status.
+    if (verdict_only_) return;
     AddError(PopulateError(ValidationError::WARNING, code, line_col, params,
                            spec_url),
              result);
@@ -2232,11 +2981,36 @@ class Context {
   void AddError(ValidationError::Code code, LineCol line_col,
                 const vector<std::string>& params, const std::string& spec_url,
                 ValidationResult* result) const {
+    if (verdict_only_) {
+      result->set_status(ValidationResult::FAIL);
+      return;
+    }
     AddError(
         PopulateError(ValidationError::ERROR, code, line_col, params, spec_url),
         result);
   }
 
+  void AddWarning(ValidationError::Code code, LineCol line_col,
+                  vector<std::string> params, std::string spec_url,
+                  TagValidationResult* result) const {
+    if (verdict_only_) return;
+    AddError({ValidationError::WARNING, code, line_col, std::move(params),
+              std::move(spec_url)},
+             result);
+  }
+
+  void AddError(ValidationError::Code code, LineCol line_col,
+                vector<std::string> params, std::string spec_url,
+                TagValidationResult* result) const {
+    if (verdict_only_) {
+      result->set_status(ValidationResult::FAIL);
+      return;
+    }
+    AddError({ValidationError::ERROR, code, line_col, std::move(params),
+              std::move(spec_url)},
+             result);
+  }
+
   // Given the tag_result from validating a single tag, update the overall
   // result as well as the Context state to affect later validation.
   void UpdateFromTagResults(const ParsedHtmlTag& encountered_tag,
@@ -2308,10 +3082,21 @@ class Context {
       AddError(to_merge.errors(i), merged);
   }
 
-  void SetDocByteSize(int32_t byte_size) { doc_byte_size_ = byte_size; }
-
-  const int32_t& doc_byte_size() const { return doc_byte_size_; }
-
+  // Same as above, converting the errors of |to_merge| into ValidationErrors.
+  void MergeRespectingMaxErrors(const TagValidationResult& to_merge,
+                                ValidationResult* merged) const {
+    if (to_merge.status() == ValidationResult::FAIL)
+      merged->set_status(ValidationResult::FAIL);
+    for (const ErrorRecord& error : to_merge.errors()) {
+      if (!Progress(*merged).wants_more_errors) break;
+      AddError(error.ToValidationError(), merged);
+    }
+  }
+
+  void SetDocByteSize(int32_t byte_size) { doc_byte_size_ = byte_size; }
+
+  const int32_t& doc_byte_size() const { return doc_byte_size_; }
+
   // These methods keep track of how much of the document is used towards
   // CSS style elements, via <style amp-custom> and inline styles (style
   // attribute on any tag).
@@ -2452,11 +3237,10 @@ class Context {
 
     const auto& validation_result = result.validation_result;
     for (const auto& provision : validation_result.value_set_provisions())
-      value_sets_provided_.insert(ValueSetProvision(provision));
+      value_sets_provided_.insert(provision);
     for (const auto& requirement : validation_result.value_set_requirements()) {
-      if (!requirement.has_provision()) continue;
-      value_sets_required_[ValueSetProvision(requirement.provision())]
-          .push_back(requirement.error_if_unsatisfied());
+      value_sets_required_[requirement.provision].push_back(
+          requirement.error_if_unsatisfied.ToValidationError());
     }
 
     if (result.IsPassing()) {
@@ -2481,12 +3265,12 @@ class Context {
     if (!tag_result.best_match_tag_spec) return;
     const ParsedTagSpec* parsed_tag_spec = tag_result.best_match_tag_spec;
     if (!parsed_tag_spec->AttrsCanSatisfyExtension()) return;
-    const absl::flat_hash_map<std::string, int32_t>& attr_ids_by_name =
-        parsed_tag_spec->attr_ids_by_name();
+    const absl::flat_hash_map<int32_t, int32_t>& attr_ids_by_name_id =
+        parsed_tag_spec->attr_ids_by_name_id();
     ExtensionsContext* extensions_ctx = mutable_extensions();
     for (const ParsedHtmlTagAttr& attr : encountered_tag.Attributes()) {
-      auto jt = attr_ids_by_name.find(attr.name());
-      if (jt != attr_ids_by_name.end()) {
+      auto jt = attr_ids_by_name_id.find(attr.name_id());
+      if (jt != attr_ids_by_name_id.end()) {
         const ParsedAttrSpec& parsed_attr_spec =
             rules_->parsed_attr_specs().GetById(jt->second);
         if (!parsed_attr_spec.spec().requires_extension().empty())
@@ -2530,6 +3314,8 @@ class Context {
 
   const ParsedValidatorRules* rules_;
   int max_errors_ = -1;
+  bool verdict_only_ = false;
+  htmlparser::Deadline* deadline_ = nullptr;
   const char* current_token_start_;
   LineCol line_col_;
 
@@ -2568,7 +3354,7 @@ class Context {
 
 void ChildTagMatcher::MatchChildTagName(const ParsedHtmlTag& encountered_tag,
                                         const Context& context,
-                                        ValidationResult* result) const {
+                                        TagValidationResult* result) const {
   const ChildTagSpec& child_tags = parent_spec_->child_tags();
   // Enforce child_tag_name_oneof: If at least one tag name is specified, then
   // the child tags of the parent tag must have one of the provided tag names.
@@ -2637,14 +3423,14 @@ class UrlErrorInAttrAdapter {
       : attr_name_(attr_name) {}
 
   void MissingUrl(const Context& context, const TagSpec& tag_spec,
-                  ValidationResult* result) const {
+                  TagValidationResult* result) const {
     context.AddError(ValidationError::MISSING_URL, context.line_col(),
                      /*params=*/{*attr_name_, TagDescriptiveName(tag_spec)},
                      TagSpecUrl(tag_spec), result);
   }
 
   void InvalidUrl(const Context& context, const std::string& url,
-                  const TagSpec& tag_spec, ValidationResult* result) const {
+                  const TagSpec& tag_spec, TagValidationResult* result) const {
     context.AddError(
         ValidationError::INVALID_URL, context.line_col(),
         /*params=*/{*attr_name_, TagDescriptiveName(tag_spec), url},
@@ -2653,7 +3439,7 @@ class UrlErrorInAttrAdapter {
 
   void InvalidUrlProtocol(const Context& context, const std::string& url,
                           const std::string& protocol, const TagSpec& tag_spec,
-                          ValidationResult* result) const {
+                          TagValidationResult* result) const {
     context.AddError(
         ValidationError::INVALID_URL_PROTOCOL, context.line_col(),
         /*params=*/{*attr_name_, TagDescriptiveName(tag_spec), protocol},
@@ -2662,7 +3448,7 @@ class UrlErrorInAttrAdapter {
 
   void DisallowedRelativeUrl(const Context& context, const std::string& url,
                              const TagSpec& tag_spec,
-                             ValidationResult* result) const {
+                             TagValidationResult* result) const {
     context.AddError(
         ValidationError::DISALLOWED_RELATIVE_URL, context.line_col(),
         /*params=*/{*attr_name_, TagDescriptiveName(tag_spec), url},
@@ -2673,37 +3459,43 @@ class UrlErrorInAttrAdapter {
   const std::string* attr_name_;
 };
 
+// Used for URLs in both <style> contents and style attributes, so errors may be
+// added to a document level or a tag level result.
 class UrlErrorInStylesheetAdapter {
  public:
   explicit UrlErrorInStylesheetAdapter(LineCol line_col)
       : line_col_(line_col) {}
 
+  template <typename Result>
   void MissingUrl(const Context& context, const TagSpec& tag_spec,
-                  ValidationResult* result) const {
+                  Result* result) const {
     context.AddError(ValidationError::CSS_SYNTAX_MISSING_URL, line_col_,
                      /*params=*/{TagDescriptiveName(tag_spec)},
                      TagSpecUrl(tag_spec), result);
   }
 
+  template <typename Result>
   void InvalidUrl(const Context& context, const std::string& url,
-                  const TagSpec& tag_spec, ValidationResult* result) const {
+                  const TagSpec& tag_spec, Result* result) const {
     context.AddError(ValidationError::CSS_SYNTAX_INVALID_URL, line_col_,
                      /*params=*/{TagDescriptiveName(tag_spec), url},
                      TagSpecUrl(tag_spec), result);
   }
 
+  template <typename Result>
   void InvalidUrlProtocol(const Context& context, const std::string& url,
                           const std::string& protocol, const TagSpec& tag_spec,
-                          ValidationResult* result) const {
+                          Result* result) const {
     context.AddError(ValidationError::CSS_SYNTAX_INVALID_URL_PROTOCOL,
                      line_col_,
                      /*params=*/{TagDescriptiveName(tag_spec), protocol},
                      TagSpecUrl(tag_spec), result);
   }
 
+  template <typename Result>
   void DisallowedRelativeUrl(const Context& context, const std::string& url,
                              const TagSpec& tag_spec,
-                             ValidationResult* result) const {
+                             Result* result) const {
     context.AddError(ValidationError::CSS_SYNTAX_DISALLOWED_RELATIVE_URL,
                      line_col_,
                      /*params=*/{TagDescriptiveName(tag_spec), url},
@@ -2744,11 +3536,13 @@ std::string UrlProtocol(const std::string& url, const URL& parsed_url) {
   return protocol;
 }
 
-template <typename ErrorAdapter>
+template <typename ErrorAdapter, typename Result>
 void ValidateUrlAndProtocol(const ParsedUrlSpec& parsed_url_spec,
                             const ErrorAdapter& adapter, const Context& context,
                             const std::string& url, const TagSpec& tag_spec,
-                            ValidationResult* result) {
+                            Result* result) {
+  VALIDATION_STATS_ADD(url_checks, 1);
+  VALIDATION_STATS_TIMER(url_check_time);
   const UrlSpec* spec = parsed_url_spec.spec();
   // includes non-breaking space
   static LazyRE2 only_whitespace_re = {"[\\s\xc2\xa0]*"};
@@ -2878,11 +3672,10 @@ class InvalidDeclVisitor : public htmlparser::css::RuleVisitor {
             css_spec_.spec().spec_url(), result_);
       }
     } else if (css_declaration->has_value_regex_casei()) {
-      RE2::Options options;
-      options.set_case_sensitive(false);
-      RE2 pattern(css_declaration->value_regex_casei(), options);
       const std::string first_ident = declaration.FirstIdent();
-      if (!RE2::FullMatch(first_ident, pattern)) {
+      if (!RE2::FullMatch(first_ident,
+                          css_spec_.CssDeclarationValueRegex(
+                              *css_declaration))) {
         context_->AddError(
             ValidationError::CSS_SYNTAX_DISALLOWED_PROPERTY_VALUE,
             LineCol(declaration.line(), declaration.col()),
@@ -2905,15 +3698,19 @@ void CdataMatcher::Match(string_view cdata, Context* context,
                          const LineCol& content_line_col) const {
   if (!parsed_cdata_spec_) return;
   if (context->Progress(*result).complete) return;
+  if (MatchesCss()) {
+    MatchParsedCss(cdata,
+                   *ParseCss(cdata, content_line_col, context->deadline()),
+                   context->tag_stack().CountDocCssBytes(), context, result);
+    return;
+  }
 
   const CdataSpec& cdata_spec = parsed_cdata_spec_->Spec();
 
-  int url_bytes = 0;
-
   // The mandatory_cdata, cdata_regex, and css_spec fields are treated
   // like a oneof, but we're not using oneof because it's a feature
   // that was added after protobuf 2.5.0 (which our open-source
-  // version uses).
+  // version uses). css_spec is handled by MatchParsedCss() above.
   // begin oneof {
 
   // Mandatory CDATA exact match
@@ -2929,7 +3726,7 @@ void CdataMatcher::Match(string_view cdata, Context* context,
     // spec shouldn't have an exact match rule that doesn't validate.
     return;
   } else if (cdata_spec.has_cdata_regex()) {
-    if (!RE2::FullMatch(cdata, parsed_cdata_spec_->CdataRegex())) {
+    if (!RuleRegexFullMatch(cdata, parsed_cdata_spec_->CdataRegex())) {
       context->AddError(
           ValidationError::MANDATORY_CDATA_MISSING_OR_INCORRECT,
           context->line_col(),
@@ -2937,9 +3734,6 @@ void CdataMatcher::Match(string_view cdata, Context* context,
           TagSpecUrl(parsed_cdata_spec_->ParentTagSpec()), result);
       return;
     }
-  } else if (cdata_spec.has_css_spec()) {
-    MatchCss(cdata, cdata_spec.css_spec(), &url_bytes, context, result,
-             content_line_col);
   } else if (cdata_spec.whitespace_only()) {
     static LazyRE2 ws_only = {"^\\s*$"};
     if (!RE2::FullMatch(cdata, *ws_only)) {
@@ -2953,6 +3747,34 @@ void CdataMatcher::Match(string_view cdata, Context* context,
   }
   // } end oneof
 
+  MatchLengthAndDenylists(cdata, /*url_bytes=*/0,
+                          context->tag_stack().CountDocCssBytes(), context,
+                          result);
+}
+
+bool CdataMatcher::MatchesCss() const {
+  if (!parsed_cdata_spec_) return false;
+  const CdataSpec& cdata_spec = parsed_cdata_spec_->Spec();
+  return !cdata_spec.has_mandatory_cdata() && !cdata_spec.has_cdata_regex() &&
+         cdata_spec.has_css_spec();
+}
+
+void CdataMatcher::MatchParsedCss(string_view cdata, const ParsedCss& css,
+                                  bool count_doc_css_bytes, Context* context,
+                                  ValidationResult* result) const {
+  if (context->Progress(*result).complete) return;
+  int url_bytes = 0;
+  MatchCss(css, parsed_cdata_spec_->Spec().css_spec(), &url_bytes, context,
+           result);
+  MatchLengthAndDenylists(cdata, url_bytes, count_doc_css_bytes, context,
+                          result);
+}
+
+void CdataMatcher::MatchLengthAndDenylists(string_view cdata, int url_bytes,
+                                           bool count_doc_css_bytes,
+                                           Context* context,
+                                           ValidationResult* result) const {
+  const CdataSpec& cdata_spec = parsed_cdata_spec_->Spec();
   std::optional<const ParsedDocCssSpec*> maybe_doc_css_spec =
       context->MatchingDocCssSpec();
   int adjusted_cdata_length = cdata.length();
@@ -2980,7 +3802,7 @@ void CdataMatcher::Match(string_view cdata, Context* context,
   }
 
   // Record <style amp-custom> byte size
-  if (context->tag_stack().CountDocCssBytes()) {
+  if (count_doc_css_bytes) {
     // This is safe from multiple TagSpecs executing on the same Tag, because
     // CDATA matching only happens once the TagSpec matches otherwise. It's not
     // of the TagSpec selection algorithm.
@@ -2989,15 +3811,16 @@ void CdataMatcher::Match(string_view cdata, Context* context,
 
   if (context->Progress(*result).complete) return;
   // Evaluate the denylisted CDATA Regular Expressions
-  for (const auto& entry : parsed_cdata_spec_->DenylistsWithErrorMsgs()) {
+  vector<int> matched;
+  parsed_cdata_spec_->MatchDenylists(cdata, &matched);
+  for (int index : matched) {
     if (context->Progress(*result).complete) return;
-    if (RE2::PartialMatch(cdata, *entry.first))
-      context->AddError(
-          ValidationError::CDATA_VIOLATES_DENYLIST, context->line_col(),
-          /*params=*/
-          {TagDescriptiveName(parsed_cdata_spec_->ParentTagSpec()),
-           entry.second},
-          TagSpecUrl(parsed_cdata_spec_->ParentTagSpec()), result);
+    context->AddError(
+        ValidationError::CDATA_VIOLATES_DENYLIST, context->line_col(),
+        /*params=*/
+        {TagDescriptiveName(parsed_cdata_spec_->ParentTagSpec()),
+         parsed_cdata_spec_->DenylistsWithErrorMsgs()[index].second},
+        TagSpecUrl(parsed_cdata_spec_->ParentTagSpec()), result);
   }
 }
 
@@ -3105,31 +3928,30 @@ void CdataMatcher::MatchSelectors(
   stylesheet.Accept(&visitor);
 }
 
-void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
-                            int* url_bytes, Context* context,
-                            ValidationResult* result,
-                            const LineCol& content_line_col) const {
-  vector<unique_ptr<htmlparser::css::ErrorToken>> css_errors;
-  vector<unique_ptr<htmlparser::css::ErrorToken>> css_warnings;
-  vector<char32_t> codepoints =
-      htmlparser::Strings::Utf8ToCodepoints(cdata.data());
+unique_ptr<ParsedCss> CdataMatcher::ParseCss(
+    string_view cdata, const LineCol& content_line_col,
+    htmlparser::Deadline* deadline) const {
+  VALIDATION_STATS_TIMER(css_parse_time);
+  const CssSpec& css_spec = parsed_cdata_spec_->Spec().css_spec();
+  auto css = make_unique<ParsedCss>();
+  vector<unique_ptr<htmlparser::css::ErrorToken>>& css_errors =
+      css->css_errors;
+  css->codepoints = htmlparser::Strings::Utf8ToCodepoints(cdata.data());
   // Use the tag's line (line_col_) to preserve correct line numbering, but
   // use the content's column (content_line_col) so that when the CSS is on
   // the same line as the <style> tag, column offsets are correct. For
   // multi-line content, the first newline resets the column to 0 anyway.
-  vector<unique_ptr<htmlparser::css::Token>> tokens = htmlparser::css::Tokenize(
-      &codepoints, line_col_.line(), content_line_col.col(), &css_errors);
-  unique_ptr<htmlparser::css::Stylesheet> stylesheet =
-      htmlparser::css::ParseAStylesheet(
-          &tokens, parsed_cdata_spec_->css_parsing_config(), &css_errors);
-
-  std::optional<const ParsedDocCssSpec*> maybe_doc_css_spec =
-      context->MatchingDocCssSpec();
+  css->tokens =
+      htmlparser::css::Tokenize(&css->codepoints, line_col_.line(),
+                                content_line_col.col(), &css_errors, deadline);
+  VALIDATION_STATS_ADD(css_tokens, css->tokens.size());
+  css->stylesheet = htmlparser::css::ParseAStylesheet(
+      &css->tokens, parsed_cdata_spec_->css_parsing_config(), &css_errors);
+  const htmlparser::css::Stylesheet& stylesheet = *css->stylesheet;
 
   // We extract the urls from the stylesheet. As a side-effect, this can
   // generate errors for url(...) functions with invalid parameters.
-  vector<unique_ptr<htmlparser::css::ParsedCssUrl>> parsed_urls;
-  htmlparser::css::ExtractUrls(*stylesheet, &parsed_urls, &css_errors);
+  htmlparser::css::ExtractUrls(stylesheet, &css->parsed_urls, &css_errors);
 
   // Similarly, we extract query types and features from @media rules.
   for (const AtRuleSpec& at_rule_spec : css_spec.at_rule_spec()) {
@@ -3138,27 +3960,36 @@ void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
         << "Only 'media' AT rules should have a MediaQuerySpec";
     const MediaQuerySpec& media_query_spec = at_rule_spec.media_query_spec();
     auto* error_buffer =
-        media_query_spec.issues_as_error() ? &css_errors : &css_warnings;
-    MatchMediaQuery(*stylesheet, at_rule_spec.media_query_spec(), error_buffer);
+        media_query_spec.issues_as_error() ? &css_errors : &css->css_warnings;
+    MatchMediaQuery(stylesheet, at_rule_spec.media_query_spec(), error_buffer);
     // There will be at most one @media at_rule_spec.
     break;
   }
 
   if (css_spec.has_selector_spec()) {
     const SelectorSpec& selector_spec = css_spec.selector_spec();
-    MatchSelectors(*stylesheet, selector_spec, &css_errors);
+    MatchSelectors(stylesheet, selector_spec, &css_errors);
   }
 
   if (css_spec.validate_amp4ads()) {
-    htmlparser::css::ValidateAmp4AdsCss(*stylesheet, &css_errors);
+    htmlparser::css::ValidateAmp4AdsCss(stylesheet, &css_errors);
   }
   if (css_spec.validate_keyframes()) {
-    amp::validator::parse_css::ValidateKeyframesCss(*stylesheet, &css_errors);
+    amp::validator::parse_css::ValidateKeyframesCss(stylesheet, &css_errors);
   }
+  return css;
+}
+
+void CdataMatcher::MatchCss(const ParsedCss& css, const CssSpec& css_spec,
+                            int* url_bytes, Context* context,
+                            ValidationResult* result) const {
+  const htmlparser::css::Stylesheet& stylesheet = *css.stylesheet;
+  std::optional<const ParsedDocCssSpec*> maybe_doc_css_spec =
+      context->MatchingDocCssSpec();
 
   // Add errors then warnings:
   for (const unique_ptr<htmlparser::css::ErrorToken>& error_token :
-       css_errors) {
+       css.css_errors) {
     // Override the first parameter with the name of this style tag.
     vector<std::string> params = error_token->params();
     params[0] = TagDescriptiveName(parsed_cdata_spec_->ParentTagSpec());
@@ -3167,7 +3998,7 @@ void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
                       /*spec_url=*/"", result);
   }
   for (const unique_ptr<htmlparser::css::ErrorToken>& error_token :
-       css_warnings) {
+       css.css_warnings) {
     // Override the first parameter with the name of this style tag.
     vector<std::string> params = error_token->params();
     params[0] = TagDescriptiveName(parsed_cdata_spec_->ParentTagSpec());
@@ -3179,7 +4010,7 @@ void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
   // If `!important` is not allowed, record instances as errors.
   if (!css_spec.allow_important()) {
     vector<const htmlparser::css::Declaration*> important;
-    htmlparser::css::ExtractImportantDeclarations(*stylesheet, &important);
+    htmlparser::css::ExtractImportantDeclarations(stylesheet, &important);
     for (const htmlparser::css::Declaration* decl : important) {
       context->AddError(ValidationError::CSS_SYNTAX_DISALLOWED_IMPORTANT,
                         LineCol(decl->important_line(), decl->important_col()),
@@ -3191,7 +4022,7 @@ void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
   // Validate all url() functions found in the CSS against the document-level
   // image and font url specs.
   *url_bytes = 0;
-  for (const auto& url : parsed_urls) {
+  for (const auto& url : css.parsed_urls) {
     // Some CSS specs can choose to not count URLs against the byte limit, but
     // data URLs are always counted (or in other words, they aren't considered
     // URLs).
@@ -3209,7 +4040,7 @@ void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
   }
   // Validate the allowed CSS AT rules (eg: `@media`).
   InvalidRuleVisitor visitor(parsed_cdata_spec_, context, result);
-  stylesheet->Accept(&visitor);
+  stylesheet.Accept(&visitor);
 
   // Validate the allowed CSS declarations (eg: `background-color`)
   if (maybe_doc_css_spec &&
@@ -3217,14 +4048,14 @@ void CdataMatcher::MatchCss(string_view cdata, const CssSpec& css_spec,
     InvalidDeclVisitor visitor(
         **maybe_doc_css_spec, context,
         TagDescriptiveName(parsed_cdata_spec_->ParentTagSpec()), result);
-    stylesheet->Accept(&visitor);
+    stylesheet.Accept(&visitor);
   }
 }
 
 void ValidateAttrValueUrl(const ParsedAttrSpec& parsed_attr_spec,
                           const Context& context, const std::string& attr_name,
                           const std::string& attr_value,
-                          const TagSpec& tag_spec, ValidationResult* result) {
+                          const TagSpec& tag_spec, TagValidationResult* result) {
   vector<std::string> maybe_urls;
   if (attr_name != "srcset") {
     maybe_urls.push_back(attr_value);
@@ -3275,7 +4106,7 @@ void ValidateAttrValueProperties(const ParsedAttrSpec& parsed_attr_spec,
                                  const std::string& attr_name,
                                  const std::string& attr_value,
                                  const TagSpec& tag_spec,
-                                 ValidationResult* result) {
+                                 TagValidationResult* result) {
   vector<const PropertySpec*> mandatory_value_properties_seen;
   const unordered_map<std::string, const PropertySpec*>&
       value_property_by_name = parsed_attr_spec.value_property_by_name();
@@ -3340,28 +4171,87 @@ void ValidateAttrValueProperties(const ParsedAttrSpec& parsed_attr_spec,
   }
 }
 
-// This is the main validation procedure for attributes, operating with a
-// ParsedAttrSpec instance.
-void ValidateNonTemplateAttrValueAgainstSpec(
-    const ParsedAttrSpec& parsed_attr_spec, const Context& context,
-    const std::string& attr_name, const std::string& attr_value,
-    const TagSpec& tag_spec, ValidationResult* result) {
-  const AttrSpec& spec = parsed_attr_spec.spec();
-  if (spec.has_add_value_to_set()) {
-    auto* provision = result->add_value_set_provisions();
-    provision->set_set(spec.add_value_to_set());
-    provision->set_value(attr_value);
+// A bounded, process-wide memo of attribute values which passed the
+// context-free value checks of an AttrSpec: value_regex, value_url and
+// value_properties. Only passing values are remembered. The errors of a
+// failing value depend on the context, so it is validated in full every time.
+class AttrValueCache {
+ public:
+  static int Capacity() { return absl::GetFlag(FLAGS_attr_value_cache_size); }
+
+  // Whether |attr_name|=|attr_value| is known to pass the value checks of
+  // |spec|. Values too long to be worth remembering are never found.
+  static bool Contains(const AttrSpec& spec, const std::string& attr_name,
+                       const std::string& attr_value) {
+    if (attr_value.size() > kMaxValueLength) return false;
+    size_t hash = absl::HashOf(&spec, attr_name, attr_value);
+    Shard& shard = shards_[hash % kNumShards];
+    absl::MutexLock lock(&shard.mu);
+    auto iter = shard.entries.find(hash);
+    if (iter != shard.entries.end() && iter->second.spec == &spec &&
+        iter->second.attr_name == attr_name &&
+        iter->second.attr_value == attr_value) {
+      ++shard.hits;
+      return true;
+    }
+    ++shard.misses;
+    return false;
   }
-  if (spec.has_value_oneof_set()) {
-    auto* requirement = result->add_value_set_requirements();
-    requirement->mutable_provision()->set_set(spec.value_oneof_set());
-    requirement->mutable_provision()->set_value(attr_value);
-    *requirement->mutable_error_if_unsatisfied() =
-        PopulateError(ValidationError::ERROR,
-                      ValidationError::VALUE_SET_MISMATCH, context.line_col(),
-                      /*params=*/{attr_name, TagDescriptiveName(tag_spec)},
-                      TagSpecUrl(tag_spec));
+
+  // Remembers that |attr_name|=|attr_value| passes the value checks of |spec|.
+  // A full shard is emptied before inserting.
+  static void Insert(const AttrSpec& spec, const std::string& attr_name,
+                     const std::string& attr_value) {
+    if (attr_value.size() > kMaxValueLength) return;
+    size_t hash = absl::HashOf(&spec, attr_name, attr_value);
+    Shard& shard = shards_[hash % kNumShards];
+    absl::MutexLock lock(&shard.mu);
+    if (shard.entries.size() * kNumShards >= static_cast<size_t>(Capacity()))
+      shard.entries.clear();
+    shard.entries.insert_or_assign(hash, Entry{&spec, attr_name, attr_value});
   }
+
+  static AttrValueCacheStats Stats() {
+    AttrValueCacheStats stats;
+    for (int i = 0; i < kNumShards; ++i) {
+      absl::MutexLock lock(&shards_[i].mu);
+      stats.hits += shards_[i].hits;
+      stats.misses += shards_[i].misses;
+      stats.entries += shards_[i].entries.size();
+    }
+    return stats;
+  }
+
+ private:
+  static constexpr int kNumShards = 16;
+  static constexpr size_t kMaxValueLength = 1024;
+
+  struct Entry {
+    const AttrSpec* spec;
+    std::string attr_name;
+    std::string attr_value;
+  };
+  struct Shard {
+    absl::Mutex mu;
+    flat_hash_map<size_t, Entry> entries ABSL_GUARDED_BY(mu);
+    int64_t hits ABSL_GUARDED_BY(mu) = 0;
+    int64_t misses ABSL_GUARDED_BY(mu) = 0;
+  };
+  // Never destroyed, as validation may still be running on other threads at
+  // exit.
+  static Shard* shards_;
+};
+
+AttrValueCache::Shard* AttrValueCache::shards_ =
+    new AttrValueCache::Shard[AttrValueCache::kNumShards];
+
+// Validates |attr_value| against whichever of the value, value_casei,
+// value_regex, value_url and value_properties fields |parsed_attr_spec| has.
+void ValidateAttrValue(const ParsedAttrSpec& parsed_attr_spec,
+                       const Context& context, const std::string& attr_name,
+                       const std::string& attr_value, const TagSpec& tag_spec,
+                       TagValidationResult* result) {
+  const AttrSpec& spec = parsed_attr_spec.spec();
   // The value, value_regex, and value_properties fields are treated
   // like a oneof, but we're not using oneof because it's a feature
   // that was added after protobuf 2.5.0 (which our open-source version uses).
@@ -3387,7 +4277,8 @@ void ValidateNonTemplateAttrValueAgainstSpec(
         /*params=*/{attr_name, TagDescriptiveName(tag_spec), attr_value},
         TagSpecUrl(tag_spec), result);
   } else if (parsed_attr_spec.has_value_regex()) {
-    if (!RE2::FullMatch(attr_value, parsed_attr_spec.value_regex())) {
+    if (!RuleRegexFullMatch(attr_value, parsed_attr_spec.value_regex(),
+                            context.rules().profiler(), parsed_attr_spec.id())) {
       context.AddError(
           ValidationError::INVALID_ATTR_VALUE, context.line_col(),
           /*params=*/{attr_name, TagDescriptiveName(tag_spec), attr_value},
@@ -3403,6 +4294,54 @@ void ValidateNonTemplateAttrValueAgainstSpec(
   // } end oneof
 }
 
+// This is the main validation procedure for attributes, operating with a
+// ParsedAttrSpec instance.
+void ValidateNonTemplateAttrValueAgainstSpec(
+    const ParsedAttrSpec& parsed_attr_spec, const Context& context,
+    const std::string& attr_name, const std::string& attr_value,
+    const TagSpec& tag_spec, TagValidationResult* result) {
+  const AttrSpec& spec = parsed_attr_spec.spec();
+  if (spec.has_add_value_to_set())
+    result->add_value_set_provision({spec.add_value_to_set(), attr_value});
+  if (spec.has_value_oneof_set()) {
+    result->add_value_set_requirement(
+        {{spec.value_oneof_set(), attr_value},
+         {ValidationError::ERROR,
+          ValidationError::VALUE_SET_MISMATCH,
+          context.line_col(),
+          /*params=*/{attr_name, TagDescriptiveName(tag_spec)},
+          TagSpecUrl(tag_spec)}});
+  }
+  // Comparing against value or value_casei is cheaper than a cache lookup.
+  if (spec.value_size() > 0 || spec.value_casei_size() > 0 ||
+      AttrValueCache::Capacity() <= 0) {
+    ValidateAttrValue(parsed_attr_spec, context, attr_name, attr_value,
+                      tag_spec, result);
+    return;
+  }
+  if (AttrValueCache::Contains(spec, attr_name, attr_value)) {
+    if (RulesProfiler* profiler = context.rules().profiler()) {
+      profiler->attr_spec(parsed_attr_spec.id())
+          .cache_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
+  }
+  // Validate into a scratch result first, so that only values which pass
+  // without any errors or warnings are remembered. The rare failing value is
+  // validated again, so that its errors are reported exactly as without the
+  // cache.
+  TagValidationResult scratch;
+  ValidateAttrValue(parsed_attr_spec, context, attr_name, attr_value, tag_spec,
+                    &scratch);
+  if (scratch.status() != ValidationResult::FAIL &&
+      scratch.errors_size() == 0) {
+    AttrValueCache::Insert(spec, attr_name, attr_value);
+    return;
+  }
+  ValidateAttrValue(parsed_attr_spec, context, attr_name, attr_value, tag_spec,
+                    result);
+}
+
 bool AttrValueHasTemplateSyntax(string_view value) {
   // Mustache (https://mustache.github.io/mustache.5.html), our template
   // system, supports replacement tags that start with {{ and end with }}.
@@ -3433,7 +4372,7 @@ bool AttrValueHasPartialsTemplateSyntax(string_view value) {
 // Validates whether the parent tag satisfied the spec (e.g., some
 // tags can only appear in head).
 void ValidateParentTag(const ParsedTagSpec& parsed_tag_spec,
-                       const Context& context, ValidationResult* result) {
+                       const Context& context, TagValidationResult* result) {
   const TagSpec& spec = parsed_tag_spec.spec();
   if (spec.has_mandatory_parent() &&
       (spec.mandatory_parent() != context.tag_stack().ParentTagName()) &&
@@ -3452,7 +4391,7 @@ void ValidateParentTag(const ParsedTagSpec& parsed_tag_spec,
 // Validates that this tag is an allowed descendant tag type.
 void ValidateDescendantTags(const ParsedHtmlTag& encountered_tag,
                             const ParsedTagSpec& parsed_tag_spec,
-                            const Context& context, ValidationResult* result) {
+                            const Context& context, TagValidationResult* result) {
   const TagStack& tag_stack = context.tag_stack();
 
   int32_t allowed_descendants_lists =
@@ -3480,7 +4419,7 @@ void ValidateDescendantTags(const ParsedHtmlTag& encountered_tag,
 void ValidateNoSiblingsAllowedTags(const ParsedHtmlTag& tag,
                                    const ParsedTagSpec& parsed_tag_spec,
                                    const Context& context,
-                                   ValidationResult* result) {
+                                   TagValidationResult* result) {
   const TagSpec& tag_spec = parsed_tag_spec.spec();
 
   if (tag_spec.siblings_disallowed() &&
@@ -3505,7 +4444,7 @@ void ValidateNoSiblingsAllowedTags(const ParsedHtmlTag& tag,
 }
 
 // Validates if the 'last child' rule exists.
-void ValidateLastChildTags(const Context& context, ValidationResult* result) {
+void ValidateLastChildTags(const Context& context, TagValidationResult* result) {
   if (context.tag_stack().ParentHasChildWithLastChildRule()) {
     context.AddError(
         ValidationError::MANDATORY_LAST_CHILD_TAG,
@@ -3521,7 +4460,7 @@ void ValidateLastChildTags(const Context& context, ValidationResult* result) {
 // report an error if that extension has not been loaded.
 void ValidateRequiredExtensions(const ParsedTagSpec& parsed_tag_spec,
                                 const Context& context,
-                                ValidationResult* result) {
+                                TagValidationResult* result) {
   const TagSpec& tag_spec = parsed_tag_spec.spec();
   const ExtensionsContext& extensions_ctx = context.extensions();
   for (const std::string& required_extension : tag_spec.requires_extension()) {
@@ -3538,7 +4477,7 @@ void ValidateRequiredExtensions(const ParsedTagSpec& parsed_tag_spec,
 // report an error if that extension has not been loaded.
 void ValidateAttrRequiredExtensions(const ParsedAttrSpec& parsed_attr_spec,
                                     const Context& context,
-                                    ValidationResult* result) {
+                                    TagValidationResult* result) {
   const AttrSpec& attr_spec = parsed_attr_spec.spec();
   const ExtensionsContext& extensions_ctx = context.extensions();
   for (const std::string& required_extension : attr_spec.requires_extension()) {
@@ -3554,7 +4493,7 @@ void ValidateAttrRequiredExtensions(const ParsedAttrSpec& parsed_attr_spec,
 // Check for duplicates of tags that should be unique, reporting errors for the
 // second instance of each unique tag.
 void ValidateUniqueness(const ParsedTagSpec& parsed_tag_spec,
-                        const Context& context, ValidationResult* result) {
+                        const Context& context, TagValidationResult* result) {
   const TagSpec& tag_spec = parsed_tag_spec.spec();
   if (tag_spec.unique() &&
       context.TagspecsValidated().count(parsed_tag_spec.id())) {
@@ -3570,7 +4509,7 @@ void ValidateUniqueness(const ParsedTagSpec& parsed_tag_spec,
 void CheckForReferencePointCollision(const ParsedTagSpec* ref_point_spec,
                                      const ParsedTagSpec* tag_spec,
                                      const Context& context,
-                                     ValidationResult* result) {
+                                     TagValidationResult* result) {
   if (!ref_point_spec || !ref_point_spec->has_reference_points()) return;
   if (!tag_spec || !tag_spec->has_reference_points()) return;
 
@@ -3584,7 +4523,7 @@ void CheckForReferencePointCollision(const ParsedTagSpec* ref_point_spec,
 
 // Validates if the tag ancestors satisfied the spec.
 void ValidateAncestorTags(const ParsedTagSpec& parsed_tag_spec,
-                          const Context& context, ValidationResult* result) {
+                          const Context& context, TagValidationResult* result) {
   const TagSpec& spec = parsed_tag_spec.spec();
   if (spec.has_mandatory_ancestor()) {
     const std::string& mandatory_ancestor = spec.mandatory_ancestor();
@@ -3629,7 +4568,7 @@ void ValidateSsrLayout(const TagSpec& spec,
                        const CssLength input_height,
                        const string_view sizes_attr,
                        const string_view heights_attr, const Context& context,
-                       ValidationResult* result) {
+                       TagValidationResult* result) {
   // Only applies to transformed AMP and custom elements (<amp-...>).
   if (!context.is_transformed() ||
       !StartsWith(encountered_tag.LowerName(), "amp-"))
@@ -3698,7 +4637,7 @@ void ValidateSsrLayout(const TagSpec& spec,
 void ValidateLayout(const ParsedTagSpec& parsed_tag_spec,
                     const Context& context,
                     const ParsedHtmlTag& encountered_tag,
-                    ValidationResult* result) {
+                    TagValidationResult* result) {
   const TagSpec& spec = parsed_tag_spec.spec();
   string_view layout_attr =
       encountered_tag.GetAttr("layout").value_or(string_view());
@@ -3875,7 +4814,7 @@ void ValidateLayout(const ParsedTagSpec& parsed_tag_spec,
 void ValidateAttrNotFoundInSpec(const ParsedTagSpec& parsed_tag_spec,
                                 const Context& context,
                                 const std::string& attr_name,
-                                ValidationResult* result) {
+                                TagValidationResult* result) {
   // For now, we just skip data- attributes in the validator, because
   // our schema doesn't capture which ones would be ok or not. E.g.
   // in practice, some type of ad or perhaps other custom elements
@@ -3923,7 +4862,7 @@ void ValidateAttrValueBelowTemplateTag(const ParsedTagSpec& parsed_tag_spec,
                                        const Context& context,
                                        const std::string& attr_name,
                                        const std::string& attr_value,
-                                       ValidationResult* result) {
+                                       TagValidationResult* result) {
   const std::string& tag_spec_name = TagDescriptiveName(parsed_tag_spec.spec());
   const std::string& template_spec_url = context.rules().template_spec_url();
   if (AttrValueHasUnescapedTemplateSyntax(attr_value)) {
@@ -3982,7 +4921,7 @@ bool ValidateAttrInExtension(const TagSpec& tag_spec,
 // Validates that the reserved `i-amphtml-` prefix is not used in a class token.
 void ValidateClassAttr(const ParsedHtmlTagAttr& class_attr,
                        const TagSpec& tag_spec, const Context& context,
-                       ValidationResult* result) {
+                       TagValidationResult* result) {
   for (const string_view class_token :
        StrSplit(class_attr.value(), ByAnyChar("\t\n\f\r "))) {
     if (StartsWith(class_token, "i-amphtml-")) {
@@ -4006,7 +4945,7 @@ void ValidateClassAttr(const ParsedHtmlTagAttr& class_attr,
 void ValidateAmpScriptSrcAttr(const ParsedHtmlTag& tag,
                               const std::string& attr_value,
                               const TagSpec& tag_spec, const Context& context,
-                              ValidationResult* result) {
+                              TagValidationResult* result) {
   if (!tag.IsAmpDomain()) {
     bool is_amp_format =
         c_find(context.type_identifiers(), TypeIdentifier::kAmp) !=
@@ -4147,11 +5086,16 @@ void ValidateAttrCss(const ParsedAttrSpec& parsed_attr_spec,
   // that any line/col values for tokens are also similarly offset incorrectly.
   // For error messages, this means we just use the line/col of the tag instead
   // of the token so as to minimize confusion. This could be improved further.
-  vector<unique_ptr<htmlparser::css::Token>> tokens =
-      htmlparser::css::Tokenize(&codepoints, context.line_col().line(),
-                                context.line_col().col(), &css_errors);
-  vector<unique_ptr<htmlparser::css::Declaration>> declarations =
-      htmlparser::css::ParseInlineStyle(&tokens, &css_errors);
+  vector<unique_ptr<htmlparser::css::Token>> tokens;
+  vector<unique_ptr<htmlparser::css::Declaration>> declarations;
+  {
+    VALIDATION_STATS_TIMER(css_parse_time);
+    tokens = htmlparser::css::Tokenize(&codepoints, context.line_col().line(),
+                                       context.line_col().col(), &css_errors,
+                                       context.deadline());
+    VALIDATION_STATS_ADD(css_tokens, tokens.size());
+    declarations = htmlparser::css::ParseInlineStyle(&tokens, &css_errors);
+  }
   const std::string tag_description = TagDescriptiveName(tag_spec);
   for (const unique_ptr<htmlparser::css::ErrorToken>& error_token :
        css_errors) {
@@ -4238,11 +5182,9 @@ void ValidateAttrCss(const ParsedAttrSpec& parsed_attr_spec,
                 &result->validation_result);
           }
         } else if (css_declaration->has_value_regex_casei()) {
-          RE2::Options options;
-          options.set_case_sensitive(false);
-          RE2 pattern(css_declaration->value_regex_casei(), options);
           const std::string first_ident = declaration->FirstIdent();
-          if (!RE2::FullMatch(first_ident, pattern)) {
+          if (!RE2::FullMatch(first_ident,
+                              spec.CssDeclarationValueRegex(*css_declaration))) {
             context.AddError(
                 ValidationError::CSS_SYNTAX_DISALLOWED_PROPERTY_VALUE,
                 context.line_col(),
@@ -4309,7 +5251,7 @@ void ValidateAttrDeclaration(const ParsedAttrSpec& parsed_attr_spec,
                              const std::string& tag_spec_name,
                              const std::string& attr_name,
                              const std::string& attr_value,
-                             ValidationResult* result) {
+                             TagValidationResult* result) {
   vector<unique_ptr<htmlparser::css::ErrorToken>> css_errors;
   vector<char32_t> codepoints =
       htmlparser::Strings::Utf8ToCodepoints(attr_value);
@@ -4318,11 +5260,16 @@ void ValidateAttrDeclaration(const ParsedAttrSpec& parsed_attr_spec,
   // that any line/col values for tokens are also similarly offset incorrectly.
   // For error messages, this means we just use the line/col of the tag instead
   // of the token so as to minimize confusion. This could be improved further.
-  vector<unique_ptr<htmlparser::css::Token>> tokens =
-      htmlparser::css::Tokenize(&codepoints, context.line_col().line(),
-                                context.line_col().col(), &css_errors);
-  vector<unique_ptr<htmlparser::css::Declaration>> declarations =
-      htmlparser::css::ParseInlineStyle(&tokens, &css_errors);
+  vector<unique_ptr<htmlparser::css::Token>> tokens;
+  vector<unique_ptr<htmlparser::css::Declaration>> declarations;
+  {
+    VALIDATION_STATS_TIMER(css_parse_time);
+    tokens = htmlparser::css::Tokenize(&codepoints, context.line_col().line(),
+                                       context.line_col().col(), &css_errors,
+                                       context.deadline());
+    VALIDATION_STATS_ADD(css_tokens, tokens.size());
+    declarations = htmlparser::css::ParseInlineStyle(&tokens, &css_errors);
+  }
   for (const unique_ptr<htmlparser::css::ErrorToken>& error_token :
        css_errors) {
     // Override the first parameter with the name of the tag.
@@ -4369,11 +5316,9 @@ void ValidateAttrDeclaration(const ParsedAttrSpec& parsed_attr_spec,
             /*spec_url=*/context.rules().styles_spec_url(), result);
       }
     } else if (css_declaration->has_value_regex_casei()) {
-      RE2::Options options;
-      options.set_case_sensitive(false);
-      RE2 pattern(css_declaration->value_regex_casei(), options);
       const std::string first_ident = declaration->FirstIdent();
-      if (!RE2::FullMatch(first_ident, pattern)) {
+      if (!RE2::FullMatch(first_ident, parsed_attr_spec.CssDeclarationValueRegex(
+                                           *css_declaration))) {
         context.AddError(
             ValidationError::CSS_SYNTAX_DISALLOWED_PROPERTY_VALUE,
             context.line_col(),
@@ -4424,10 +5369,14 @@ void ValidateAttributes(const ParsedTagSpec& parsed_tag_spec,
   set<std::string_view> mandatory_anyofs_seen;
   vector<const ParsedAttrTriggerSpec*> parsed_trigger_specs;
   set<int32_t> attrspecs_validated;
-  const absl::flat_hash_map<std::string, int32_t>& attr_ids_by_name =
-      parsed_tag_spec.attr_ids_by_name();
+  const absl::flat_hash_map<int32_t, int32_t>& attr_ids_by_name_id =
+      parsed_tag_spec.attr_ids_by_name_id();
 
   for (const ParsedHtmlTagAttr& attr : encountered_tag.Attributes()) {
+    // Nothing below can turn a failed attempt into a passing one.
+    if (context.verdict_only() &&
+        result->validation_result.status() == ValidationResult::FAIL)
+      return;
     if (!attr_seen.insert(attr.name()).second) {
       continue;
     }
@@ -4454,8 +5403,8 @@ void ValidateAttributes(const ParsedTagSpec& parsed_tag_spec,
       }
     }
 
-    auto jt = attr_ids_by_name.find(attr.name());
-    if (jt == attr_ids_by_name.end()) {
+    auto jt = attr_ids_by_name_id.find(attr.name_id());
+    if (jt == attr_ids_by_name_id.end()) {
       // The HTML tag specifies type identifiers which are validated in
       // ValidateHtmlTag(), so we skip them here.
       if (is_html_tag && context.rules().IsTypeIdentifier(attr.name()))
@@ -4467,7 +5416,7 @@ void ValidateAttributes(const ParsedTagSpec& parsed_tag_spec,
       // On the other hand, if we did just validate a reference point for
       // this tag, we check whether that reference point covers the attribute.
       if (best_match_reference_point &&
-          best_match_reference_point->HasAttrWithName(attr.name()))
+          best_match_reference_point->HasAttrWithNameId(attr.name_id()))
         continue;
       // If |spec| is an extension, then we ad-hoc validate 'custom-element',
       // 'custom-template', and 'host-service' attributes by calling this
@@ -4538,8 +5487,10 @@ void ValidateAttributes(const ParsedTagSpec& parsed_tag_spec,
         continue;
     }
     if (parsed_attr_spec.has_disallowed_value_regex()) {
-      if (RE2::PartialMatch(attr.value(),
-                            parsed_attr_spec.disallowed_value_regex())) {
+      if (RuleRegexPartialMatch(attr.value(),
+                                parsed_attr_spec.disallowed_value_regex(),
+                                context.rules().profiler(),
+                                parsed_attr_spec.id())) {
         context.AddError(
             ValidationError::INVALID_ATTR_VALUE, context.line_col(),
             /*params=*/{attr.name(), TagDescriptiveName(spec), attr.value()},
@@ -4601,8 +5552,10 @@ void ValidateAttributes(const ParsedTagSpec& parsed_tag_spec,
     if (parsed_attr_spec.spec().has_trigger() &&
         (!parsed_attr_spec.trigger_spec().has_if_value_regex() ||
          (parsed_attr_spec.trigger_spec().has_if_value_regex() &&
-          RE2::FullMatch(attr.value(),
-                         parsed_attr_spec.trigger_spec().if_value_regex())))) {
+          RuleRegexFullMatch(attr.value(),
+                             parsed_attr_spec.trigger_spec().if_value_regex(),
+                             context.rules().profiler(),
+                             parsed_attr_spec.id())))) {
       parsed_trigger_specs.push_back(&parsed_attr_spec.trigger_spec());
     }
     attrspecs_validated.insert(parsed_attr_spec.id());
@@ -4635,8 +5588,8 @@ void ValidateAttributes(const ParsedTagSpec& parsed_tag_spec,
   for (const ParsedAttrTriggerSpec* trigger_spec : parsed_trigger_specs) {
     for (const std::string& also_requires_attr :
          trigger_spec->spec().also_requires_attr()) {
-      auto it = attr_ids_by_name.find(also_requires_attr);
-      if (it != attr_ids_by_name.end()) {
+      auto it = parsed_tag_spec.attr_ids_by_name().find(also_requires_attr);
+      if (it != parsed_tag_spec.attr_ids_by_name().end()) {
         const int32_t also_requires_attr_id = it->second;
         // If a tag has implicit attributes, we then consider these attributes
         // as validated. E.g. tag 'a' has implicit attributes 'role' and
@@ -4757,10 +5710,10 @@ ParsedValidatorRules::ParsedValidatorRules(HtmlFormat::Code html_format)
     if (!parsed_tag_spec.is_reference_point()) {
       auto& tagspec_dispatch =
           tagspecs_by_tagname_[parsed_tag_spec.spec().tag_name()];
-      std::vector<std::string> dispatch_keys =
+      std::vector<DispatchKey> dispatch_keys =
           parsed_tag_spec.GetDispatchKeys();
       if (!dispatch_keys.empty()) {
-        for (const std::string& dispatch_key : dispatch_keys)
+        for (const DispatchKey& dispatch_key : dispatch_keys)
           tagspec_dispatch.RegisterDispatchKey(dispatch_key, ii);
       } else if (tag.has_extension_spec()) {
         tagspec_dispatch.RegisterDispatchKey(
@@ -4774,6 +5727,14 @@ ParsedValidatorRules::ParsedValidatorRules(HtmlFormat::Code html_format)
     }
     if (parsed_tag_spec.spec().mandatory()) mandatory_tagspecs_.push_back(ii);
   }
+  for (auto& [tagname, tagspec_dispatch] : tagspecs_by_tagname_)
+    tagspec_dispatch.PrecomputeMatches();
+  parsed_attr_specs_->mutable_attr_name_ids()->IndexAtoms();
+  for (const auto& [atom, tag_names] : NamesByAtom()) {
+    auto iter = tagspecs_by_tagname_.find(tag_names.upper);
+    if (iter != tagspecs_by_tagname_.end())
+      tagspecs_by_atom_[atom] = &iter->second;
+  }
   std::stable_sort(mandatory_tagspecs_.begin(), mandatory_tagspecs_.end());
 
   error_codes_.resize(ValidationError::Code_MAX + 1);
@@ -4788,6 +5749,54 @@ ParsedValidatorRules::ParsedValidatorRules(HtmlFormat::Code html_format)
           error_specificity.specificity();
     }
   }
+#ifdef AMP_VALIDATOR_STATS
+  profiler_ = make_unique<RulesProfiler>(tagspec_by_id_.size(),
+                                         parsed_attr_specs_->size());
+#endif
+}
+
+void ParsedValidatorRules::Profile(RulesProfile* profile) const {
+  profile->html_format = html_format_;
+  const RulesProfiler* profiler = this->profiler();
+  if (!profiler) return;
+  for (int32_t id = 0; id < profiler->num_tag_specs(); ++id) {
+    const auto& counters = profiler->tag_spec(id);
+    if (counters.attempts.load(std::memory_order_relaxed) == 0) continue;
+    TagSpecProfile& tag_spec = profile->tag_specs.emplace_back();
+    tag_spec.id = id;
+    tag_spec.name = TagSpecName(GetTagSpec(id)->spec());
+    tag_spec.attempts = counters.attempts.load(std::memory_order_relaxed);
+    tag_spec.wins = counters.wins.load(std::memory_order_relaxed);
+    tag_spec.time = std::chrono::nanoseconds(
+        counters.time_ns.load(std::memory_order_relaxed));
+    tag_spec.attribute_time = std::chrono::nanoseconds(
+        counters.attribute_time_ns.load(std::memory_order_relaxed));
+  }
+  // Attribute specs are declared in a tag spec or in an attribute list.
+  absl::flat_hash_map<const AttrSpec*, std::string> declared_in;
+  for (const AttrList& attr_list : rules_.attr_lists())
+    for (const AttrSpec& attr_spec : attr_list.attrs())
+      declared_in[&attr_spec] = attr_list.name();
+  for (const TagSpec& tag_spec : rules_.tags())
+    for (const AttrSpec& attr_spec : tag_spec.attrs())
+      declared_in[&attr_spec] = TagSpecName(tag_spec);
+  for (int32_t id = 0; id < profiler->num_attr_specs(); ++id) {
+    const auto& counters = profiler->attr_spec(id);
+    if (counters.regex_evaluations.load(std::memory_order_relaxed) == 0 &&
+        counters.cache_hits.load(std::memory_order_relaxed) == 0)
+      continue;
+    const AttrSpec& spec = parsed_attr_specs_->GetById(id).spec();
+    AttrSpecProfile& attr_spec = profile->attr_specs.emplace_back();
+    attr_spec.id = id;
+    attr_spec.name = spec.name();
+    if (auto it = declared_in.find(&spec); it != declared_in.end())
+      attr_spec.declared_in = it->second;
+    attr_spec.regex_evaluations =
+        counters.regex_evaluations.load(std::memory_order_relaxed);
+    attr_spec.regex_time = std::chrono::nanoseconds(
+        counters.regex_time_ns.load(std::memory_order_relaxed));
+    attr_spec.cache_hits = counters.cache_hits.load(std::memory_order_relaxed);
+  }
 }
 
 // Loads validator rules into the |rules_| proto, stub or actual (embedded).
@@ -5123,10 +6132,10 @@ int32_t ParsedValidatorRules::Specificity(ValidationError::Code code) const {
 // in ParsedValidatorRules::ValidateTag to report the results which
 // have the most specific errors.
 int32_t ParsedValidatorRules::MaxSpecificity(
-    const RepeatedPtrField<ValidationError>& errors) const {
+    const vector<ErrorRecord>& errors) const {
   int32_t max_specificity = 0;
-  for (const ValidationError& error : errors) {
-    max_specificity = std::max(max_specificity, Specificity(error.code()));
+  for (const ErrorRecord& error : errors) {
+    max_specificity = std::max(max_specificity, Specificity(error.code));
   }
   return max_specificity;
 }
@@ -5147,12 +6156,12 @@ bool BetterValidationResultStatusThan(ValidationResult::Status statusA,
 
 // Returns true if the error codes in errorsB are a subset of the error codes in
 // errorsA.
-bool IsErrorSubset(const RepeatedPtrField<ValidationError>& errorsA,
-                   const RepeatedPtrField<ValidationError>& errorsB) {
+bool IsErrorSubset(const vector<ErrorRecord>& errorsA,
+                   const vector<ErrorRecord>& errorsB) {
   set<ValidationError::Code> codesA;
-  for (const ValidationError& error : errorsA) codesA.insert(error.code());
+  for (const ErrorRecord& error : errorsA) codesA.insert(error.code);
   set<ValidationError::Code> codesB;
-  for (const ValidationError& error : errorsB) codesB.insert(error.code());
+  for (const ErrorRecord& error : errorsB) codesB.insert(error.code);
 
   // Every code in B is also in A. If they are the same, not a subset.
   return absl::c_includes(codesA, codesB) && codesA.size() > codesB.size();
@@ -5163,7 +6172,8 @@ bool IsErrorSubset(const RepeatedPtrField<ValidationError>& errorsA,
 // Used for comparing ValidationResults for a single tag, produced by multiple
 // tag specs. We prefer passing, fewer, and more specific error messages.
 bool ParsedValidatorRules::BetterValidationResultThan(
-    const ValidationResult& resultA, const ValidationResult& resultB) const {
+    const TagValidationResult& resultA,
+    const TagValidationResult& resultB) const {
   if (resultA.status() != resultB.status())
     return BetterValidationResultStatusThan(resultA.status(), resultB.status());
 
@@ -5393,6 +6403,13 @@ ValidateTagResult ValidateTagAgainstSpec(
     const ParsedTagSpec& parsed_tag_spec,
     const ParsedTagSpec* best_match_reference_point, const Context& context,
     const ParsedHtmlTag& encountered_tag) {
+  VALIDATION_STATS_ADD(tag_spec_attempts, 1);
+  RulesProfiler::TagSpecCounters* counters = nullptr;
+  if (RulesProfiler* profiler = context.rules().profiler()) {
+    counters = &profiler->tag_spec(parsed_tag_spec.id());
+    counters->attempts.fetch_add(1, std::memory_order_relaxed);
+  }
+  RulesProfiler::ScopedTimer timer(counters ? &counters->time_ns : nullptr);
   ValidateTagResult attempt;
   attempt.validation_result.set_status(ValidationResult::PASS);
   ValidateParentTag(parsed_tag_spec, context, &attempt.validation_result);
@@ -5406,6 +6423,8 @@ ValidateTagResult ValidateTagAgainstSpec(
   // Parent/Ancestor errors are informative without adding additional errors
   // about attributes.
   if (attempt.validation_result.status() == ValidationResult::PASS) {
+    RulesProfiler::ScopedTimer attribute_timer(
+        counters ? &counters->attribute_time_ns : nullptr);
     ValidateAttributes(parsed_tag_spec, best_match_reference_point, context,
                        encountered_tag, &attempt);
   }
@@ -5414,6 +6433,10 @@ ValidateTagResult ValidateTagAgainstSpec(
     ValidateDescendantTags(encountered_tag, parsed_tag_spec, context,
                            &attempt.validation_result);
   }
+  // In verdict-only mode, a failed attempt needs no further checks.
+  if (context.verdict_only() &&
+      attempt.validation_result.status() == ValidationResult::FAIL)
+    return attempt;
   ValidateNoSiblingsAllowedTags(encountered_tag, parsed_tag_spec, context,
                                 &attempt.validation_result);
   ValidateLastChildTags(context, &attempt.validation_result);
@@ -5462,7 +6485,7 @@ ValidateTagResult ValidateTag(const ParsedHtmlTag& encountered_tag,
                               const ParsedTagSpec* best_match_reference_point,
                               const Context& context) {
   const TagSpecDispatch& tagspec_dispatch =
-      context.rules().DispatchForTagName(encountered_tag.UpperName());
+      context.rules().DispatchForTag(encountered_tag);
   // Filter TagSpecDispatch.AllTagSpecs by type identifiers.
   vector<const ParsedTagSpec*> filtered_tag_specs;
   for (int32_t tag_id : tagspec_dispatch.AllTagSpecs()) {
@@ -5497,12 +6520,13 @@ ValidateTagResult ValidateTag(const ParsedHtmlTag& encountered_tag,
   // over encountered attributes in the case where we have no dispatches.
   if (tagspec_dispatch.HasDispatchKeys()) {
     for (const ParsedHtmlTagAttr& attr : encountered_tag.Attributes()) {
-      vector<int32_t> tag_spec_ids = tagspec_dispatch.MatchingDispatchKey(
-          attr.name(),
-          // Attribute values are case-sensitive by default, but we
-          // match dispatch keys in a case-insensitive manner and then
-          // validate using whatever the tagspec requests.
-          AsciiStrToLower(attr.value()), context.tag_stack().ParentTagName());
+      absl::Span<const int32_t> tag_spec_ids =
+          tagspec_dispatch.MatchingDispatchKey(
+              attr.name(),
+              // Attribute values are case-sensitive by default, but we
+              // match dispatch keys in a case-insensitive manner and then
+              // validate using whatever the tagspec requests.
+              attr.value(), context.tag_stack().ParentTagName());
       ValidateTagResult ret;
       for (int32_t tag_spec_id : tag_spec_ids) {
         const ParsedTagSpec* parsed_tag_spec =
@@ -5657,42 +6681,175 @@ void ReferencePointMatcher::ExitParentTag(const Context& context,
   }
 }
 
-// Makes Singleton ParsedValidatorRules non destructible.
-// TSAN throw race condition errors when ~ParsedValidatorRules destructor is
-// called.
-template <typename T>
-class NoDestructor {
- public:
-  template <typename... Ts>
-  NoDestructor(Ts&&... args) : t_(new (&space_) T(std::forward<Ts>(args)...)) {}
-
-  const T* Get() const { return t_; }
-
- private:
-  alignas(T) unsigned char space_[sizeof(T)];
-  const T* t_;
-};
-
 class ParsedValidatorRulesProvider {
  public:
   static const ParsedValidatorRules* Get(HtmlFormat::Code format) {
     switch (format) {
       case HtmlFormat::AMP4ADS: {
-        static const NoDestructor<ParsedValidatorRules> rules(
-            HtmlFormat::AMP4ADS);
-        return rules.Get();
+        static const ParsedValidatorRules* rules = Build(HtmlFormat::AMP4ADS);
+        return rules;
       }
       case HtmlFormat::AMP4EMAIL: {
-        static const NoDestructor<ParsedValidatorRules> rules(
-            HtmlFormat::AMP4EMAIL);
-        return rules.Get();
+        static const ParsedValidatorRules* rules =
+            Build(HtmlFormat::AMP4EMAIL);
+        return rules;
       }
       default: {
-        static const NoDestructor<ParsedValidatorRules> rules(HtmlFormat::AMP);
-        return rules.Get();
+        static const ParsedValidatorRules* rules = Build(HtmlFormat::AMP);
+        return rules;
+      }
+    }
+  }
+
+  // Returns the stats of the rules for AMP, AMP4ADS and AMP4EMAIL.
+  static std::vector<RulesStats> Stats() {
+    absl::MutexLock lock(&mu_);
+    std::vector<RulesStats> stats;
+    for (HtmlFormat::Code format :
+         {HtmlFormat::AMP, HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL}) {
+      stats.push_back(states_[Index(format)].stats);
+      stats.back().html_format = format;
+    }
+    return stats;
+  }
+
+ private:
+  struct FormatState {
+    RulesStats stats;
+  };
+
+  static int Index(HtmlFormat::Code format) {
+    switch (format) {
+      case HtmlFormat::AMP4ADS:
+        return 1;
+      case HtmlFormat::AMP4EMAIL:
+        return 2;
+      default:
+        return 0;
+    }
+  }
+
+  // Builds the rules for |format|, recording how long it takes. The rules
+  // are never destroyed, as TSAN reports races in ~ParsedValidatorRules at
+  // exit.
+  static const ParsedValidatorRules* Build(HtmlFormat::Code format) {
+    auto start = std::chrono::steady_clock::now();
+    const auto* rules = new ParsedValidatorRules(format);
+    auto build_time = std::chrono::steady_clock::now() - start;
+
+    absl::MutexLock lock(&mu_);
+    RulesStats& stats = states_[Index(format)].stats;
+    stats.built = true;
+    stats.build_time =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(build_time);
+    return rules;
+  }
+
+  ABSL_CONST_INIT static absl::Mutex mu_;
+  static FormatState states_[3] ABSL_GUARDED_BY(mu_);
+};
+
+ABSL_CONST_INIT absl::Mutex ParsedValidatorRulesProvider::mu_(
+    absl::kConstInit);
+ParsedValidatorRulesProvider::FormatState
+    ParsedValidatorRulesProvider::states_[3];
+
+// The worker threads which parse stylesheets for --css_validation_threads,
+// shared by all validators.
+class CssWorkerPool {
+ public:
+  // Returns the pool, or null if stylesheets are parsed inline. The number of
+  // threads is the value of the flag when the pool is first used.
+  static CssWorkerPool* Get() {
+    if (absl::GetFlag(FLAGS_css_validation_threads) <= 0) return nullptr;
+    static CssWorkerPool* pool =
+        new CssWorkerPool(absl::GetFlag(FLAGS_css_validation_threads));
+    return pool;
+  }
+
+  void Schedule(std::function<void()> task) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    tasks_.push_back(std::move(task));
+  }
+
+ private:
+  explicit CssWorkerPool(int num_threads) {
+    for (int i = 0; i < num_threads; ++i)
+      std::thread([this] { Work(); }).detach();
+  }
+
+  void Work() ABSL_LOCKS_EXCLUDED(mu_) {
+    while (true) {
+      std::function<void()> task;
+      {
+        absl::MutexLock lock(&mu_);
+        mu_.Await(absl::Condition(this, &CssWorkerPool::HasTasks));
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
       }
+      task();
     }
   }
+
+  bool HasTasks() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return !tasks_.empty();
+  }
+
+  absl::Mutex mu_;
+  std::deque<std::function<void()>> tasks_ ABSL_GUARDED_BY(mu_);
+};
+
+// The cdata of a <style> whose stylesheet is parsed by a CssWorkerPool, and
+// the state of the validation as of the cdata, to match it with later.
+class PendingCss {
+ public:
+  PendingCss(const CdataMatcher& matcher, string_view cdata,
+             const LineCol& content_line_col, const LineCol& line_col,
+             bool count_doc_css_bytes)
+      : matcher_(matcher.parsed_cdata_spec(), matcher.line_col()),
+        cdata_(cdata),
+        content_line_col_(content_line_col),
+        line_col_(line_col),
+        count_doc_css_bytes_(count_doc_css_bytes) {}
+
+  // Parses the stylesheet, unless another thread started to already.
+  void Parse() ABSL_LOCKS_EXCLUDED(mu_) {
+    {
+      absl::MutexLock lock(&mu_);
+      if (started_) return;
+      started_ = true;
+    }
+    unique_ptr<ParsedCss> css = matcher_.ParseCss(cdata_, content_line_col_);
+    absl::MutexLock lock(&mu_);
+    css_ = std::move(css);
+    parsed_ = true;
+  }
+
+  // Matches the stylesheet as CdataMatcher::Match() would have, parsing it
+  // on this thread if no worker got to it yet.
+  void Match(Context* context, ValidationResult* result)
+      ABSL_LOCKS_EXCLUDED(mu_) {
+    Parse();
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(&parsed_));
+    }
+    context->SetLineCol(line_col_.line(), line_col_.col());
+    matcher_.MatchParsedCss(cdata_, *css_, count_doc_css_bytes_, context,
+                            result);
+  }
+
+ private:
+  const CdataMatcher matcher_;
+  // A copy, as the cdata of <noscript> contents doesn't outlive traversal.
+  const std::string cdata_;
+  const LineCol content_line_col_;
+  const LineCol line_col_;
+  const bool count_doc_css_bytes_;
+  absl::Mutex mu_;
+  bool started_ ABSL_GUARDED_BY(mu_) = false;
+  bool parsed_ ABSL_GUARDED_BY(mu_) = false;
+  unique_ptr<ParsedCss> css_;
 };
 
 class Validator {
@@ -5701,6 +6858,110 @@ class Validator {
       : rules_(rules), max_errors_(max_errors), context_(rules_, max_errors_) {}
 
   ValidationResult Validate(const htmlparser::Document& doc) {
+    Clear();
+    return ValidateDocument(doc);
+  }
+
+  ValidationResult Validate(std::string_view html) {
+    htmlparser::ParseOptions options = ParseOptions();
+    options.deadline = deadline_;
+#ifdef AMP_VALIDATOR_STATS
+    if (current_validation_stats)
+      options.stats = &current_validation_stats->parse;
+#endif
+    auto parser = std::make_unique<htmlparser::Parser>(html, options);
+    auto doc = parser->Parse();
+    return ValidateParsedDocument(doc.get());
+  }
+
+  // The options with which the validator parses html.
+  static htmlparser::ParseOptions ParseOptions() {
+    return htmlparser::ParseOptions{
+        .scripting = true,
+        .frameset_ok = true,
+        .record_node_offsets = true,
+        .record_attribute_offsets = true,
+        .parse_noscript_as_markup = true,
+    };
+  }
+
+  // Validates the document returned by the parser.
+  ValidationResult ValidateParsedDocument(const htmlparser::Document* doc) {
+    Validator* validator = this;
+    ValidateParsedDocument(doc, absl::MakeConstSpan(&validator, 1));
+    return result_;
+  }
+
+  // Validates the document returned by the parser with each of |validators|,
+  // which must be distinct, in a single traversal. The results are left in
+  // their Result().
+  static void ValidateParsedDocument(const htmlparser::Document* doc,
+                                     absl::Span<Validator* const> validators) {
+    for (Validator* validator : validators) {
+      validator->Clear();
+      // The result of a parse which ran out of time has no verdict.
+      if (doc && validator->deadline_ &&
+          doc->status() == validator->deadline_->status()) {
+        validator->expired_phase_ = ValidationPhase::kParse;
+        continue;
+      }
+      // Currently parser returns nullptr only if document is too complex.
+      // NOTE: If htmlparser starts returning null document for other
+      // reasons, we must add new error types here.
+      if (!doc || !doc->status().ok()) {
+        validator->context_.AddError(ValidationError::DOCUMENT_TOO_COMPLEX,
+                                     LineCol(1, 0), {}, "",
+                                     &validator->result_);
+      }
+    }
+    if (!doc || !doc->status().ok()) return;
+
+    ValidateDocument(*doc, validators);
+  }
+
+  // Changes the maximum number of errors reported for subsequent documents.
+  void set_max_errors(int max_errors) { max_errors_ = max_errors; }
+
+  // Enables verdict-only mode for subsequent documents, see
+  // Context::verdict_only().
+  void set_verdict_only(bool verdict_only) { verdict_only_ = verdict_only; }
+
+  // Sets the deadline of subsequent documents, which stops their validation
+  // early, see htmlparser::Deadline. Null for none.
+  void set_deadline(htmlparser::Deadline* deadline) { deadline_ = deadline; }
+
+  // The phase in which the deadline of the last document expired, if it did.
+  std::optional<ValidationPhase> expired_phase() const {
+    return expired_phase_;
+  }
+
+  // Validates |doc| using the current state, which the caller must have
+  // cleared.
+  ValidationResult ValidateDocument(const htmlparser::Document& doc) {
+    Validator* validator = this;
+    ValidateDocument(doc, absl::MakeConstSpan(&validator, 1));
+    return result_;
+  }
+
+  // Validates |doc| with each of |validators|, whose state the caller must
+  // have cleared, walking the tree once.
+  static void ValidateDocument(const htmlparser::Document& doc,
+                               absl::Span<Validator* const> validators) {
+    for (Validator* validator : validators) validator->StartDocument(doc);
+    ValidateNode(doc.RootNode(), validators);
+    for (Validator* validator : validators) validator->FinishDocument();
+  }
+
+  // Prepares the validation of |doc|, before its traversal.
+  void StartDocument(const htmlparser::Document& doc) {
+    // Parsing stylesheets ahead only helps when the validation can't stop
+    // early, which would depend on the errors found in them.
+    // Nor with a deadline, which is checked on this thread only.
+    // Nor while collecting statistics, which are per thread.
+    css_pool_ = max_errors_ < 0 && !verdict_only_ && !deadline_ &&
+                        !CollectingValidationStats()
+                    ? CssWorkerPool::Get()
+                    : nullptr;
     doc_metadata_ = doc.Metadata();
     UpdateLineColumnIndex(doc.RootNode());
     // The validation check for document size can't be done here since
@@ -5708,39 +6969,27 @@ class Validator {
     // we wouldn't know which rule to apply. It's set to the context
     // so that when those things are known it can be checked.
     context_.SetDocByteSize(doc_metadata_.html_src_bytes);
-    ValidateNode(doc.RootNode());
+  }
+
+  // Completes the validation of the document, after its traversal.
+  void FinishDocument() {
+    // What is left to check depends on the whole document, which wasn't
+    // seen.
+    if (deadline_ && deadline_->expired()) {
+      if (!expired_phase_.has_value()) expired_phase_ = ValidationPhase::kCss;
+      result_.set_status(ValidationResult::UNKNOWN);
+      return;
+    }
+    MatchPendingCss();
     auto [current_line_no, current_col_no] =
         doc_metadata_.document_end_location;
     context_.SetLineCol(current_line_no, current_col_no > 0 ? current_col_no - 1
                                                             : current_col_no);
     EndDocument();
-    return result_;
-  }
-
-  ValidationResult Validate(std::string_view html) {
-    Clear();
-    htmlparser::ParseOptions options{
-        .scripting = true,
-        .frameset_ok = true,
-        .record_node_offsets = true,
-        .record_attribute_offsets = true,
-    };
-    auto parser = std::make_unique<htmlparser::Parser>(html, options);
-    auto doc = parser->Parse();
-    // Currently parser returns nullptr only if document is too complex.
-    // NOTE: If htmlparser starts returning null document for other reasons, we
-    // must add new error types here.
-    if (!doc || !doc->status().ok()) {
-      context_.AddError(ValidationError::DOCUMENT_TOO_COMPLEX, LineCol(1, 0),
-                        {}, "", &result_);
-      return result_;
-    }
-
-    return Validate(*doc);
   }
 
   // Updates context's line column index using the current node's position.
-  inline void UpdateLineColumnIndex(htmlparser::Node* node) {
+  inline void UpdateLineColumnIndex(const htmlparser::Node* node) {
     auto node_line_col = node->LineColInHtmlSrc();
     if (node_line_col.has_value()) {
       auto [line_no, col_no] = node_line_col.value();
@@ -5749,32 +6998,190 @@ class Validator {
     }
   }
 
-  // May return false if validation fails due to DOCUMENT_TOO_COMPLEX error.
-  bool ValidateNode(htmlparser::Node* node, int stack_size = 1) {
-    if (stack_size > GetFlag(FLAGS_max_node_recursion_depth)) {
+  // The outcome of EnterNode().
+  enum class NodeEntry {
+    // The node was validated and has no children to validate.
+    kLeaf,
+    // The node was entered and its children are to be validated next.
+    kChildren,
+    // Validation stops, see ValidateNode().
+    kAbort,
+  };
+
+  // A node whose children are being validated by ValidateNode().
+  struct NodeFrame {
+    const htmlparser::Node* node;
+    const htmlparser::Node* next_child;
+    // Whether |node| is one of the top level nodes of a reparsed <noscript>
+    // text, whose failure does not stop the validation of its siblings.
+    bool in_fragment = false;
+    // The reparsed contents of |fragment_text|, a text child of the
+    // <noscript> |node|. Its nodes are validated before |next_child|.
+    std::unique_ptr<htmlparser::Document> fragment;
+    const htmlparser::Node* fragment_text = nullptr;
+    size_t next_fragment_node = 0;
+  };
+
+  // Validates |root| and its descendants, calling StartTag() and EndTag() in
+  // document order. The traversal keeps its own stack of open nodes, so the
+  // depth of a document is limited only by --max_node_recursion_depth, not by
+  // the call stack.
+  //
+  // May return false if validation fails due to DOCUMENT_TOO_COMPLEX error,
+  // or to stop validation once the verdict is known. As with a recursive
+  // descent, such a failure skips the EndTag() calls of the open nodes.
+  //
+  // Each of |validators| is driven through the same traversal, node by node.
+  // This requires that they enter nodes alike, which holds unless some
+  // validate for the verdict only.
+  static bool ValidateNode(const htmlparser::Node* root,
+                           absl::Span<Validator* const> validators) {
+    const int max_depth = GetFlag(FLAGS_max_node_recursion_depth);
+    vector<NodeFrame>& frames = validators.front()->node_frames_;
+    const bool noscript_parsed_as_markup =
+        validators.front()->doc_metadata_.noscript_parsed_as_markup;
+    frames.clear();
+    switch (EnterNode(root, /*depth=*/1, max_depth, validators)) {
+      case NodeEntry::kLeaf:
+        return true;
+      case NodeEntry::kAbort:
+        return false;
+      case NodeEntry::kChildren:
+        frames.push_back({root, root->FirstChild()});
+        break;
+    }
+
+    while (!frames.empty()) {
+      for (Validator* validator : validators) {
+        if (validator->DeadlineExpired()) return false;
+      }
+      NodeFrame& frame = frames.back();
+      const htmlparser::Node* parent = frame.node;
+      const htmlparser::Node* c;
+      bool in_fragment = false;
+      if (frame.fragment) {
+        const auto& fragment_nodes = frame.fragment->FragmentNodes();
+        if (frame.next_fragment_node == fragment_nodes.size()) {
+          frame.fragment.reset();
+          frame.fragment_text = nullptr;
+          continue;
+        }
+        // The fragment belongs to this validation, unlike the document.
+        htmlparser::Node* fragment_node =
+            fragment_nodes[frame.next_fragment_node++];
+        fragment_node->UpdateChildNodesPositions(parent);
+        c = fragment_node;
+        in_fragment = true;
+      } else if (frame.next_child) {
+        c = frame.next_child;
+        frame.next_child = c->NextSibling();
+      } else {
+        if (parent->Type() == htmlparser::NodeType::ELEMENT_NODE) {
+          std::string upper_tag_name = AsciiStrToUpper(
+              htmlparser::AtomUtil::ToString(parent->DataAtom(),
+                                             parent->Data()));
+          for (Validator* validator : validators)
+            validator->EndTag(upper_tag_name);
+        }
+        frames.pop_back();
+        continue;
+      }
+
+      for (Validator* validator : validators)
+        validator->UpdateLineColumnIndex(c);
+      switch (EnterNode(c, frames.size() + 1, max_depth, validators)) {
+        case NodeEntry::kLeaf:
+          // For user agents with scripting enabled (99% cases) noscript is
+          // parsed as text and ignored. That is noscript element contents are
+          // not evaluated or made part of the DOM.
+          // htmlparser parses AMP documents with the same behavior, i.e
+          // scripting enabled.
+          //
+          // To parse the content of noscript, reparse the noscript element
+          // contents and validate them as children of the noscript element,
+          // unless the parser has already done so.
+          if (!in_fragment && !noscript_parsed_as_markup &&
+              parent->DataAtom() == htmlparser::Atom::NOSCRIPT &&
+              c->Type() == htmlparser::NodeType::TEXT_NODE) {
+            auto dummy_node = std::make_unique<htmlparser::Node>(
+                htmlparser::NodeType::ELEMENT_NODE, htmlparser::Atom::BODY);
+            // The reparse is part of the traversal, so bounded by the same
+            // deadline.
+            htmlparser::Deadline* deadline = validators.front()->deadline_;
+            htmlparser::ParseOptions options = {
+                .scripting = true,
+                .frameset_ok = true,
+                .record_node_offsets = true,
+                .record_attribute_offsets = true,
+                .count_num_terms_in_text_node = true,
+                .deadline = deadline};
+            auto doc = htmlparser::ParseFragmentWithOptions(
+                c->Data(), options, dummy_node.get());
+            if (doc && deadline && doc->status() == deadline->status()) {
+              for (Validator* validator : validators) {
+                if (!validator->expired_phase_.has_value())
+                  validator->expired_phase_ = ValidationPhase::kTraversal;
+              }
+            }
+            if (doc && doc->status().ok()) {
+              frames.back().fragment = std::move(doc);
+              frames.back().fragment_text = c;
+              frames.back().next_fragment_node = 0;
+            }
+          }
+          break;
+        case NodeEntry::kChildren:
+          frames.push_back({c, c->FirstChild(), in_fragment});
+          break;
+        case NodeEntry::kAbort:
+          // A failing node fails its ancestors, up to the nearest top level
+          // node of a reparsed <noscript> text, if any.
+          if (in_fragment) break;
+          for (;;) {
+            if (frames.empty()) return false;
+            bool fragment_root = frames.back().in_fragment;
+            frames.pop_back();
+            if (fragment_root) break;
+          }
+          break;
+      }
+    }
+    return true;
+  }
+
+  // Enters |node| with each of |validators|, see ValidateNode().
+  static NodeEntry EnterNode(const htmlparser::Node* node, int depth,
+                             int max_depth,
+                             absl::Span<Validator* const> validators) {
+    VALIDATION_STATS_ADD(nodes, 1);
+    VALIDATION_STATS_ADD(attributes, node->Attributes().size());
+    NodeEntry entry = NodeEntry::kLeaf;
+    for (Validator* validator : validators)
+      entry = validator->EnterNode(node, depth, max_depth);
+    return entry;
+  }
+
+  // Validates |node| itself, at nesting |depth| (the document being at depth
+  // 1), before its children if any.
+  NodeEntry EnterNode(const htmlparser::Node* node, int depth,
+                      int max_depth) {
+    if (context_.verdict_only() &&
+        result_.status() == ValidationResult::FAIL)
+      return NodeEntry::kAbort;
+    if (depth > max_depth) {
       context_.AddError(ValidationError::DOCUMENT_TOO_COMPLEX,
                         context_.encountered_body_line_col(),
                         /*params=*/{"BODY"},
                         /*spec_url=*/"", &result_);
-      return false;
+      return NodeEntry::kAbort;
     }
 
-    ParsedHtmlTag parsed_tag{node};
-
     switch (node->Type()) {
       case htmlparser::NodeType::ERROR_NODE:
         // TODO: Set error here.
         break;
       case htmlparser::NodeType::DOCUMENT_NODE:
-        for (htmlparser::Node* c = node->FirstChild(); c;
-             c = c->NextSibling()) {
-          UpdateLineColumnIndex(c);
-          if (!ValidateNode(c, ++stack_size)) {
-            return false;
-          }
-          --stack_size;
-        }
-        return true;
+        return NodeEntry::kChildren;
       case htmlparser::NodeType::COMMENT_NODE:
         if (node->IsManufactured()) {
           UpdateLineColumnIndex(node);
@@ -5783,8 +7190,8 @@ class Validator {
                                     node->LineColInHtmlSrc()->second),
                             /*params=*/{"<?"}, /*spec_url=*/"", &result_);
         }
-        return true;
-      case htmlparser::NodeType::DOCTYPE_NODE:
+        return NodeEntry::kLeaf;
+      case htmlparser::NodeType::DOCTYPE_NODE: {
         if (doc_metadata_.quirks_mode) {
           LineCol linecol(1, 0);
           auto lc = node->LineColInHtmlSrc();
@@ -5799,23 +7206,29 @@ class Validator {
                             &result_);
         }
         // Process doctype node as if it is valid.
+        ParsedHtmlTag parsed_tag{node,
+                                 rules_->parsed_attr_specs().attr_name_ids()};
         StartTag(parsed_tag);
-        return true;
+        return NodeEntry::kLeaf;
+      }
       case htmlparser::NodeType::ELEMENT_NODE:
         break;
       case htmlparser::NodeType::TEXT_NODE:
-        return true;
+        return NodeEntry::kLeaf;
       default:
-        return true;
+        return NodeEntry::kLeaf;
     }
 
+    ParsedHtmlTag parsed_tag{node,
+                             rules_->parsed_attr_specs().attr_name_ids()};
     StartTag(parsed_tag);
     std::string upper_tag_name = AsciiStrToUpper(
         htmlparser::AtomUtil::ToString(node->DataAtom(), node->Data()));
 
     const auto& tags_with_cdata = rules_->IntertagsToValidate();
-    bool has_template_ancestor = context_.tag_stack().HasAncestor("TEMPLATE");
     if (tags_with_cdata.find(upper_tag_name) != tags_with_cdata.end()) {
+      bool has_template_ancestor =
+          context_.tag_stack().HasAncestor("TEMPLATE");
       if (node->FirstChild() &&
           node->FirstChild()->Type() == htmlparser::NodeType::TEXT_NODE) {
         for (auto& attr : node->Attributes()) {
@@ -5865,9 +7278,17 @@ class Validator {
             content_lc = LineCol(line_no >= 0 ? line_no : line_no + 1,
                                  col_no > 0 ? col_no - 1 : col_no);
           }
-          cdata_matcher->Match(string_view(node->FirstChild()->Data().data(),
-                                           node->FirstChild()->Data().size()),
-                               &context_, &result_, content_lc);
+          string_view cdata(node->FirstChild()->Data().data(),
+                            node->FirstChild()->Data().size());
+          if (css_pool_ && cdata_matcher->MatchesCss()) {
+            auto pending = std::make_shared<PendingCss>(
+                *cdata_matcher, cdata, content_lc, context_.line_col(),
+                context_.tag_stack().CountDocCssBytes());
+            css_pool_->Schedule([pending] { pending->Parse(); });
+            pending_css_.push_back(std::move(pending));
+          } else {
+            cdata_matcher->Match(cdata, &context_, &result_, content_lc);
+          }
         }
       }
     }
@@ -5875,58 +7296,44 @@ class Validator {
     if (std::find(htmlparser::kVoidElements.begin(),
                   htmlparser::kVoidElements.end(),
                   node->DataAtom()) != htmlparser::kVoidElements.end()) {
-      stack_size--;
       EndTag(upper_tag_name);
-      return true;
+      return NodeEntry::kLeaf;
     }
+    return NodeEntry::kChildren;
 
-    for (htmlparser::Node* c = node->FirstChild(); c;) {
-      auto next = c->NextSibling();
-      UpdateLineColumnIndex(c);
-      if (!ValidateNode(c, ++stack_size)) return false;
-      --stack_size;
-
-      // For user agents with scripting enabled (99% cases) noscript is parsed
-      // as text and ignored. That is noscript element contents are not
-      // evaluated or made part of the DOM.
-      // htmlparser parses AMP documents with the same behavior, i.e scripting
-      // enabled.
-      //
-      // To parse the content of noscript, reparse the noscript element contents
-      // and populate it in the DOM.
-      if (node->DataAtom() == htmlparser::Atom::NOSCRIPT &&
-          c->Type() == htmlparser::NodeType::TEXT_NODE) {
-        auto dummy_node = std::make_unique<htmlparser::Node>(
-            htmlparser::NodeType::ELEMENT_NODE, htmlparser::Atom::BODY);
-        auto doc = htmlparser::ParseFragment(c->Data(), dummy_node.get());
-        if (doc && doc->status().ok()) {
-          // Append all the nodes to the original <noscript> parent.
-          for (htmlparser::Node* cn : doc->FragmentNodes()) {
-            cn->UpdateChildNodesPositions(node);
-            UpdateLineColumnIndex(cn);
-            ValidateNode(cn, ++stack_size);
-            --stack_size;
-          }
-          node->RemoveChild(c);
-        }
-      }
-      c = next;
-    }
-
-    EndTag(AsciiStrToUpper(
-        htmlparser::AtomUtil::ToString(node->DataAtom(), node->Data())));
-    return true;
   }
 
   const ValidationResult& Result() const { return result_; }
 
-  // While the validator instance is tied forever to a given htmlparser
-  // and seemingly not reusable, the htmlparser can be used
-  // to parse multiple documents, so in case a new document arrives
-  // we clear out the state.
+  // Clears out the state left over from a previous document, so that the
+  // same validator instance can be used for many documents. The result and
+  // context keep their allocated storage between documents.
   void Clear() {
     result_.Clear();
-    context_ = Context(rules_, max_errors_);
+    context_.Reset(max_errors_, verdict_only_, deadline_);
+    expired_phase_.reset();
+  }
+
+  // Returns whether the deadline, if any, has expired, noting the phase in
+  // which it did.
+  bool DeadlineExpired() {
+    if (!deadline_) return false;
+    // The CSS tokenizer may have seen it expire first.
+    if (deadline_->expired()) {
+      if (!expired_phase_.has_value()) expired_phase_ = ValidationPhase::kCss;
+      return true;
+    }
+    if (!deadline_->Expired()) return false;
+    expired_phase_ = ValidationPhase::kTraversal;
+    return true;
+  }
+
+  // Matches the stylesheets deferred to the CssWorkerPool, in document
+  // order, so that they add their errors as if matched during traversal.
+  void MatchPendingCss() {
+    for (const shared_ptr<PendingCss>& pending : pending_css_)
+      pending->Match(&context_, &result_);
+    pending_css_.clear();
   }
 
   // While parsing the document HEAD, we may accumulate errors which depend
@@ -5976,9 +7383,19 @@ class Validator {
     }
 
     // Validate against the set of tag specs.
-    ValidateTagResult result_for_tag =
-        ValidateTag(encountered_tag,
-                    result_for_reference_point.best_match_tag_spec, context_);
+    ValidateTagResult result_for_tag;
+    {
+      VALIDATION_STATS_TIMER(tag_spec_matching_time);
+      result_for_tag =
+          ValidateTag(encountered_tag,
+                      result_for_reference_point.best_match_tag_spec, context_);
+    }
+    if (RulesProfiler* profiler = rules_->profiler();
+        profiler && result_for_tag.best_match_tag_spec &&
+        result_for_tag.IsPassing()) {
+      profiler->tag_spec(result_for_tag.best_match_tag_spec->id())
+          .wins.fetch_add(1, std::memory_order_relaxed);
+    }
     // Suppress errors in dev-mode.
     result_for_tag.dev_mode_suppress =
         ShouldSuppressDevModeErrors(encountered_tag, context_);
@@ -6027,6 +7444,7 @@ class Validator {
 
     // As some errors can be inserted out of order, sort errors at the
     // end based on their line/col numbers.
+    VALIDATION_STATS_TIMER(error_sort_time);
     std::stable_sort(
         result_.mutable_errors()->begin(), result_.mutable_errors()->end(),
         [](const ValidationError& lhs, const ValidationError& rhs) {
@@ -6038,27 +7456,624 @@ class Validator {
  private:
   const ParsedValidatorRules* rules_;
   int max_errors_ = -1;
+  bool verdict_only_ = false;
+  htmlparser::Deadline* deadline_ = nullptr;
+  std::optional<ValidationPhase> expired_phase_;
   Context context_;
   htmlparser::DocumentMetadata doc_metadata_;
   ValidationResult result_;
+  // The stack of ValidateNode(), kept to reuse its storage. Only the first
+  // of the validators driven together uses it.
+  vector<NodeFrame> node_frames_;
+  // Where to parse stylesheets, if not inline.
+  CssWorkerPool* css_pool_ = nullptr;
+  // The stylesheets being parsed by |css_pool_|, in document order.
+  vector<shared_ptr<PendingCss>> pending_css_;
   Validator(const Validator&) = delete;
   Validator& operator=(const Validator&) = delete;
 };
 
+// Returns the calling thread's validator for |html_format|, configured to
+// report up to |max_errors| errors. These are kept alive for the lifetime of
+// the thread so that Validate() doesn't pay for setting up a validator on
+// every call.
+Validator* ThreadLocalValidator(HtmlFormat::Code html_format, int max_errors) {
+  thread_local std::unique_ptr<Validator>
+      validators[HtmlFormat::Code_ARRAYSIZE];
+  if (!HtmlFormat::Code_IsValid(html_format)) html_format = HtmlFormat::AMP;
+  std::unique_ptr<Validator>& validator = validators[html_format];
+  if (!validator) {
+    validator = std::make_unique<Validator>(
+        ParsedValidatorRulesProvider::Get(html_format), max_errors);
+  }
+  validator->set_max_errors(max_errors);
+  validator->set_verdict_only(false);
+  validator->set_deadline(nullptr);
+  return validator.get();
+}
+
+// A queue of document indices owned by one ValidateBatch() worker. The owner
+// takes work from the front; idle workers steal from the back, so that a
+// worker stuck on a large document doesn't hold up the documents queued
+// behind it.
+class BatchWorkQueue {
+ public:
+  void Push(int index) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    indices_.push_back(index);
+  }
+
+  // Returns false if the queue is empty.
+  bool Pop(int* index) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    if (indices_.empty()) return false;
+    *index = indices_.front();
+    indices_.pop_front();
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool Steal(int* index) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    if (indices_.empty()) return false;
+    *index = indices_.back();
+    indices_.pop_back();
+    return true;
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::deque<int> indices_ ABSL_GUARDED_BY(mu_);
+};
+
+// Validates |input|, html or a document, with a ThreadLocalValidator.
+template <typename Input>
+BoundedValidationResult ValidateWithDeadline(const Input& input,
+                                             HtmlFormat_Code html_format,
+                                             int max_errors,
+                                             htmlparser::Deadline* deadline) {
+  Validator* validator = ThreadLocalValidator(html_format, max_errors);
+  validator->set_deadline(deadline);
+  BoundedValidationResult bounded;
+  bounded.result = validator->Validate(input);
+  if (deadline && deadline->expired()) {
+    bounded.status = deadline->status();
+    bounded.expired_phase = validator->expired_phase();
+  }
+  validator->set_deadline(nullptr);
+  return bounded;
+}
+
 }  // namespace
 
 ValidationResult Validate(std::string_view html, HtmlFormat_Code html_format,
                           int max_errors) {
-  Validator validator(ParsedValidatorRulesProvider::Get(html_format),
-                      max_errors);
-  return validator.Validate(html);
+  return ThreadLocalValidator(html_format, max_errors)->Validate(html);
+}
+
+ValidationResult Validate(std::string_view html, HtmlFormat_Code html_format,
+                          int max_errors, ValidationStats* stats) {
+  if (stats) *stats = ValidationStats();
+#ifdef AMP_VALIDATOR_STATS
+  ValidationStats* previous_stats = current_validation_stats;
+  current_validation_stats = stats;
+  ValidationResult result = Validate(html, html_format, max_errors);
+  current_validation_stats = previous_stats;
+  return result;
+#else
+  return Validate(html, html_format, max_errors);
+#endif
+}
+
+htmlparser::ParseOptions ValidatorParseOptions() {
+  return Validator::ParseOptions();
 }
 
 ValidationResult Validate(const htmlparser::Document& doc,
                           HtmlFormat_Code html_format, int max_errors) {
-  Validator validator(ParsedValidatorRulesProvider::Get(html_format),
-                      max_errors);
-  return validator.Validate(doc);
+  return ThreadLocalValidator(html_format, max_errors)->Validate(doc);
+}
+
+std::vector<ValidationResult> ValidateMulti(
+    std::string_view html, absl::Span<const HtmlFormat_Code> formats,
+    int max_errors) {
+  // There is one thread local validator per format, so formats listed more
+  // than once share their validator, and their result.
+  std::vector<Validator*> validators;
+  std::vector<int> validator_indices;
+  validator_indices.reserve(formats.size());
+  for (HtmlFormat_Code html_format : formats) {
+    Validator* validator = ThreadLocalValidator(html_format, max_errors);
+    auto it = std::find(validators.begin(), validators.end(), validator);
+    validator_indices.push_back(it - validators.begin());
+    if (it == validators.end()) validators.push_back(validator);
+  }
+  std::vector<ValidationResult> results;
+  if (validators.empty()) return results;
+
+  auto parser =
+      std::make_unique<htmlparser::Parser>(html, Validator::ParseOptions());
+  auto doc = parser->Parse();
+  Validator::ValidateParsedDocument(doc.get(), validators);
+  results.reserve(formats.size());
+  for (int index : validator_indices)
+    results.push_back(validators[index]->Result());
+  return results;
+}
+
+BoundedValidationResult Validate(std::string_view html,
+                                 HtmlFormat_Code html_format, int max_errors,
+                                 htmlparser::Deadline* deadline) {
+  return ValidateWithDeadline(html, html_format, max_errors, deadline);
+}
+
+BoundedValidationResult Validate(const htmlparser::Document& doc,
+                                 HtmlFormat_Code html_format, int max_errors,
+                                 htmlparser::Deadline* deadline) {
+  return ValidateWithDeadline(doc, html_format, max_errors, deadline);
+}
+
+ValidationResult::Status ValidateVerdict(std::string_view html,
+                                         HtmlFormat_Code html_format) {
+  Validator* validator = ThreadLocalValidator(html_format, /*max_errors=*/0);
+  validator->set_verdict_only(true);
+  return validator->Validate(html).status();
 }
 
+ValidationResult::Status ValidateVerdict(const htmlparser::Document& doc,
+                                         HtmlFormat_Code html_format) {
+  Validator* validator = ThreadLocalValidator(html_format, /*max_errors=*/0);
+  validator->set_verdict_only(true);
+  return validator->Validate(doc).status();
+}
+
+std::vector<ValidationResult> ValidateBatch(
+    absl::Span<const std::string_view> htmls, HtmlFormat_Code html_format,
+    int max_errors, int num_threads) {
+  std::vector<ValidationResult> results(htmls.size());
+  if (num_threads <= 0) num_threads = std::thread::hardware_concurrency();
+  num_threads = std::max(1, std::min<int>(num_threads, htmls.size()));
+  if (num_threads == 1) {
+    for (size_t i = 0; i < htmls.size(); ++i)
+      results[i] = Validate(htmls[i], html_format, max_errors);
+    return results;
+  }
+
+  // Each worker starts out with a contiguous share of the documents and,
+  // once it is done with them, steals from the other workers' queues.
+  // Each worker validates on its own thread-local validator; only the
+  // parsed rules are shared, and these are immutable.
+  std::vector<BatchWorkQueue> queues(num_threads);
+  for (size_t i = 0; i < htmls.size(); ++i)
+    queues[i * num_threads / htmls.size()].Push(i);
+  // Build the rules before the workers race to do so.
+  ParsedValidatorRulesProvider::Get(html_format);
+
+  auto worker = [&](int id) {
+    int index;
+    while (true) {
+      if (!queues[id].Pop(&index)) {
+        bool stolen = false;
+        for (int i = 1; i < num_threads && !stolen; ++i)
+          stolen = queues[(id + i) % num_threads].Steal(&index);
+        // Queues are only ever drained, so if all of them are empty there
+        // is no work left.
+        if (!stolen) return;
+      }
+      results[index] = Validate(htmls[index], html_format, max_errors);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (int id = 1; id < num_threads; ++id) threads.emplace_back(worker, id);
+  worker(0);
+  for (std::thread& thread : threads) thread.join();
+  return results;
+}
+
+class ChunkedValidator::Impl {
+ public:
+  Impl(HtmlFormat_Code html_format, int max_errors)
+      : html_format_(html_format),
+        max_errors_(max_errors),
+        parser_(std::make_unique<htmlparser::StreamingParser>(
+            Validator::ParseOptions())) {}
+
+  void Feed(std::string_view chunk) {
+    CHECK(parser_ != nullptr) << "Feed() called after Finish()";
+    parser_->Feed(chunk);
+  }
+
+  ValidationResult Finish() {
+    CHECK(parser_ != nullptr) << "Finish() called twice";
+    std::unique_ptr<htmlparser::Document> doc = parser_->Finish();
+    parser_.reset();
+    return ThreadLocalValidator(html_format_, max_errors_)
+        ->ValidateParsedDocument(doc.get());
+  }
+
+ private:
+  const HtmlFormat_Code html_format_;
+  const int max_errors_;
+  std::unique_ptr<htmlparser::StreamingParser> parser_;
+};
+
+ChunkedValidator::ChunkedValidator(HtmlFormat_Code html_format,
+                                   int max_errors)
+    : impl_(std::make_unique<Impl>(html_format, max_errors)) {}
+
+ChunkedValidator::~ChunkedValidator() = default;
+
+void ChunkedValidator::Feed(std::string_view chunk) { impl_->Feed(chunk); }
+
+ValidationResult ChunkedValidator::Finish() { return impl_->Finish(); }
+
+class ValidatorSession::Impl {
+ public:
+  Impl(HtmlFormat_Code html_format, int max_errors)
+      : html_format_(html_format),
+        validator_(ParsedValidatorRulesProvider::Get(html_format),
+                   max_errors) {}
+
+  HtmlFormat_Code html_format() const { return html_format_; }
+  Validator* validator() { return &validator_; }
+
+ private:
+  const HtmlFormat_Code html_format_;
+  Validator validator_;
+};
+
+ValidatorSession::ValidatorSession(HtmlFormat_Code html_format,
+                                   int max_errors)
+    : impl_(std::make_unique<Impl>(html_format, max_errors)) {}
+
+ValidatorSession::~ValidatorSession() = default;
+
+ValidationResult ValidatorSession::Validate(std::string_view html) {
+  return impl_->validator()->Validate(html);
+}
+
+ValidationResult ValidatorSession::Validate(
+    const htmlparser::Document& document) {
+  return impl_->validator()->Validate(document);
+}
+
+HtmlFormat_Code ValidatorSession::html_format() const {
+  return impl_->html_format();
+}
+
+class IncrementalValidator::Impl {
+ public:
+  Impl(HtmlFormat_Code html_format, int max_errors)
+      : html_format_(html_format),
+        max_errors_(max_errors),
+        rules_(ParsedValidatorRulesProvider::Get(html_format)) {
+    for (const DocSpec& doc_spec : rules_->rules().doc()) {
+      if (doc_spec.has_max_bytes() && doc_spec.max_bytes() >= 0)
+        max_doc_bytes_ =
+            std::min<size_t>(max_doc_bytes_, doc_spec.max_bytes());
+    }
+  }
+
+  ValidationResult Validate(std::string_view html) {
+    html_ = std::string(html);
+    return ValidateInFull();
+  }
+
+  ValidationResult Edit(size_t offset, size_t length,
+                        std::string_view replacement) {
+    CHECK(offset <= html_.size() && length <= html_.size() - offset)
+        << "Edit out of range";
+    if (EditTextRun(offset, length, replacement)) {
+      ++stats_.incremental_edits;
+      return result_;
+    }
+    html_.replace(offset, length, replacement);
+    return ValidateInFull();
+  }
+
+  const std::string& html() const { return html_; }
+  IncrementalValidatorStats stats() const { return stats_; }
+
+ private:
+  // A text node whose contents may be edited without changing anything
+  // but its own contents and the columns of whatever follows it on its line:
+  // a text node of the body, on one line, of printable ASCII characters
+  // other than '<' and '&', which the source has verbatim.
+  struct TextRun {
+    // The column of the first character, counted in code points from 0.
+    int col;
+    // In bytes, which is also in columns.
+    int size;
+  };
+
+  // Whether |c| may be part of a TextRun.
+  static bool IsTextRunChar(char c) {
+    return (c == '\t' || (c >= ' ' && c <= '~')) && c != '<' && c != '&';
+  }
+
+  // Whether a TextRun with |text| is more than whitespace, so that the parser
+  // treats it the same way no matter how it's edited, see frameset-ok in the
+  // HTML parsing spec.
+  static bool HasNonWhitespace(std::string_view text) {
+    return text.find_first_not_of(" \t") != std::string_view::npos;
+  }
+
+  ValidationResult ValidateInFull() {
+    ++stats_.full_validations;
+    htmlparser::Parser parser(html_, Validator::ParseOptions());
+    std::unique_ptr<htmlparser::Document> doc = parser.Parse();
+    IndexLines();
+    IndexTextRuns(doc.get());
+    result_ = ThreadLocalValidator(html_format_, max_errors_)
+                  ->ValidateParsedDocument(doc.get());
+    return result_;
+  }
+
+  // Records the offsets at which lines start, where lines are separated the
+  // same way as by the tokenizer.
+  void IndexLines() {
+    line_starts_.assign(1, 0);
+    for (size_t i = 0; i < html_.size(); ++i) {
+      if (html_[i] == '\n' ||
+          (html_[i] == '\r' && i + 1 < html_.size() && html_[i + 1] != '\n'))
+        line_starts_.push_back(i + 1);
+    }
+  }
+
+  // Returns the column, in code points as counted by the tokenizer, of
+  // |offset| within the line starting at |line_start|.
+  int ColumnOf(size_t line_start, size_t offset) const {
+    int col = 0;
+    for (size_t i = line_start; i < offset; ++i) {
+      ++col;
+      int multi_byte =
+          htmlparser::Strings::CodePointByteSequenceCount(html_[i]);
+      if (multi_byte > 1) col -= multi_byte - 1;
+    }
+    return col;
+  }
+
+  // Returns the offset of the code point at |col| within the line starting at
+  // |line_start|.
+  size_t OffsetOf(size_t line_start, int col) const {
+    size_t offset = line_start;
+    while (col > 0 && offset < html_.size()) {
+      int multi_byte =
+          htmlparser::Strings::CodePointByteSequenceCount(html_[offset]);
+      offset += std::max(multi_byte, 1);
+      --col;
+    }
+    return offset;
+  }
+
+  void IndexTextRuns(htmlparser::Document* doc) {
+    text_runs_.clear();
+    if (!doc || !doc->status().ok()) return;
+    // The elements whose text is parsed or validated in any special way, or
+    // whose position in the tree depends on the text.
+    static const auto* const kSpecialElements =
+        new flat_hash_set<htmlparser::Atom>{
+            htmlparser::Atom::IFRAME,   htmlparser::Atom::LISTING,
+            htmlparser::Atom::MATH,     htmlparser::Atom::NOEMBED,
+            htmlparser::Atom::NOFRAMES, htmlparser::Atom::NOSCRIPT,
+            htmlparser::Atom::PLAINTEXT, htmlparser::Atom::PRE,
+            htmlparser::Atom::SCRIPT,   htmlparser::Atom::SELECT,
+            htmlparser::Atom::STYLE,    htmlparser::Atom::SVG,
+            htmlparser::Atom::TABLE,    htmlparser::Atom::TBODY,
+            htmlparser::Atom::TEMPLATE, htmlparser::Atom::TEXTAREA,
+            htmlparser::Atom::TFOOT,    htmlparser::Atom::THEAD,
+            htmlparser::Atom::TITLE,    htmlparser::Atom::TR,
+            htmlparser::Atom::XMP};
+    htmlparser::Node* body = nullptr;
+    for (htmlparser::Node* html = doc->RootNode()->FirstChild(); html;
+         html = html->NextSibling()) {
+      if (html->DataAtom() != htmlparser::Atom::HTML) continue;
+      for (htmlparser::Node* c = html->FirstChild(); c; c = c->NextSibling())
+        if (c->DataAtom() == htmlparser::Atom::BODY) body = c;
+    }
+    if (!body) return;
+
+    vector<htmlparser::Node*> stack = {body};
+    while (!stack.empty()) {
+      htmlparser::Node* parent = stack.back();
+      stack.pop_back();
+      bool validates_text =
+          rules_->IntertagsToValidate().count(AsciiStrToUpper(
+              htmlparser::AtomUtil::ToString(parent->DataAtom(),
+                                             parent->Data()))) > 0;
+      for (htmlparser::Node* c = parent->FirstChild(); c;
+           c = c->NextSibling()) {
+        if (c->Type() == htmlparser::NodeType::ELEMENT_NODE) {
+          if (!kSpecialElements->contains(c->DataAtom())) stack.push_back(c);
+          continue;
+        }
+        if (c->Type() == htmlparser::NodeType::TEXT_NODE && !validates_text)
+          MaybeIndexTextRun(c);
+      }
+    }
+    for (auto& [line, runs] : text_runs_) {
+      std::sort(runs.begin(), runs.end(),
+                [](const TextRun& lhs, const TextRun& rhs) {
+                  return lhs.col < rhs.col;
+                });
+    }
+  }
+
+  void MaybeIndexTextRun(htmlparser::Node* text) {
+    std::string_view data = text->Data();
+    auto line_col = text->LineColInHtmlSrc();
+    if (!line_col.has_value() || data.empty() || !HasNonWhitespace(data) ||
+        !std::all_of(data.begin(), data.end(), IsTextRunChar))
+      return;
+    auto [line, col] = line_col.value();
+    if (line < 1 || line > static_cast<int>(line_starts_.size()) || col < 0)
+      return;
+    size_t offset = OffsetOf(line_starts_[line - 1], col);
+    // The text must be verbatim in the source, as one token which ends at
+    // the next tag, or else the tree depends on more than the text itself.
+    if (html_.compare(offset, data.size(), data) != 0 ||
+        (offset + data.size() < html_.size() &&
+         html_[offset + data.size()] != '<'))
+      return;
+    text_runs_[line].push_back({col, static_cast<int>(data.size())});
+  }
+
+  // Applies an edit which stays within a TextRun, and updates the result
+  // accordingly. Returns false, without effect, for any other edit.
+  bool EditTextRun(size_t offset, size_t length, std::string_view replacement) {
+    if (text_runs_.empty() ||
+        !std::all_of(replacement.begin(), replacement.end(), IsTextRunChar) ||
+        !std::all_of(html_.begin() + offset, html_.begin() + offset + length,
+                     IsTextRunChar))
+      return false;
+    const int delta =
+        static_cast<int>(replacement.size()) - static_cast<int>(length);
+    if (html_.size() > max_doc_bytes_ ||
+        html_.size() - length + replacement.size() > max_doc_bytes_)
+      return false;
+
+    // Neither the replaced text nor the replacement spans lines.
+    const int line = std::upper_bound(line_starts_.begin(), line_starts_.end(),
+                                      offset) -
+                     line_starts_.begin();
+    auto runs = text_runs_.find(line);
+    if (runs == text_runs_.end()) return false;
+    const int col = ColumnOf(line_starts_[line - 1], offset);
+    auto run = std::find_if(runs->second.begin(), runs->second.end(),
+                            [&](const TextRun& candidate) {
+                              return candidate.col <= col &&
+                                     col + static_cast<int>(length) <=
+                                         candidate.col + candidate.size;
+                            });
+    if (run == runs->second.end()) return false;
+    size_t run_offset = offset - (col - run->col);
+    std::string text = html_.substr(run_offset, run->size);
+    text.replace(offset - run_offset, length, replacement);
+    if (!HasNonWhitespace(text)) return false;
+
+    // Whatever follows the run on its line moves by |delta| columns; nothing
+    // else moves. The text node itself, at column run->col, doesn't move
+    // either, and is validated as column run->col - 1, see
+    // Validator::UpdateLineColumnIndex.
+    html_.replace(offset, length, replacement);
+    for (size_t i = line; i < line_starts_.size(); ++i)
+      line_starts_[i] += delta;
+    for (TextRun& other : runs->second) {
+      if (other.col > run->col) other.col += delta;
+    }
+    const int first_moved_col = run->col + 1;
+    run->size += delta;
+    for (ValidationError& error : *result_.mutable_errors()) {
+      if (error.line() == line && error.col() >= first_moved_col)
+        error.set_col(error.col() + delta);
+    }
+    return true;
+  }
+
+  const HtmlFormat_Code html_format_;
+  const int max_errors_;
+  const ParsedValidatorRules* rules_;
+  // Documents larger than this may fail validation for their size, which
+  // depends on more than the edit.
+  size_t max_doc_bytes_ = std::numeric_limits<size_t>::max();
+  std::string html_;
+  ValidationResult result_;
+  // The offset of each line of html_.
+  vector<size_t> line_starts_;
+  // The TextRuns of html_ by line, sorted by column.
+  flat_hash_map<int, vector<TextRun>> text_runs_;
+  IncrementalValidatorStats stats_;
+};
+
+IncrementalValidator::IncrementalValidator(HtmlFormat_Code html_format,
+                                           int max_errors)
+    : impl_(std::make_unique<Impl>(html_format, max_errors)) {}
+
+IncrementalValidator::~IncrementalValidator() = default;
+
+ValidationResult IncrementalValidator::Validate(std::string_view html) {
+  return impl_->Validate(html);
+}
+
+ValidationResult IncrementalValidator::Edit(size_t offset, size_t length,
+                                            std::string_view replacement) {
+  return impl_->Edit(offset, length, replacement);
+}
+
+const std::string& IncrementalValidator::html() const { return impl_->html(); }
+
+IncrementalValidatorStats IncrementalValidator::stats() const {
+  return impl_->stats();
+}
+
+void Warmup(absl::Span<const HtmlFormat_Code> html_formats, int num_threads) {
+  if (num_threads <= 0) num_threads = std::thread::hardware_concurrency();
+  num_threads = std::max(1, std::min<int>(num_threads, html_formats.size()));
+  std::atomic<size_t> next = 0;
+  auto worker = [&] {
+    for (size_t i; (i = next++) < html_formats.size();)
+      ParsedValidatorRulesProvider::Get(html_formats[i]);
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (int i = 1; i < num_threads; ++i) threads.emplace_back(worker);
+  worker();
+  for (std::thread& thread : threads) thread.join();
+}
+
+BackgroundWarmup::BackgroundWarmup(
+    absl::Span<const HtmlFormat_Code> html_formats)
+    : thread_([html_formats = std::vector<HtmlFormat_Code>(
+                   html_formats.begin(), html_formats.end())] {
+        Warmup(html_formats);
+      }) {}
+
+BackgroundWarmup::~BackgroundWarmup() { Wait(); }
+
+void BackgroundWarmup::Wait() {
+  if (thread_.joinable()) thread_.join();
+}
+
+std::vector<RulesStats> GetRulesStats() {
+  return ParsedValidatorRulesProvider::Stats();
+}
+
+std::vector<RulesProfile> GetRulesProfiles() {
+  std::vector<RulesProfile> profiles;
+  for (const RulesStats& stats : ParsedValidatorRulesProvider::Stats()) {
+    RulesProfile& profile = profiles.emplace_back();
+    profile.html_format = stats.html_format;
+    // Rules which weren't built have nothing to report.
+    if (stats.built)
+      ParsedValidatorRulesProvider::Get(stats.html_format)->Profile(&profile);
+  }
+  return profiles;
+}
+
+RegexStats GetRegexStats() { return RegexRegistry::Stats(); }
+
+AttrValueCacheStats GetAttrValueCacheStats() { return AttrValueCache::Stats(); }
+
+uint64_t EmbeddedRulesFingerprint() {
+  static const uint64_t fingerprint = [] {
+    // 64-bit FNV-1a.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < amp::validator::data::kValidatorProtoBytesSize;
+         ++i) {
+      hash ^= static_cast<unsigned char>(
+          amp::validator::data::kValidatorProtoBytes[i]);
+      hash *= 0x100000001b3;
+    }
+    return hash;
+  }();
+  return fingerprint;
+}
+
+#ifndef AMP_VALIDATOR_BUILD_STAMP
+#define AMP_VALIDATOR_BUILD_STAMP __DATE__ " " __TIME__
+#endif
+
+std::string_view ValidatorBuildStamp() { return AMP_VALIDATOR_BUILD_STAMP; }
+
 }  // namespace amp::validator
@@ -0,0 +1,81 @@
+// Validates a corpus of documents and prints where validation spent its time,
+// per TagSpec and per AttrSpec of the rules, most expensive first, so that
+// rule authors can see the cost of their changes.
+//
+// Usage:
+//   validator-profile <html_format> <html_file>...
+//
+// where html_format is one of AMP, AMP4ADS, AMP4EMAIL. The profile is only
+// collected by builds with bazel build --define=stats=1.
+//
+// The output is tab separated: a line per TagSpec with its id, name,
+// attempts, wins, time and attribute time, then a line per AttrSpec with its
+// id, attribute name, declaring TagSpec or AttrList, regex evaluations,
+// regex time and attribute value cache hits. Times are in microseconds.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "cpp/engine/validator.h"
+#include "cpp/htmlparser/fileutil.h"
+#include "cpp/htmlparser/logging.h"
+#include "validator.pb.h"
+
+namespace {
+
+int64_t Micros(std::chrono::nanoseconds time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  CHECK(argc >= 3) << "Usage: validator-profile <html_format> <html_file>...";
+  CHECK(amp::validator::kValidationStatsEnabled)
+      << "Profiles are only collected with bazel build --define=stats=1.";
+  amp::validator::HtmlFormat_Code html_format;
+  CHECK(amp::validator::HtmlFormat_Code_Parse(argv[1], &html_format) &&
+        html_format != amp::validator::HtmlFormat::UNKNOWN_CODE)
+      << "Unknown html format: " << argv[1];
+
+  for (int i = 2; i < argc; ++i) {
+    amp::validator::Validate(htmlparser::FileUtil::FileContents(argv[i]),
+                             html_format);
+  }
+
+  for (amp::validator::RulesProfile& profile :
+       amp::validator::GetRulesProfiles()) {
+    if (profile.html_format != html_format) continue;
+    std::sort(profile.tag_specs.begin(), profile.tag_specs.end(),
+              [](const amp::validator::TagSpecProfile& lhs,
+                 const amp::validator::TagSpecProfile& rhs) {
+                return lhs.time > rhs.time;
+              });
+    std::sort(profile.attr_specs.begin(), profile.attr_specs.end(),
+              [](const amp::validator::AttrSpecProfile& lhs,
+                 const amp::validator::AttrSpecProfile& rhs) {
+                return lhs.regex_time > rhs.regex_time;
+              });
+    std::cout << "tag_spec_id\tname\tattempts\twins\ttime_us\t"
+                 "attribute_time_us\n";
+    for (const amp::validator::TagSpecProfile& tag_spec : profile.tag_specs) {
+      std::cout << tag_spec.id << "\t" << tag_spec.name << "\t"
+                << tag_spec.attempts << "\t" << tag_spec.wins << "\t"
+                << Micros(tag_spec.time) << "\t"
+                << Micros(tag_spec.attribute_time) << "\n";
+    }
+    std::cout << "\nattr_spec_id\tname\tdeclared_in\tregex_evaluations\t"
+                 "regex_time_us\tcache_hits\n";
+    for (const amp::validator::AttrSpecProfile& attr_spec :
+         profile.attr_specs) {
+      std::cout << attr_spec.id << "\t" << attr_spec.name << "\t"
+                << attr_spec.declared_in << "\t"
+                << attr_spec.regex_evaluations << "\t"
+                << Micros(attr_spec.regex_time) << "\t"
+                << attr_spec.cache_hits << "\n";
+    }
+  }
+  return 0;
+}
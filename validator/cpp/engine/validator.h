@@ -18,17 +18,95 @@
 //
 //     Above call will return upto 10 errors only.
 //
+//   - To validate a document that arrives in chunks, parsing them as they
+//     arrive and validating once the last one has:
+//     amp::validator::ChunkedValidator validator(
+//         amp::validator::HtmlFormat::AMP);
+//     while (...) validator.Feed(chunk);
+//     auto result = validator.Finish();
+//
+//   - To validate a document for several formats, parsing and traversing it
+//     once:
+//     std::vector<ValidationResult> results = amp::validator::ValidateMulti(
+//         my_html, {amp::validator::HtmlFormat::AMP,
+//                   amp::validator::HtmlFormat::AMP4ADS});
+//
+//   - To bound the time spent on hostile documents, give a deadline, which
+//     may also be cancelled from another thread:
+//     htmlparser::CancellationToken token;
+//     htmlparser::Deadline deadline(
+//         std::chrono::steady_clock::now() + std::chrono::seconds(1), &token);
+//     auto bounded = amp::validator::Validate(my_html,
+//                        amp::validator::HtmlFormat::AMP, -1, &deadline);
+//     if (!bounded.status.ok()) ...  // Out of time, no verdict.
+//
+//   - If only PASS or FAIL is of interest, use the faster:
+//     auto status = amp::validator::ValidateVerdict(my_html,
+//                       amp::validator::HtmlFormat::AMP);
+//
+//   - To validate a batch of documents on several threads:
+//     std::vector<ValidationResult> results =
+//         amp::validator::ValidateBatch(htmls,
+//             amp::validator::HtmlFormat::AMP, /*max_errors=*/-1,
+//             /*num_threads=*/8);
+//
+//   - To validate many documents of the same format, create a session once
+//     and reuse it, which avoids the per-document setup cost:
+//     amp::validator::ValidatorSession session(
+//         amp::validator::HtmlFormat::AMP);
+//     for (std::string_view html : documents) {
+//       auto result = session.Validate(html);
+//     }
+//
+//   - To validate one parsed document for several formats, possibly on
+//     several threads at once, since the document is only read:
+//     auto doc = htmlparser::Parser(my_html,
+//         amp::validator::ValidatorParseOptions()).Parse();
+//     auto ads_result = amp::validator::Validate(*doc,
+//                           amp::validator::HtmlFormat::AMP4ADS);
+//     auto email_result = amp::validator::Validate(*doc,
+//                             amp::validator::HtmlFormat::AMP4EMAIL);
+//
+//   - To revalidate a document after each of many small edits:
+//     amp::validator::IncrementalValidator validator(
+//         amp::validator::HtmlFormat::AMP);
+//     validator.Validate(my_html);
+//     auto result = validator.Edit(offset, length, replacement);
+//
+//   - To build the rules for all formats up front, instead of on the first
+//     validation of each format:
+//     amp::validator::Warmup();
+//
 //   - See scripts/basic_validator_example.cc for a working example.
 
 #ifndef CPP_ENGINE_VALIDATOR_H_
 #define CPP_ENGINE_VALIDATOR_H_
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
 #include "cpp/htmlparser/css/parse-css.h"
+#include "cpp/htmlparser/deadline.h"
 #include "cpp/htmlparser/document.h"
+#include "cpp/htmlparser/parser.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "validator.pb.h"
 
 namespace amp::validator {
 
+// The options with which Validate() parses html. Documents parsed with other
+// options may be reported at other lines and columns, or differently.
+htmlparser::ParseOptions ValidatorParseOptions();
+
+// Validation only reads |document|, so the same document may be validated on
+// several threads at once.
 ValidationResult Validate(const htmlparser::Document& document,
                           HtmlFormat_Code html_format = HtmlFormat::AMP,
                           int max_errors = -1);
@@ -37,6 +115,334 @@ ValidationResult Validate(std::string_view html,
                           HtmlFormat_Code html_format = HtmlFormat::AMP,
                           int max_errors = -1);
 
+// The phases of a validation, in which its deadline may expire.
+enum class ValidationPhase {
+  // Parsing the html into a document.
+  kParse,
+  // Walking the document and checking its tags.
+  kTraversal,
+  // Tokenizing a stylesheet or a style attribute.
+  kCss,
+};
+
+// The result of a validation with a deadline.
+struct BoundedValidationResult {
+  // OK, or the status() of the deadline if it expired, in which case
+  // |result| has the errors found until then and an UNKNOWN status.
+  absl::Status status;
+  // The phase in which the deadline expired, if it did.
+  std::optional<ValidationPhase> expired_phase;
+  ValidationResult result;
+};
+
+// Like Validate() above, but stops once |deadline| expires. The deadline is
+// checked before each token of the parser and of the CSS tokenizer, and
+// before each node of the traversal.
+BoundedValidationResult Validate(std::string_view html,
+                                 HtmlFormat_Code html_format, int max_errors,
+                                 htmlparser::Deadline* deadline);
+
+BoundedValidationResult Validate(const htmlparser::Document& document,
+                                 HtmlFormat_Code html_format, int max_errors,
+                                 htmlparser::Deadline* deadline);
+
+// Whether the validator is built to collect ValidationStats, with
+// bazel build --define=stats=1. Otherwise, the statistics stay zero and
+// validation costs nothing more for them.
+#ifdef AMP_VALIDATOR_STATS
+inline constexpr bool kValidationStatsEnabled = true;
+#else
+inline constexpr bool kValidationStatsEnabled = false;
+#endif
+
+// Where the time of a validation went. The times of the phases below are
+// wall times, measured each time a phase is entered, and overlap: e.g. the
+// attribute regexes and url checks are part of the tag spec matching.
+struct ValidationStats {
+  // Tokenizing and tree construction, see htmlparser::ParseStats.
+  htmlparser::ParseStats parse;
+  // The nodes and attributes visited by the traversal.
+  int64_t nodes = 0;
+  int64_t attributes = 0;
+  // The tag specs a tag was checked against, and the time spent finding the
+  // spec which matches each tag.
+  int64_t tag_spec_attempts = 0;
+  std::chrono::nanoseconds tag_spec_matching_time{0};
+  // The regexes of the rules evaluated against attribute values and cdata.
+  int64_t regex_evaluations = 0;
+  std::chrono::nanoseconds regex_time{0};
+  // Tokenizing and parsing stylesheets and style attributes.
+  int64_t css_tokens = 0;
+  std::chrono::nanoseconds css_parse_time{0};
+  // The urls of attributes checked.
+  int64_t url_checks = 0;
+  std::chrono::nanoseconds url_check_time{0};
+  // Sorting the errors by position at the end of the document.
+  std::chrono::nanoseconds error_sort_time{0};
+};
+
+// Like Validate() above, but also fills |stats| if kValidationStatsEnabled.
+ValidationResult Validate(std::string_view html, HtmlFormat_Code html_format,
+                          int max_errors, ValidationStats* stats);
+
+// Validates |html| for each of |formats|, returning the results in the same
+// order. The results are those of Validate() for each format, but the
+// document is parsed once and its tree walked once, with the rules of all
+// formats checked at each node.
+std::vector<ValidationResult> ValidateMulti(
+    std::string_view html, absl::Span<const HtmlFormat_Code> formats,
+    int max_errors = -1);
+
+// Returns PASS if the document is valid and FAIL otherwise, like the status
+// of the result of Validate(), only faster: no errors are produced, and
+// validation stops at the first error. Use this where only the verdict is
+// needed.
+ValidationResult::Status ValidateVerdict(
+    std::string_view html, HtmlFormat_Code html_format = HtmlFormat::AMP);
+
+ValidationResult::Status ValidateVerdict(
+    const htmlparser::Document& document,
+    HtmlFormat_Code html_format = HtmlFormat::AMP);
+
+// Validates each of |htmls|, returning the results in the same order.
+// Documents are distributed across |num_threads| threads, which balance the
+// load between them by stealing work from each other. If |num_threads| is
+// not positive, one thread per hardware thread is used.
+std::vector<ValidationResult> ValidateBatch(
+    absl::Span<const std::string_view> htmls,
+    HtmlFormat_Code html_format = HtmlFormat::AMP, int max_errors = -1,
+    int num_threads = 0);
+
+// Validates a single document which is fed in chunks, e.g. as it arrives
+// over the network. This is not streaming validation: only tokenization and
+// tree construction advance with each chunk, and the tags are all validated
+// in Finish(), as the tree builder may still move nodes that were parsed
+// earlier. No errors are reported before then, and the input and the parsed
+// document are kept, so memory use is that of Validate(). The result is the
+// same as that of Validate() for the concatenated chunks.
+class ChunkedValidator {
+ public:
+  explicit ChunkedValidator(HtmlFormat_Code html_format = HtmlFormat::AMP,
+                            int max_errors = -1);
+  ~ChunkedValidator();
+
+  ChunkedValidator(const ChunkedValidator&) = delete;
+  ChunkedValidator& operator=(const ChunkedValidator&) = delete;
+
+  // Appends |chunk| to the document.
+  void Feed(std::string_view chunk);
+
+  // Completes the document and returns the validation result. Must be called
+  // exactly once, after the last chunk has been fed.
+  ValidationResult Finish();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+// Statistics of an IncrementalValidator.
+struct IncrementalValidatorStats {
+  // Documents and edits which were parsed and validated in full.
+  int64_t full_validations = 0;
+  // Edits whose result was derived from that of the previous document.
+  int64_t incremental_edits = 0;
+};
+
+// Validates a document which is edited in place, e.g. in an editor which
+// revalidates on every keystroke. The result of each edit is the same as that
+// of Validate() for the edited document.
+//
+// Edits within a run of text in the body, such as typing or deleting words in
+// a paragraph, don't change the structure of the document, nor anything the
+// validation of its tags depends on, so the result is derived from the
+// previous one in time proportional to the edit and its line. Any other edit,
+// e.g. of markup, entities or line breaks, is validated in full.
+//
+// Not thread-safe.
+class IncrementalValidator {
+ public:
+  explicit IncrementalValidator(HtmlFormat_Code html_format = HtmlFormat::AMP,
+                                int max_errors = -1);
+  ~IncrementalValidator();
+
+  IncrementalValidator(const IncrementalValidator&) = delete;
+  IncrementalValidator& operator=(const IncrementalValidator&) = delete;
+
+  // Makes |html| the current document and validates it in full.
+  ValidationResult Validate(std::string_view html);
+
+  // Replaces the |length| bytes at |offset| of the current document with
+  // |replacement|, and returns the result for the edited document. The range
+  // must be within the current document.
+  ValidationResult Edit(size_t offset, size_t length,
+                        std::string_view replacement);
+
+  // The current document.
+  const std::string& html() const;
+
+  IncrementalValidatorStats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+// Validates a sequence of documents of a single html format. A session keeps
+// its validation state (context, tag stack, error buffers) allocated between
+// documents instead of rebuilding it for every call. The Validate() functions
+// above already use one such state per thread and format; a session gives
+// callers explicit ownership of it.
+//
+// A session is not thread-safe. Use one session per thread.
+class ValidatorSession {
+ public:
+  explicit ValidatorSession(HtmlFormat_Code html_format = HtmlFormat::AMP,
+                            int max_errors = -1);
+  ~ValidatorSession();
+
+  ValidatorSession(const ValidatorSession&) = delete;
+  ValidatorSession& operator=(const ValidatorSession&) = delete;
+
+  ValidationResult Validate(std::string_view html);
+  ValidationResult Validate(const htmlparser::Document& document);
+
+  HtmlFormat_Code html_format() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+// Builds the rules for |html_formats|, which otherwise happens on the first
+// validation of each format and takes tens of milliseconds. The formats are
+// built in parallel on up to |num_threads| threads. If |num_threads| is not
+// positive, up to one thread per hardware thread is used.
+void Warmup(absl::Span<const HtmlFormat_Code> html_formats =
+                {HtmlFormat::AMP, HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL},
+            int num_threads = 0);
+
+// Like Warmup(), but builds the rules on a background thread, e.g. to
+// preload them while the process starts up. A validation which needs rules
+// that are still being built waits for them. Destroying a BackgroundWarmup
+// waits for the rules, so keep it until they are needed, and don't let it
+// outlive main().
+//
+// Usage:
+//   amp::validator::BackgroundWarmup warmup;
+//   ... other setup ...
+//   warmup.Wait();
+class BackgroundWarmup {
+ public:
+  explicit BackgroundWarmup(
+      absl::Span<const HtmlFormat_Code> html_formats = {
+          HtmlFormat::AMP, HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL});
+  ~BackgroundWarmup();
+
+  BackgroundWarmup(const BackgroundWarmup&) = delete;
+  BackgroundWarmup& operator=(const BackgroundWarmup&) = delete;
+
+  // Returns once the rules are built.
+  void Wait();
+
+ private:
+  std::thread thread_;
+};
+
+// The state of the rules for an html format.
+struct RulesStats {
+  HtmlFormat_Code html_format = HtmlFormat::UNKNOWN_CODE;
+  // Whether the rules have been built.
+  bool built = false;
+  // The wall time that building the rules took.
+  std::chrono::nanoseconds build_time{0};
+};
+
+// Returns the state of the rules for AMP, AMP4ADS and AMP4EMAIL, in that
+// order.
+std::vector<RulesStats> GetRulesStats();
+
+// How a TagSpec of the rules fared in the validations so far.
+struct TagSpecProfile {
+  // The index of the TagSpec in the rules, and its name as in errors.
+  int32_t id = 0;
+  std::string name;
+  // The tags checked against the spec, and those it was the passing match
+  // for.
+  int64_t attempts = 0;
+  int64_t wins = 0;
+  // The wall time of the checks, of which |attribute_time| checking the
+  // attributes of the tags.
+  std::chrono::nanoseconds time{0};
+  std::chrono::nanoseconds attribute_time{0};
+};
+
+// How the regexes of an AttrSpec of the rules fared in the validations so
+// far: its value_regex, disallowed_value_regex and trigger if_value_regex.
+struct AttrSpecProfile {
+  // The id of the AttrSpec, the name of its attribute, and the TagSpec or
+  // AttrList it is declared in.
+  int32_t id = 0;
+  std::string name;
+  std::string declared_in;
+  int64_t regex_evaluations = 0;
+  std::chrono::nanoseconds regex_time{0};
+  // The values which weren't evaluated because they had passed before, see
+  // --attr_value_cache_size.
+  int64_t cache_hits = 0;
+};
+
+// The TagSpecs and AttrSpecs of the rules for an html format which were
+// used, by id. Empty unless kValidationStatsEnabled.
+struct RulesProfile {
+  HtmlFormat_Code html_format = HtmlFormat::UNKNOWN_CODE;
+  std::vector<TagSpecProfile> tag_specs;
+  std::vector<AttrSpecProfile> attr_specs;
+};
+
+// Returns the profiles of the rules for AMP, AMP4ADS and AMP4EMAIL, in that
+// order, accumulated over the validations on all threads since the rules
+// were built. Use these to see which rules validation spends its time on.
+std::vector<RulesProfile> GetRulesProfiles();
+
+// Counters of the regular expressions in the rules, which are compiled once
+// per distinct pattern and shared by the rules for all formats.
+struct RegexStats {
+  // The number of distinct patterns compiled.
+  int64_t patterns = 0;
+  // The number of regexes the rules asked for, of which all but |patterns|
+  // reused a compiled pattern.
+  int64_t lookups = 0;
+  // The total time spent compiling patterns.
+  std::chrono::nanoseconds compile_time{0};
+};
+
+RegexStats GetRegexStats();
+
+// Statistics of the cache of attribute values which passed validation, which
+// is enabled by --attr_value_cache_size.
+struct AttrValueCacheStats {
+  // Lookups of values which had passed before, so weren't validated again.
+  int64_t hits = 0;
+  // Lookups of values which had to be validated.
+  int64_t misses = 0;
+  // The number of values currently remembered.
+  int64_t entries = 0;
+};
+
+AttrValueCacheStats GetAttrValueCacheStats();
+
+// A hash of the rules compiled into the validator. Unlike absl::Hash, it is
+// stable across processes, so it may identify the rules in files, e.g.
+// shared result caches.
+uint64_t EmbeddedRulesFingerprint();
+
+// Identifies the build of the validator library, for files which are only
+// valid for the build that wrote them, e.g. shared result caches. It is
+// AMP_VALIDATOR_BUILD_STAMP if the build defines it, e.g. to the source
+// revision, and otherwise the time validator-internal.cc was compiled.
+std::string_view ValidatorBuildStamp();
+
 int RulesSpecVersion();
 int ValidatorVersion();
 htmlparser::css::CssParsingConfig GenCssParsingConfig();
@@ -0,0 +1,322 @@
+// Benchmarks for the AMP validator.
+//
+// Usage:
+//   bazel run -c opt --cxxopt='-std=c++17' validator_benchmark
+//
+// Benchmarks over the testdata corpus expect to be run from the directory
+// containing testdata/, which is the case for bazel run. The cold start
+// benchmarks fork, and must run first.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/util/json_util.h"
+#include "benchmark/benchmark.h"
+#include "cpp/engine/result-writer.h"
+#include "cpp/engine/testing-utils.h"
+#include "cpp/engine/validator.h"
+#include "cpp/htmlparser/node.h"
+#include "cpp/htmlparser/parser.h"
+#include "validator.pb.h"
+
+ABSL_DECLARE_FLAG(int, max_node_recursion_depth);
+
+namespace amp::validator {
+namespace {
+
+// The minimum valid AMP document (testdata/feature_tests/minimum_valid_amp),
+// representative of the many small documents for which the fixed, per
+// document cost of the validator dominates.
+constexpr std::string_view kMinimumValidAmp =
+    "<!doctype html>\n"
+    "<html ⚡>\n"
+    "<head>\n"
+    "  <meta charset=\"utf-8\">\n"
+    "  <link rel=\"canonical\" href=\"./regular-html-version.html\">\n"
+    "  <meta name=\"viewport\" content=\"width=device-width\">\n"
+    "  <style amp-boilerplate>body{-webkit-animation:-amp-start 8s "
+    "steps(1,end) 0s 1 normal both;-moz-animation:-amp-start 8s steps(1,end) "
+    "0s 1 normal both;-ms-animation:-amp-start 8s steps(1,end) 0s 1 normal "
+    "both;animation:-amp-start 8s steps(1,end) 0s 1 normal "
+    "both}@-webkit-keyframes -amp-start{from{visibility:hidden}to{visibility:"
+    "visible}}@-moz-keyframes -amp-start{from{visibility:hidden}to{visibility:"
+    "visible}}@-ms-keyframes -amp-start{from{visibility:hidden}to{visibility:"
+    "visible}}@-o-keyframes -amp-start{from{visibility:hidden}to{visibility:"
+    "visible}}@keyframes -amp-start{from{visibility:hidden}to{visibility:"
+    "visible}}</style><noscript><style amp-boilerplate>body{-webkit-animation:"
+    "none;-moz-animation:none;-ms-animation:none;animation:none}</style>"
+    "</noscript>\n"
+    "  <script async src=\"https://cdn.ampproject.org/v0.js\"></script>\n"
+    "</head>\n"
+    "<body>\n"
+    "Hello, world.\n"
+    "</body>\n"
+    "</html>\n";
+
+// Runs |validate| in a child process, which is forked before the validator
+// rules are built in this process, and so sets them up from scratch like a
+// short-lived worker does. |validate| returns whether it succeeded.
+template <typename F>
+void ColdValidate(benchmark::State& state, F validate) {
+  for (auto _ : state) {
+    pid_t pid = fork();
+    if (pid == 0) _exit(validate() ? 0 : 1);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      state.SkipWithError("validation failed");
+      break;
+    }
+  }
+}
+
+// The first validation in a process, which builds the rules from the
+// embedded rules for all formats. Must run before anything else builds the
+// rules in this process.
+void BM_ColdValidate(benchmark::State& state) {
+  ColdValidate(state, [] {
+    return Validate(kMinimumValidAmp, HtmlFormat::AMP).status() ==
+           ValidationResult::PASS;
+  });
+}
+BENCHMARK(BM_ColdValidate)->UseRealTime();
+
+// Baseline: sets up new validation state for every document, which is what
+// Validate() used to do on every call.
+void BM_ValidateWithNewSession(benchmark::State& state) {
+  for (auto _ : state) {
+    ValidatorSession session(HtmlFormat::AMP);
+    benchmark::DoNotOptimize(session.Validate(kMinimumValidAmp));
+  }
+}
+BENCHMARK(BM_ValidateWithNewSession);
+
+// Reuses the validation state of a single session across documents.
+void BM_ValidateWithReusedSession(benchmark::State& state) {
+  ValidatorSession session(HtmlFormat::AMP);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(session.Validate(kMinimumValidAmp));
+  }
+}
+BENCHMARK(BM_ValidateWithReusedSession);
+
+// The free function, backed by a per-thread validator.
+void BM_Validate(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Validate(kMinimumValidAmp, HtmlFormat::AMP));
+  }
+}
+BENCHMARK(BM_Validate);
+
+// Parses kMinimumValidAmp, whose boilerplate <noscript> is the one every AMP
+// document has, with its contents as markup: with
+// ParseOptions::parse_noscript_as_markup (1), or, as the validator used to,
+// by parsing the text of the <noscript> as a fragment of its own afterwards
+// (0). Both parse the contents with a nested parser, the option saves the
+// fragment's dummy context node, node allocator and document.
+void BM_ParseNoscriptAsMarkup(benchmark::State& state) {
+  htmlparser::ParseOptions options = {
+      .scripting = true,
+      .frameset_ok = true,
+      .record_node_offsets = true,
+      .record_attribute_offsets = true,
+      .count_num_terms_in_text_node = true,
+      .parse_noscript_as_markup = state.range(0) == 1};
+  for (auto _ : state) {
+    auto doc = htmlparser::ParseWithOptions(kMinimumValidAmp, options);
+    if (!options.parse_noscript_as_markup) {
+      htmlparser::Node* html = doc->RootNode()->LastChild();
+      htmlparser::Node* head = html->FirstChild();
+      for (htmlparser::Node* c = head->FirstChild(); c; c = c->NextSibling()) {
+        if (c->DataAtom() != htmlparser::Atom::NOSCRIPT) continue;
+        auto context = std::make_unique<htmlparser::Node>(
+            htmlparser::NodeType::ELEMENT_NODE, htmlparser::Atom::BODY);
+        benchmark::DoNotOptimize(htmlparser::ParseFragmentWithOptions(
+            c->FirstChild()->Data(), options, context.get()));
+      }
+    }
+    benchmark::DoNotOptimize(doc);
+  }
+}
+BENCHMARK(BM_ParseNoscriptAsMarkup)->Arg(0)->Arg(1);
+
+// A head with many tags that are validated via dispatch keys.
+void BM_ValidateDispatchHeavyHead(benchmark::State& state) {
+  std::string head;
+  for (int i = 0; i < 100; ++i) {
+    absl::StrAppend(
+        &head, "<meta name=\"description\" content=\"Hello\">\n",
+        "<meta property=\"og:title\" content=\"Hello\">\n",
+        "<link rel=\"preconnect\" href=\"https://example.com\">\n",
+        "<link rel=\"preload\" href=\"/font.woff2\" as=\"font\">\n",
+        "<script type=\"application/ld+json\">{}</script>\n");
+  }
+  std::string document(kMinimumValidAmp);
+  document.insert(document.find("</head>"), head);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Validate(document, HtmlFormat::AMP));
+  }
+}
+BENCHMARK(BM_ValidateDispatchHeavyHead);
+
+// A body of state.range(0) nested elements, with the depth limit lifted.
+void BM_ValidateDeepDocument(benchmark::State& state) {
+  int max_node_recursion_depth = absl::GetFlag(FLAGS_max_node_recursion_depth);
+  absl::SetFlag(&FLAGS_max_node_recursion_depth, state.range(0) + 100);
+  std::string body;
+  for (int i = 0; i < state.range(0); ++i) body.append("<div>");
+  for (int i = 0; i < state.range(0); ++i) body.append("</div>");
+  std::string document(kMinimumValidAmp);
+  document.replace(document.find("Hello, world."), 13, body);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Validate(document, HtmlFormat::AMP));
+  }
+  absl::SetFlag(&FLAGS_max_node_recursion_depth, max_node_recursion_depth);
+}
+BENCHMARK(BM_ValidateDeepDocument)->Arg(1000)->Arg(10000);
+
+// testdata/feature_tests/css_length.html with an author stylesheet at the
+// 75000 byte limit, which the CDATA denylists are matched against in full.
+void BM_ValidateLargeStylesheet(benchmark::State& state) {
+  std::string document =
+      testing::TestCases().at("feature_tests/css_length.html").input_content;
+  std::string stylesheet;
+  for (int i = 0; i < 7500; ++i) stylesheet.append("h1{top:0}\n");
+  document.replace(document.find(".replace_amp_custom {}"), 22, stylesheet);
+  document.replace(document.find("replace_inline_style"), 20, "");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Validate(document, HtmlFormat::AMP));
+  }
+  state.SetBytesProcessed(state.iterations() * stylesheet.size());
+}
+BENCHMARK(BM_ValidateLargeStylesheet);
+
+// Validates all documents in testdata, in full or for the verdict only.
+void BM_ValidateTestdata(benchmark::State& state) {
+  const auto& test_cases = testing::TestCases();
+  for (auto _ : state) {
+    for (const auto& [name, test_case] : test_cases) {
+      benchmark::DoNotOptimize(
+          Validate(test_case.input_content, test_case.html_format));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * test_cases.size());
+}
+BENCHMARK(BM_ValidateTestdata);
+
+void BM_ValidateVerdictTestdata(benchmark::State& state) {
+  const auto& test_cases = testing::TestCases();
+  for (auto _ : state) {
+    for (const auto& [name, test_case] : test_cases) {
+      benchmark::DoNotOptimize(
+          ValidateVerdict(test_case.input_content, test_case.html_format));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * test_cases.size());
+}
+BENCHMARK(BM_ValidateVerdictTestdata);
+
+constexpr HtmlFormat::Code kAllFormats[] = {
+    HtmlFormat::AMP, HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL};
+
+// Validates all documents in testdata for each format, one format at a time
+// (arg 0) or in a single traversal (arg 1).
+void BM_ValidateTestdataAllFormats(benchmark::State& state) {
+  const auto& test_cases = testing::TestCases();
+  for (auto _ : state) {
+    for (const auto& [name, test_case] : test_cases) {
+      if (state.range(0)) {
+        benchmark::DoNotOptimize(
+            ValidateMulti(test_case.input_content, kAllFormats));
+      } else {
+        for (HtmlFormat::Code format : kAllFormats)
+          benchmark::DoNotOptimize(Validate(test_case.input_content, format));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * test_cases.size());
+}
+BENCHMARK(BM_ValidateTestdataAllFormats)->Arg(0)->Arg(1);
+
+// The result of a document with 5000 disallowed tags, written out by the
+// result writers, with or without messages, and by protobuf for reference.
+ValidationResult ResultWithManyErrors() {
+  std::string body;
+  for (int i = 0; i < 5000; ++i) body.append("<foo>\n");
+  std::string document(kMinimumValidAmp);
+  document.replace(document.find("Hello, world."), 13, body);
+  return Validate(document, HtmlFormat::AMP);
+}
+
+void BM_WriteCompactResult(benchmark::State& state) {
+  ValidationResult result = ResultWithManyErrors();
+  ResultWriterOptions options;
+  options.include_messages = state.range(0);
+  std::string compact;
+  for (auto _ : state) {
+    compact.clear();
+    WriteCompactResult(result, &compact, options);
+    benchmark::DoNotOptimize(compact);
+  }
+  state.SetItemsProcessed(state.iterations() * result.errors_size());
+}
+BENCHMARK(BM_WriteCompactResult)->Arg(0)->Arg(1);
+
+void BM_WriteJsonResult(benchmark::State& state) {
+  ValidationResult result = ResultWithManyErrors();
+  ResultWriterOptions options;
+  options.include_messages = state.range(0);
+  std::string json;
+  for (auto _ : state) {
+    json.clear();
+    StringOutputSink sink(&json);
+    WriteJsonResult(result, &sink, options);
+    benchmark::DoNotOptimize(json);
+  }
+  state.SetItemsProcessed(state.iterations() * result.errors_size());
+}
+BENCHMARK(BM_WriteJsonResult)->Arg(0)->Arg(1);
+
+void BM_ProtobufJsonResult(benchmark::State& state) {
+  ValidationResult result = ResultWithManyErrors();
+  for (auto _ : state) {
+    std::string json;
+    benchmark::DoNotOptimize(
+        google::protobuf::util::MessageToJsonString(result, &json));
+    benchmark::DoNotOptimize(json);
+  }
+  state.SetItemsProcessed(state.iterations() * result.errors_size());
+}
+BENCHMARK(BM_ProtobufJsonResult);
+
+// A batch of documents of widely varying sizes, validated on
+// state.range(0) threads.
+void BM_ValidateBatch(benchmark::State& state) {
+  std::vector<std::string> documents;
+  for (int i = 0; i < 64; ++i) {
+    std::string body;
+    for (int j = 0; j < (i % 8) * (i % 8) * 50; ++j)
+      body.append("<p>Hello, <b>world</b>.</p>\n");
+    std::string document(kMinimumValidAmp);
+    document.replace(document.find("Hello, world."), 13, body);
+    documents.push_back(std::move(document));
+  }
+  std::vector<std::string_view> htmls(documents.begin(), documents.end());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ValidateBatch(htmls, HtmlFormat::AMP,
+                                           /*max_errors=*/-1,
+                                           /*num_threads=*/state.range(0)));
+  }
+}
+BENCHMARK(BM_ValidateBatch)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+}  // namespace
+}  // namespace amp::validator
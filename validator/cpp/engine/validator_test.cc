@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <thread>
 
 #include "cpp/engine/validator_pb.h"
 #include "gtest/gtest.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/escaping.h"
@@ -18,9 +23,14 @@
 #include "cpp/engine/validator.h"
 #include "cpp/htmlparser/css/parse-css.pb.h"
 #include "cpp/htmlparser/logging.h"
+#include "cpp/htmlparser/parser.h"
 #include "validator.pb.h"
 #include "re2/re2.h"
 
+ABSL_DECLARE_FLAG(int, max_node_recursion_depth);
+ABSL_DECLARE_FLAG(int, attr_value_cache_size);
+ABSL_DECLARE_FLAG(int, css_validation_threads);
+
 using absl::StartsWith;
 using absl::StrAppend;
 using absl::StrCat;
@@ -28,6 +38,8 @@ using absl::StrReplaceAll;
 using amp::validator::AtRuleSpec;
 using amp::validator::AttrList;
 using amp::validator::AttrSpec;
+using amp::validator::AttrSpecProfile;
+using amp::validator::BoundedValidationResult;
 using amp::validator::CdataSpec;
 using amp::validator::ErrorFormat;
 using amp::validator::ErrorSpecificity;
@@ -35,9 +47,13 @@ using amp::validator::HtmlFormat;
 using amp::validator::PropertySpec;
 using amp::validator::PropertySpecList;
 using amp::validator::ReferencePoint;
+using amp::validator::RulesProfile;
 using amp::validator::TagSpec;
+using amp::validator::TagSpecProfile;
 using amp::validator::ValidationError;
+using amp::validator::ValidationPhase;
 using amp::validator::ValidationResult;
+using amp::validator::ValidationStats;
 using amp::validator::ValidatorRules;
 using amp::validator::testing::RenderInlineResult;
 using amp::validator::testing::RenderResult;
@@ -164,12 +180,508 @@ TEST(ValidatorTest, TestValidationResultTransformerVersion) {
   EXPECT_EQ(result.transformer_version(), 1);
 }
 
+TEST(ValidatorTest, ValidatorSessionIsReusable) {
+  // A session validating a sequence of documents must produce the same
+  // results as validating each document on its own, i.e. no state may leak
+  // from one document into the next.
+  ValidatorSession amp_session(HtmlFormat::AMP);
+  ValidatorSession email_session(HtmlFormat::AMP4EMAIL);
+  EXPECT_EQ(HtmlFormat::AMP, amp_session.html_format());
+  EXPECT_EQ(HtmlFormat::AMP4EMAIL, email_session.html_format());
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const auto& entry : TestCases()) {
+      const TestCase& test_case = entry.second;
+      if (test_case.html_format != HtmlFormat::AMP &&
+          test_case.html_format != HtmlFormat::AMP4EMAIL)
+        continue;
+      ValidatorSession& session = test_case.html_format == HtmlFormat::AMP
+                                      ? amp_session
+                                      : email_session;
+      ValidationResult result = session.Validate(test_case.input_content);
+      std::string output = RenderInlineResult(
+          /*filename=*/test_case.name, test_case.input_content, result);
+      MaybeGenerateFailuresFor(output, test_case.output_content,
+                               test_case.output_file);
+    }
+  }
+}
+
+TEST(ValidatorTest, ValidateBatchMatchesValidate) {
+  std::vector<std::string_view> htmls;
+  std::vector<std::string> expected_outputs;
+  for (const auto& entry : TestCases()) {
+    const TestCase& test_case = entry.second;
+    if (test_case.html_format != HtmlFormat::AMP) continue;
+    htmls.push_back(test_case.input_content);
+    expected_outputs.push_back(
+        RenderResult(test_case.name, amp::validator::Validate(
+                                         test_case.input_content,
+                                         test_case.html_format)));
+  }
+  for (int num_threads : {1, 3, 8}) {
+    SCOPED_TRACE(StrCat("num_threads=", num_threads));
+    std::vector<ValidationResult> results =
+        ValidateBatch(htmls, HtmlFormat::AMP, /*max_errors=*/-1, num_threads);
+    ASSERT_EQ(htmls.size(), results.size());
+    int i = 0;
+    for (const auto& entry : TestCases()) {
+      const TestCase& test_case = entry.second;
+      if (test_case.html_format != HtmlFormat::AMP) continue;
+      EXPECT_EQ(expected_outputs[i], RenderResult(test_case.name, results[i]));
+      ++i;
+    }
+  }
+  EXPECT_TRUE(ValidateBatch({}, HtmlFormat::AMP).empty());
+}
+
+TEST(ValidatorTest, ChunkedValidatorMatchesValidate) {
+  for (const auto& entry : TestCases()) {
+    const TestCase& test_case = entry.second;
+    for (int chunk_size : {1, 13, 1024}) {
+      ChunkedValidator validator(test_case.html_format);
+      std::string_view html = test_case.input_content;
+      for (size_t i = 0; i < html.size(); i += chunk_size)
+        validator.Feed(html.substr(i, chunk_size));
+      ValidationResult result = validator.Finish();
+      std::string output = RenderInlineResult(
+          /*filename=*/test_case.name, test_case.input_content, result);
+      SCOPED_TRACE(StrCat("chunk_size=", chunk_size));
+      MaybeGenerateFailuresFor(output, test_case.output_content,
+                               test_case.output_file);
+    }
+  }
+}
+
+TEST(ValidatorTest, ValidateVerdictMatchesValidateStatus) {
+  for (const auto& entry : TestCases()) {
+    const TestCase& test_case = entry.second;
+    EXPECT_EQ(amp::validator::Validate(test_case.input_content,
+                                       test_case.html_format)
+                  .status(),
+              ValidateVerdict(test_case.input_content, test_case.html_format))
+        << test_case.name;
+  }
+  // The verdict-only mode must not leak into later calls of Validate().
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/several_errors.html");
+  EXPECT_EQ(ValidationResult::FAIL,
+            ValidateVerdict(test_case.input_content, test_case.html_format));
+  EXPECT_GT(amp::validator::Validate(test_case.input_content,
+                                     test_case.html_format)
+                .errors_size(),
+            0);
+}
+
+TEST(ValidatorTest, ValidatorSessionRespectsMaxErrors) {
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/several_errors.html");
+  ValidatorSession session(test_case.html_format, /*max_errors=*/1);
+  for (int i = 0; i < 3; ++i) {
+    ValidationResult result = session.Validate(test_case.input_content);
+    EXPECT_EQ(ValidationResult::FAIL, result.status());
+    EXPECT_EQ(1, result.errors_size());
+  }
+}
+
+TEST(ValidatorTest, WarmupBuildsRules) {
+  Warmup({HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL}, /*num_threads=*/2);
+  std::vector<RulesStats> stats = GetRulesStats();
+  ASSERT_EQ(3, stats.size());
+  EXPECT_EQ(HtmlFormat::AMP, stats[0].html_format);
+  EXPECT_EQ(HtmlFormat::AMP4ADS, stats[1].html_format);
+  EXPECT_EQ(HtmlFormat::AMP4EMAIL, stats[2].html_format);
+  for (int i = 1; i < 3; ++i) {
+    EXPECT_TRUE(stats[i].built);
+    EXPECT_GT(stats[i].build_time.count(), 0);
+  }
+  // Warming up again is a no-op.
+  Warmup();
+  EXPECT_EQ(stats[1].build_time, GetRulesStats()[1].build_time);
+}
+
+TEST(ValidatorTest, BackgroundWarmupBuildsRules) {
+  BackgroundWarmup warmup({HtmlFormat::AMP4EMAIL});
+  warmup.Wait();
+  EXPECT_TRUE(GetRulesStats()[2].built);
+  // Waiting again, or on destruction, is a no-op.
+  warmup.Wait();
+}
+
+TEST(ValidatorTest, RegexesAreCompiledOncePerPattern) {
+  Warmup();
+  RegexStats stats = GetRegexStats();
+  EXPECT_GT(stats.patterns, 0);
+  // Many patterns recur across tagspecs and formats.
+  EXPECT_LT(stats.patterns, stats.lookups);
+  EXPECT_GT(stats.compile_time.count(), 0);
+
+  // Validating CSS doesn't compile regexes.
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/css_declarations.html");
+  amp::validator::Validate(test_case.input_content, test_case.html_format);
+  EXPECT_EQ(stats.lookups, GetRegexStats().lookups);
+}
+
+TEST(ValidatorTest, AttrValueCacheDoesNotChangeResults) {
+  std::map<std::string, std::string> expected;
+  for (const auto& [name, test_case] : TestCases()) {
+    expected[name] =
+        amp::validator::Validate(test_case.input_content, test_case.html_format)
+            .DebugString();
+  }
+  int attr_value_cache_size = absl::GetFlag(FLAGS_attr_value_cache_size);
+  absl::SetFlag(&FLAGS_attr_value_cache_size, 10000);
+  // The first round fills the cache, the second is served from it.
+  for (int round = 0; round < 2; ++round) {
+    for (const auto& [name, test_case] : TestCases()) {
+      EXPECT_EQ(expected[name],
+                amp::validator::Validate(test_case.input_content,
+                                         test_case.html_format)
+                    .DebugString())
+          << "test case " << name << ", round " << round;
+    }
+  }
+  absl::SetFlag(&FLAGS_attr_value_cache_size, attr_value_cache_size);
+  AttrValueCacheStats stats = GetAttrValueCacheStats();
+  EXPECT_GT(stats.hits, 0);
+  EXPECT_GT(stats.misses, 0);
+  EXPECT_GT(stats.entries, 0);
+  EXPECT_LE(stats.entries, 10000);
+}
+
+TEST(ValidatorTest, CssValidationThreadsDoNotChangeResults) {
+  std::map<std::string, std::string> expected;
+  for (const auto& [name, test_case] : TestCases()) {
+    expected[name] =
+        amp::validator::Validate(test_case.input_content, test_case.html_format)
+            .DebugString();
+  }
+  int css_validation_threads = absl::GetFlag(FLAGS_css_validation_threads);
+  absl::SetFlag(&FLAGS_css_validation_threads, 4);
+  for (const auto& [name, test_case] : TestCases()) {
+    EXPECT_EQ(expected[name],
+              amp::validator::Validate(test_case.input_content,
+                                       test_case.html_format)
+                  .DebugString())
+        << "test case " << name;
+  }
+  absl::SetFlag(&FLAGS_css_validation_threads, css_validation_threads);
+}
+
+TEST(ValidatorTest, ValidatesOneDocumentForSeveralFormatsConcurrently) {
+  const std::vector<HtmlFormat::Code> formats = {
+      HtmlFormat::AMP, HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL};
+  for (const auto& [name, test_case] : TestCases()) {
+    std::vector<std::string> expected;
+    for (HtmlFormat::Code format : formats) {
+      expected.push_back(
+          amp::validator::Validate(test_case.input_content, format)
+              .DebugString());
+    }
+    auto doc = htmlparser::Parser(test_case.input_content,
+                                  amp::validator::ValidatorParseOptions())
+                   .Parse();
+    ASSERT_NE(doc, nullptr) << "test case " << name;
+    // Each format is validated twice, so that any change made to the
+    // document by a validation shows in the next one.
+    std::vector<std::string> results(2 * formats.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+      threads.emplace_back([&, i] {
+        results[i] =
+            amp::validator::Validate(*doc, formats[i % formats.size()])
+                .DebugString();
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+    for (size_t i = 0; i < results.size(); ++i) {
+      EXPECT_EQ(expected[i % formats.size()], results[i])
+          << "test case " << name << ", format "
+          << HtmlFormat::Code_Name(formats[i % formats.size()]);
+    }
+  }
+}
+
+TEST(ValidatorTest, ValidateMultiMatchesValidateForEachFormat) {
+  // AMP is listed twice, to share its result.
+  const std::vector<HtmlFormat::Code> formats = {
+      HtmlFormat::AMP, HtmlFormat::AMP4ADS, HtmlFormat::AMP4EMAIL,
+      HtmlFormat::AMP};
+  for (int max_errors : {-1, 1}) {
+    for (const auto& [name, test_case] : TestCases()) {
+      std::vector<ValidationResult> results = amp::validator::ValidateMulti(
+          test_case.input_content, formats, max_errors);
+      ASSERT_EQ(formats.size(), results.size());
+      for (size_t i = 0; i < formats.size(); ++i) {
+        EXPECT_EQ(amp::validator::Validate(test_case.input_content,
+                                           formats[i], max_errors)
+                      .DebugString(),
+                  results[i].DebugString())
+            << "test case " << name << ", format "
+            << HtmlFormat::Code_Name(formats[i]) << ", max_errors "
+            << max_errors;
+      }
+    }
+  }
+  EXPECT_TRUE(amp::validator::ValidateMulti("<html>", {}).empty());
+}
+
+int fake_clock_reads = 0;
+
+// Advances by a millisecond each time it is read, see htmlparser::Deadline.
+std::chrono::steady_clock::time_point FakeClock() {
+  return std::chrono::steady_clock::time_point(
+      std::chrono::milliseconds(++fake_clock_reads));
+}
+
+TEST(ValidatorTest, ValidateWithDeadline) {
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/minimum_valid_amp.html");
+  // Far away deadlines don't change results.
+  for (const auto& [name, test_case] : TestCases()) {
+    htmlparser::Deadline deadline(std::chrono::steady_clock::now() +
+                                  std::chrono::hours(1));
+    BoundedValidationResult bounded = amp::validator::Validate(
+        test_case.input_content, test_case.html_format, -1, &deadline);
+    EXPECT_TRUE(bounded.status.ok()) << "test case " << name;
+    EXPECT_FALSE(bounded.expired_phase.has_value()) << "test case " << name;
+    EXPECT_EQ(amp::validator::Validate(test_case.input_content,
+                                       test_case.html_format)
+                  .DebugString(),
+              bounded.result.DebugString())
+        << "test case " << name;
+  }
+
+  // An expired deadline stops the parse.
+  htmlparser::Deadline past(std::chrono::steady_clock::now());
+  BoundedValidationResult bounded = amp::validator::Validate(
+      test_case.input_content, test_case.html_format, -1, &past);
+  EXPECT_TRUE(absl::IsDeadlineExceeded(bounded.status));
+  EXPECT_EQ(ValidationPhase::kParse, bounded.expired_phase);
+  EXPECT_EQ(ValidationResult::UNKNOWN, bounded.result.status());
+  EXPECT_EQ(0, bounded.result.errors_size());
+
+  // Or the traversal of a document parsed already.
+  std::string html = "<!doctype html><html ⚡><body><foo></foo>";
+  for (int i = 0; i < 1000; ++i) html += "<p>text</p>";
+  auto doc =
+      htmlparser::Parser(html, amp::validator::ValidatorParseOptions())
+          .Parse();
+  htmlparser::CancellationToken token;
+  htmlparser::Deadline deadline(&token);
+  token.Cancel();
+  bounded = amp::validator::Validate(*doc, HtmlFormat::AMP, -1, &deadline);
+  EXPECT_TRUE(absl::IsCancelled(bounded.status));
+  EXPECT_EQ(ValidationPhase::kTraversal, bounded.expired_phase);
+  EXPECT_EQ(ValidationResult::UNKNOWN, bounded.result.status());
+
+  // Expiring mid-traversal keeps the errors found until then: the <foo> tag
+  // comes first, and the deadline expires long before the rest of the
+  // document is traversed. The clock is a fake one, so that this doesn't
+  // depend on the speed of the machine.
+  for (int i = 0; i < 20000; ++i) html += "<p>text</p>";
+  doc = htmlparser::Parser(html, amp::validator::ValidatorParseOptions())
+            .Parse();
+  fake_clock_reads = 0;
+  htmlparser::Deadline soon(
+      std::chrono::steady_clock::time_point(std::chrono::milliseconds(10)),
+      /*token=*/nullptr, &FakeClock);
+  bounded = amp::validator::Validate(*doc, HtmlFormat::AMP, -1, &soon);
+  EXPECT_TRUE(absl::IsDeadlineExceeded(bounded.status));
+  EXPECT_EQ(ValidationPhase::kTraversal, bounded.expired_phase);
+  EXPECT_EQ(ValidationResult::UNKNOWN, bounded.result.status());
+  EXPECT_TRUE(std::any_of(bounded.result.errors().begin(),
+                          bounded.result.errors().end(),
+                          [](const ValidationError& error) {
+                            return error.code() ==
+                                       ValidationError::DISALLOWED_TAG &&
+                                   error.params(0) == "foo";
+                          }))
+      << bounded.result.DebugString();
+  // The errors of the document's end, such as missing mandatory tags, are
+  // not reported.
+  EXPECT_TRUE(std::none_of(bounded.result.errors().begin(),
+                           bounded.result.errors().end(),
+                           [](const ValidationError& error) {
+                             return error.code() ==
+                                    ValidationError::MANDATORY_TAG_MISSING;
+                           }));
+  // Validation stopped once the deadline expired, unlike that of the same
+  // document with a deadline that doesn't, which checks it many more times.
+  EXPECT_EQ(10, fake_clock_reads);
+  fake_clock_reads = 0;
+  htmlparser::Deadline never(std::chrono::steady_clock::time_point::max(),
+                             /*token=*/nullptr, &FakeClock);
+  bounded = amp::validator::Validate(*doc, HtmlFormat::AMP, -1, &never);
+  EXPECT_TRUE(bounded.status.ok());
+  EXPECT_EQ(ValidationResult::FAIL, bounded.result.status());
+  EXPECT_GT(fake_clock_reads, 100);
+
+  // Deadlines don't carry over to later validations.
+  EXPECT_EQ(ValidationResult::PASS,
+            amp::validator::Validate(test_case.input_content,
+                                     test_case.html_format)
+                .status());
+}
+
+TEST(ValidatorTest, ValidateWithStats) {
+  // Collecting statistics doesn't change results.
+  for (const auto& [name, test_case] : TestCases()) {
+    ValidationStats stats;
+    EXPECT_EQ(amp::validator::Validate(test_case.input_content,
+                                       test_case.html_format)
+                  .DebugString(),
+              amp::validator::Validate(test_case.input_content,
+                                       test_case.html_format, -1, &stats)
+                  .DebugString())
+        << "test case " << name;
+  }
+
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/minimum_valid_amp.html");
+  std::string html = StrReplaceAll(
+      test_case.input_content,
+      {{"</head>", "<style amp-custom>p { color: red }</style></head>"}});
+  ValidationStats stats;
+  stats.nodes = 42;
+  EXPECT_EQ(ValidationResult::PASS,
+            amp::validator::Validate(html, test_case.html_format, -1, &stats)
+                .status());
+  if (!amp::validator::kValidationStatsEnabled) {
+    EXPECT_EQ(0, stats.nodes);
+    EXPECT_EQ(0, stats.parse.tokens);
+    return;
+  }
+  EXPECT_GT(stats.parse.tokens, 0);
+  EXPECT_GT(stats.parse.tokenize_time.count(), 0);
+  EXPECT_GT(stats.parse.tree_construction_time.count(), 0);
+  EXPECT_GT(stats.parse.node_bytes_allocated, 0);
+  EXPECT_GT(stats.nodes, 0);
+  EXPECT_GT(stats.attributes, 0);
+  EXPECT_GE(stats.tag_spec_attempts, stats.nodes / 2);
+  EXPECT_GT(stats.tag_spec_matching_time.count(), 0);
+  EXPECT_GT(stats.regex_evaluations, 0);
+  EXPECT_GT(stats.css_tokens, 0);
+  EXPECT_GT(stats.css_parse_time.count(), 0);
+  EXPECT_GT(stats.url_checks, 0);
+}
+
+TEST(ValidatorTest, GetRulesProfiles) {
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/minimum_valid_amp.html");
+  amp::validator::Validate(test_case.input_content, HtmlFormat::AMP);
+  std::vector<RulesProfile> profiles = amp::validator::GetRulesProfiles();
+  ASSERT_EQ(3, profiles.size());
+  const RulesProfile& profile = profiles[0];
+  EXPECT_EQ(HtmlFormat::AMP, profile.html_format);
+  if (!amp::validator::kValidationStatsEnabled) {
+    EXPECT_TRUE(profile.tag_specs.empty());
+    EXPECT_TRUE(profile.attr_specs.empty());
+    return;
+  }
+  auto html = std::find_if(profile.tag_specs.begin(), profile.tag_specs.end(),
+                           [](const TagSpecProfile& tag_spec) {
+                             return tag_spec.name == "html";
+                           });
+  ASSERT_NE(html, profile.tag_specs.end());
+  EXPECT_GT(html->attempts, 0);
+  EXPECT_GT(html->wins, 0);
+  EXPECT_GT(html->time.count(), 0);
+  EXPECT_LE(html->attribute_time, html->time);
+  EXPECT_FALSE(profile.attr_specs.empty());
+  for (const AttrSpecProfile& attr_spec : profile.attr_specs) {
+    EXPECT_FALSE(attr_spec.name.empty());
+    EXPECT_GT(attr_spec.regex_evaluations + attr_spec.cache_hits, 0);
+  }
+
+  // Values served by the attribute value cache are counted as cache hits.
+  int attr_value_cache_size = absl::GetFlag(FLAGS_attr_value_cache_size);
+  absl::SetFlag(&FLAGS_attr_value_cache_size, 10000);
+  for (int round = 0; round < 2; ++round)
+    amp::validator::Validate(test_case.input_content, HtmlFormat::AMP);
+  absl::SetFlag(&FLAGS_attr_value_cache_size, attr_value_cache_size);
+  profiles = amp::validator::GetRulesProfiles();
+  EXPECT_TRUE(std::any_of(profiles[0].attr_specs.begin(),
+                          profiles[0].attr_specs.end(),
+                          [](const AttrSpecProfile& attr_spec) {
+                            return attr_spec.cache_hits > 0;
+                          }));
+}
+
+TEST(ValidatorTest, IncrementalValidatorMatchesFullValidation) {
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/minimum_valid_amp.html");
+  // Errors follow the text on its line, and on later lines.
+  std::string html = StrReplaceAll(
+      test_case.input_content,
+      {{"Hello, world.",
+        "<p>Some text</p><foo>x</foo><img src=a.jpg>\n<p>More</p><foo></foo>"}});
+  IncrementalValidator validator(test_case.html_format);
+  ValidationResult result = validator.Validate(html);
+  EXPECT_EQ(ValidationResult::FAIL, result.status());
+  ASSERT_GT(result.errors_size(), 1);
+
+  size_t text = html.find("Some text");
+  struct Edit {
+    size_t offset;
+    size_t length;
+    std::string replacement;
+    bool incremental;
+  };
+  std::vector<Edit> edits = {
+      {text + 4, 0, " more", true},   // Some more text
+      {text, 5, "", true},            // more text
+      {text, 0, "The ", true},        // The more text
+      {text + 3, 5, "", true},        // The text
+      {text, 8, " ", false},          // Whitespace only.
+      {text, 1, "Some text", false},  // Some text
+      {text, 4, "Any", true},         // Any text
+      {text + 3, 1, "&amp;", false},  // Any&amp;text
+      {text + 3, 5, "<b>", false},    // Any<b>text
+      {text + 3, 3, " ", false},      // Any text
+      {text + 3, 1, "\n", false},     // Any\ntext
+  };
+  int incremental_edits = 0;
+  for (const Edit& edit : edits) {
+    html.replace(edit.offset, edit.length, edit.replacement);
+    EXPECT_EQ(amp::validator::Validate(html, test_case.html_format)
+                  .DebugString(),
+              validator.Edit(edit.offset, edit.length, edit.replacement)
+                  .DebugString())
+        << html;
+    EXPECT_EQ(html, validator.html());
+    if (edit.incremental) ++incremental_edits;
+    EXPECT_EQ(incremental_edits, validator.stats().incremental_edits) << html;
+  }
+}
+
 std::string RepeatString(const std::string& blob, int n_times) {
   std::string output;
   for (int i = 0; i < n_times; ++i) StrAppend(&output, blob);
   return output;
 }
 
+TEST(ValidatorTest, ValidatesDeeplyNestedDocuments) {
+  TestCase test_case =
+      FindOrDie(TestCases(), "feature_tests/minimum_valid_amp.html");
+  std::string html = StrReplaceAll(
+      test_case.input_content,
+      {{"Hello, world.",
+        StrCat(RepeatString("<div>", 10000), RepeatString("</div>", 10000))}});
+  ValidationResult result =
+      amp::validator::Validate(html, test_case.html_format);
+  EXPECT_EQ(ValidationResult::FAIL, result.status());
+  ASSERT_EQ(1, result.errors_size());
+  EXPECT_EQ(ValidationError::DOCUMENT_TOO_COMPLEX, result.errors(0).code());
+
+  // Past the default limit, the depth is not bounded by the call stack.
+  int max_node_recursion_depth = absl::GetFlag(FLAGS_max_node_recursion_depth);
+  absl::SetFlag(&FLAGS_max_node_recursion_depth, 20000);
+  result = amp::validator::Validate(html, test_case.html_format);
+  absl::SetFlag(&FLAGS_max_node_recursion_depth, max_node_recursion_depth);
+  EXPECT_EQ(ValidationResult::PASS, result.status());
+}
+
 std::string TestWithDocSize(absl::string_view test_content,
                             absl::string_view body) {
   return StrReplaceAll(test_content, {{"replace_body", body}});
@@ -1,9 +1,11 @@
 goog.require('goog.asserts');
 goog.require('goog.crypt.base64');
 goog.require('goog.uri.utils');
+goog.require('proto.amp.validator.HtmlFormat');
 goog.require('proto.amp.validator.ValidationError');
 goog.require('proto.amp.validator.ValidationResult');
 const {
+  HtmlFormat,
   ValidationError,
   ValidationResult,
 } = proto.amp.validator;
@@ -88,6 +90,44 @@ function digitizeValidationErrorFields(error) {
  */
 const PB_BASE64 = '_PB_BASE64';
 
+/**
+ * Attaches the protobuf base64 string of |getBytes()| to |object|. It is
+ * only encoded when read, which most callers never do.
+ *
+ * @param {!Object} object
+ * @param {function(): !Uint8Array} getBytes
+ */
+function definePbBase64(object, getBytes) {
+  let value;
+  Object.defineProperty(object, PB_BASE64, {
+    enumerable: true,
+    get() {
+      if (value === undefined) {
+        value = base64.encodeByteArray(getBytes());
+      }
+      return value;
+    },
+  });
+}
+
+const textEncoder = new TextEncoder();
+
+/**
+ * Writes a string into the input buffer of the WebAssembly module.
+ *
+ * @param {string} input
+ * @return {number} the number of UTF-8 bytes written.
+ */
+function writeInputBuffer(input) {
+  // UTF-16 code units never take more than 3 bytes in UTF-8. Reserving may
+  // grow the memory, so HEAPU8 is only read afterwards.
+  const maxSize = 3 * input.length;
+  const address = wasmModule.reserveInputBuffer(maxSize);
+  const {written} = textEncoder.encodeInto(
+      input, wasmModule.HEAPU8.subarray(address, address + maxSize));
+  return written;
+}
+
 /**
  * Validates a document input as a string.
  *
@@ -101,18 +141,24 @@ function validateString(input, opt_htmlFormat) {
     htmlFormat = opt_htmlFormat.toUpperCase();
   }
   asserts.assertExists(wasmModule, `WebAssembly is uninitialized`);
-  const resultBase64 =
-      wasmModule.validateString(input, htmlFormat, /*maxErrors=*/ -1);
-  const resultJspb = ValidationResult.deserializeBinary(resultBase64);
+  // The html is written to, and the serialized result read from, the memory
+  // of the module, which saves copying them through strings and Base64.
+  const size = writeInputBuffer(input);
+  const resultSize = wasmModule.validateInputBuffer(
+      size, HtmlFormat.Code[htmlFormat] ?? HtmlFormat.Code.AMP,
+      /*maxErrors=*/ -1);
+  const resultAddress = wasmModule.resultBuffer();
+  const resultBytes =
+      wasmModule.HEAPU8.slice(resultAddress, resultAddress + resultSize);
+  const resultJspb = ValidationResult.deserializeBinary(resultBytes);
   const resultObject = resultJspb.toObject();
   resultObject.errors = resultJspb.getErrorsList().map((errorJspb) => {
     const errorObject = stringifyValidationErrorFields(errorJspb.toObject());
-    errorObject[PB_BASE64] =
-        base64.encodeByteArray(errorJspb.serializeBinary());
+    definePbBase64(errorObject, () => errorJspb.serializeBinary());
     return errorObject;
   });
   resultObject.status = STATUS.nameByNumber.get(resultObject.status);
-  resultObject[PB_BASE64] = resultBase64;
+  definePbBase64(resultObject, () => resultBytes);
   return resultObject;
 }
 
@@ -0,0 +1,97 @@
+/**
+ * @fileoverview Measures the per call overhead of the WebAssembly validator,
+ * comparing validateString, which passes the html as a JavaScript string and
+ * returns the result as a Base64 encoded proto, with the shared memory ABI,
+ * where the html is written into, and the serialized result read from, the
+ * memory of the module.
+ *
+ * Usage, after building :validator_emcc_wasm:
+ *   node validator_benchmark.js path/to/validator_emcc_wasm.js [iterations]
+ */
+'use strict';
+
+const path = require('path');
+
+const loadValidatorWasm = require(path.resolve(process.argv[2]));
+const iterations = Number(process.argv[3] || 200);
+
+const SMALL_DOCUMENT = `<!doctype html>
+<html ⚡>
+<head>
+  <meta charset="utf-8">
+  <link rel="canonical" href="self.html" />
+  <meta name="viewport" content="width=device-width">
+  <style amp-boilerplate>body{-webkit-animation:-amp-start 8s steps(1,end) 0s infinite both;-moz-animation:-amp-start 8s steps(1,end) 0s infinite both;-ms-animation:-amp-start 8s steps(1,end) 0s infinite both;animation:-amp-start 8s steps(1,end) 0s infinite both}@-webkit-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}@-moz-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}@-ms-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}@-o-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}@keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}</style><noscript><style amp-boilerplate>body{-webkit-animation:none;-moz-animation:none;-ms-animation:none;animation:none}</style></noscript>
+  <script async src="https://cdn.ampproject.org/v0.js"></script>
+</head>
+<body>
+Hello, world.
+</body>
+</html>
+`;
+
+// About 1MB of text, with a disallowed tag every paragraph so that the
+// result has thousands of errors.
+const LARGE_DOCUMENT = SMALL_DOCUMENT.replace(
+  'Hello, world.',
+  '<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit. <foo></foo></p>\n'.repeat(
+    12000
+  )
+);
+
+const textEncoder = new TextEncoder();
+
+/**
+ * @param {!Object} wasmModule
+ * @param {string} html
+ * @return {number} the size of the Base64 decoded result.
+ */
+function validateBase64(wasmModule, html) {
+  const resultBase64 = wasmModule.validateString(html, 'AMP', -1);
+  return Buffer.from(resultBase64, 'base64').length;
+}
+
+/**
+ * @param {!Object} wasmModule
+ * @param {string} html
+ * @return {number} the size of the serialized result.
+ */
+function validateSharedMemory(wasmModule, html) {
+  const maxSize = 3 * html.length;
+  // Reserving may grow the memory, so HEAPU8 is only read afterwards.
+  const address = wasmModule.reserveInputBuffer(maxSize);
+  const {written} = textEncoder.encodeInto(
+    html,
+    wasmModule.HEAPU8.subarray(address, address + maxSize)
+  );
+  const size = wasmModule.validateInputBuffer(written, /*AMP=*/ 1, -1);
+  const result = wasmModule.resultBuffer();
+  return wasmModule.HEAPU8.slice(result, result + size).length;
+}
+
+/**
+ * @param {string} name
+ * @param {function(): number} fn
+ */
+function bench(name, fn) {
+  // Warm up the module and the JIT.
+  for (let i = 0; i < Math.min(iterations, 10); ++i) fn();
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < iterations; ++i) fn();
+  const elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+  console.log(
+    `${name.padEnd(32)} ${(elapsed / iterations).toFixed(3)} ms/call`
+  );
+}
+
+loadValidatorWasm().then((wasmModule) => {
+  for (const [name, html] of [
+    ['small', SMALL_DOCUMENT],
+    ['large', LARGE_DOCUMENT],
+  ]) {
+    bench(`${name} validateString`, () => validateBase64(wasmModule, html));
+    bench(`${name} validateInputBuffer`, () =>
+      validateSharedMemory(wasmModule, html)
+    );
+  }
+});
@@ -1,5 +1,6 @@
 #include "cpp/engine/wasm/validator_inner_wrapper.h"
 
+#include <algorithm>
 #include <string_view>
 
 #include "absl/strings/escaping.h"
@@ -10,6 +11,34 @@
 
 namespace amp::validator {
 
+namespace {
+
+// The buffers of the shared memory ABI. The module is single threaded.
+std::string* input_buffer = new std::string;
+std::string* result_buffer = new std::string;
+
+}  // namespace
+
+uintptr_t ReserveInputBuffer(size_t size) {
+  if (input_buffer->size() < size) input_buffer->resize(size);
+  return reinterpret_cast<uintptr_t>(input_buffer->data());
+}
+
+uintptr_t ResultBuffer() {
+  return reinterpret_cast<uintptr_t>(result_buffer->data());
+}
+
+size_t ValidateInputBuffer(size_t size, int html_format, int max_errors) {
+  if (!HtmlFormat::Code_IsValid(html_format)) html_format = HtmlFormat::AMP;
+  ValidationResult result =
+      Validate(std::string_view(input_buffer->data(),
+                                std::min(size, input_buffer->size())),
+               static_cast<HtmlFormat::Code>(html_format), max_errors);
+  result_buffer->clear();
+  result.SerializeToString(result_buffer);
+  return result_buffer->size();
+}
+
 std::string ValidateString(std::string html, std::string html_format_name,
                            int max_errors) {
   HtmlFormat::Code html_format_code;
@@ -1,12 +1,33 @@
 #ifndef CPP_ENGINE_WASM_VALIDATOR_INNER_WRAPPER_H_
 #define CPP_ENGINE_WASM_VALIDATOR_INNER_WRAPPER_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 #include "validator.pb.h"
 
 namespace amp::validator {
 
+// The shared memory ABI, which passes documents and results through buffers
+// in linear memory, which are reused across calls: JavaScript writes the
+// UTF-8 html into the input buffer, and reads the serialized ValidationResult
+// out of the result buffer. Unlike ValidateString() below, nothing is Base64
+// encoded and the html isn't copied into a std::string. Addresses are
+// returned as numbers, as JavaScript reads linear memory through HEAPU8.
+
+// Returns the address of the input buffer, after growing it to at least
+// |size| bytes if needed.
+uintptr_t ReserveInputBuffer(size_t size);
+
+// Returns the address of the result buffer.
+uintptr_t ResultBuffer();
+
+// Validates the first |size| bytes of the input buffer as |html_format| (an
+// HtmlFormat::Code), writing the serialized ValidationResult to the result
+// buffer. Returns its size.
+size_t ValidateInputBuffer(size_t size, int html_format, int max_errors);
+
 // Validates an AMP document, and returns validation result. The return value is
 // a base64-encoded protobuf message.
 std::string ValidateString(std::string html, std::string html_format_name,
@@ -9,4 +9,9 @@ EMSCRIPTEN_BINDINGS(what) {
   emscripten::function("renderInlineResult",
                        &amp::validator::RenderInlineResult);
   emscripten::function("validateString", &amp::validator::ValidateString);
+  emscripten::function("reserveInputBuffer",
+                       &amp::validator::ReserveInputBuffer);
+  emscripten::function("resultBuffer", &amp::validator::ResultBuffer);
+  emscripten::function("validateInputBuffer",
+                       &amp::validator::ValidateInputBuffer);
 }
@@ -240,6 +240,11 @@ class Allocator {
     remaining_ = 0;
   }
 
+  // The memory held by the blocks of this allocator.
+  std::size_t BytesAllocated() const {
+    return static_cast<std::size_t>(blocks_allocated_) * block_size_;
+  }
+
   // Used only by test or development environment.
   std::tuple<int /*alignment*/,
              int /*block_size*/,
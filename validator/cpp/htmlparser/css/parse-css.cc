@@ -373,7 +373,7 @@ class Tokenizer {
  public:
   Tokenizer(vector<char32_t>* str, int line, int col,
             vector<unique_ptr<Token>>* tokens,
-            vector<unique_ptr<ErrorToken>>* errors)
+            vector<unique_ptr<ErrorToken>>* errors, Deadline* deadline)
       : str_(str), code_(0), pos_(-1), eof_(false), errors_(errors) {
     Preprocess(str_);
 
@@ -394,6 +394,7 @@ class Tokenizer {
     }
 
     while (!EofNext()) {
+      if (deadline && deadline->Expired()) break;
       unique_ptr<Token> token = ConsumeAToken();
       if (token->Type() == TokenType::ERROR) {
         errors->emplace_back(static_cast<ErrorToken*>(token.release()));
@@ -928,9 +929,11 @@ class Tokenizer {
 // Preprocesses the input string and instantiates the Tokenizer; returns the
 // resulting tokens.
 vector<unique_ptr<Token>> Tokenize(vector<char32_t>* str_in, int line, int col,
-                                   vector<unique_ptr<ErrorToken>>* errors) {
+                                   vector<unique_ptr<ErrorToken>>* errors,
+                                   Deadline* deadline) {
   vector<unique_ptr<Token>> tokens;
-  Tokenizer tmp(str_in, /*line=*/line, /*col=*/col, &tokens, errors);
+  Tokenizer tmp(str_in, /*line=*/line, /*col=*/col, &tokens, errors,
+                deadline);
   return tokens;
 }
 
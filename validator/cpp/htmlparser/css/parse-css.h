@@ -30,6 +30,7 @@
 #include "absl/memory/memory.h"
 #include "absl/strings/strip.h"
 #include "cpp/htmlparser/css/parse-css.pb.h"
+#include "cpp/htmlparser/deadline.h"
 #include "cpp/htmlparser/json/types.h"
 #include "validator.pb.h"
 
@@ -632,9 +633,12 @@ class RuleVisitor {
 };
 
 // Tokenizes the provided input string. Note: may mutate the input string.
+// If |deadline| expires, tokenizing stops, and the tokens so far are
+// returned, followed by the EOF token.
 std::vector<std::unique_ptr<Token>> Tokenize(
     std::vector<char32_t>* str_in, int line, int col,
-    std::vector<std::unique_ptr<ErrorToken>>* errors);
+    std::vector<std::unique_ptr<ErrorToken>>* errors,
+    Deadline* deadline = nullptr);
 
 // Specifies how at rules are to be handled by the parser.
 struct CssParsingConfig {
@@ -86,6 +86,20 @@ TEST(ParseCssTest, Tokenize_GeneratesTokensForSimpleExample) {
   EXPECT_EQ(17, tokens[11]->pos());
 }
 
+TEST(ParseCssTest, Tokenize_StopsAtDeadline) {
+  vector<char32_t> css =
+      htmlparser::Strings::Utf8ToCodepoints("foo { bar: baz; }");
+  vector<unique_ptr<ErrorToken>> errors;
+  htmlparser::CancellationToken token;
+  token.Cancel();
+  htmlparser::Deadline deadline(&token);
+  vector<unique_ptr<Token>> tokens =
+      Tokenize(&css, /*line=*/1, /*col=*/0, &errors, &deadline);
+  EXPECT_EQ(JsonFromList(tokens),
+            R"([{"tokentype":"EOF_TOKEN","line":1,"col":17}])");
+  EXPECT_EQ(0, errors.size());
+}
+
 TEST(ParseCssTest, Tokenize_TokenizesWithParseErrors) {
   vector<char32_t> css = htmlparser::Strings::Utf8ToCodepoints(" \"\n \"");
   vector<unique_ptr<ErrorToken>> errors;
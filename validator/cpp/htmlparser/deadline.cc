@@ -0,0 +1,20 @@
+#include "cpp/htmlparser/deadline.h"
+
+namespace htmlparser {
+
+bool Deadline::Expired() {
+  if (!status_.ok()) return true;
+  if (token_ && token_->IsCancelled()) {
+    status_ = absl::CancelledError("Cancelled.");
+    return true;
+  }
+  if (!time_.has_value() || --checks_until_clock_read_ > 0) return false;
+  checks_until_clock_read_ = kChecksPerClockRead;
+  if (clock_() >= *time_) {
+    status_ = absl::DeadlineExceededError("Deadline exceeded.");
+    return true;
+  }
+  return false;
+}
+
+}  // namespace htmlparser
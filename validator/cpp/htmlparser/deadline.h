@@ -0,0 +1,84 @@
+// Bounds the time spent on a parse or a validation, e.g. of hostile input.
+// Long running loops call Deadline::Expired() at regular points, such as
+// once per token, and stop early once it returns true.
+//
+// Usage:
+//   htmlparser::CancellationToken token;
+//   htmlparser::Deadline deadline(
+//       std::chrono::steady_clock::now() + std::chrono::milliseconds(500),
+//       &token);
+//   // Possibly from another thread:
+//   token.Cancel();
+
+#ifndef CPP_HTMLPARSER_DEADLINE_H_
+#define CPP_HTMLPARSER_DEADLINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+#include "absl/status/status.h"
+
+namespace htmlparser {
+
+// Lets a caller stop work running on other threads. Cancel() may be called
+// from any thread, at any time.
+class CancellationToken {
+ public:
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+  bool IsCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+
+// A point in time and/or a CancellationToken, past which work stops. Once
+// expired, a deadline stays expired.
+//
+// Checking a deadline is cheap: the clock is read once every
+// kChecksPerClockRead calls of Expired(). A deadline is used by one thread
+// at a time, unlike its token.
+class Deadline {
+ public:
+  static constexpr int kChecksPerClockRead = 64;
+
+  // Reads the time, e.g. std::chrono::steady_clock::now, or a fake clock in
+  // tests.
+  using Clock = std::chrono::steady_clock::time_point (*)();
+
+  // Never expires, unless |token| is cancelled.
+  explicit Deadline(const CancellationToken* token = nullptr)
+      : token_(token) {}
+
+  // Expires at |time| as read from |clock|, or when |token| is cancelled.
+  explicit Deadline(std::chrono::steady_clock::time_point time,
+                    const CancellationToken* token = nullptr,
+                    Clock clock = &std::chrono::steady_clock::now)
+      : time_(time), token_(token), clock_(clock) {}
+
+  Deadline(const Deadline&) = delete;
+  Deadline& operator=(const Deadline&) = delete;
+
+  // Returns whether the deadline has expired, checking the clock and the
+  // token every so often.
+  bool Expired();
+
+  // Returns whether a call to Expired() has returned true, without checking.
+  bool expired() const { return !status_.ok(); }
+
+  // DeadlineExceededError or CancelledError once expired, OK until then.
+  const absl::Status& status() const { return status_; }
+
+ private:
+  std::optional<std::chrono::steady_clock::time_point> time_;
+  const CancellationToken* token_;
+  Clock clock_ = &std::chrono::steady_clock::now;
+  int checks_until_clock_read_ = 0;
+  absl::Status status_;
+};
+
+}  // namespace htmlparser
+
+#endif  // CPP_HTMLPARSER_DEADLINE_H_
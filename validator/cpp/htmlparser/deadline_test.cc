@@ -0,0 +1,75 @@
+#include "cpp/htmlparser/deadline.h"
+
+#include <chrono>
+
+#include "gtest/gtest.h"
+
+namespace htmlparser {
+namespace {
+
+TEST(DeadlineTest, NeverExpiresWithoutTimeOrToken) {
+  Deadline deadline;
+  for (int i = 0; i < 10 * Deadline::kChecksPerClockRead; ++i)
+    EXPECT_FALSE(deadline.Expired());
+  EXPECT_FALSE(deadline.expired());
+  EXPECT_TRUE(deadline.status().ok());
+}
+
+TEST(DeadlineTest, ExpiresWhenCancelled) {
+  CancellationToken token;
+  Deadline deadline(std::chrono::steady_clock::now() + std::chrono::hours(1),
+                    &token);
+  EXPECT_FALSE(deadline.Expired());
+  token.Cancel();
+  EXPECT_FALSE(deadline.expired());
+  EXPECT_TRUE(deadline.Expired());
+  EXPECT_TRUE(deadline.expired());
+  EXPECT_TRUE(absl::IsCancelled(deadline.status()));
+}
+
+TEST(DeadlineTest, ExpiresOnceTimePasses) {
+  // The clock is read on the first check.
+  Deadline deadline(std::chrono::steady_clock::now());
+  EXPECT_TRUE(deadline.Expired());
+  EXPECT_TRUE(absl::IsDeadlineExceeded(deadline.status()));
+
+  auto start = std::chrono::steady_clock::now();
+  Deadline later(start + std::chrono::milliseconds(10));
+  while (!later.Expired()) {
+  }
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(10));
+  EXPECT_TRUE(absl::IsDeadlineExceeded(later.status()));
+}
+
+int fake_clock_reads = 0;
+
+// Advances by a millisecond each time it is read.
+std::chrono::steady_clock::time_point FakeClock() {
+  return std::chrono::steady_clock::time_point(
+      std::chrono::milliseconds(++fake_clock_reads));
+}
+
+TEST(DeadlineTest, ReadsTheGivenClock) {
+  fake_clock_reads = 0;
+  Deadline deadline(
+      std::chrono::steady_clock::time_point(std::chrono::milliseconds(3)),
+      /*token=*/nullptr, &FakeClock);
+  int checks = 1;
+  while (!deadline.Expired()) ++checks;
+  EXPECT_EQ(3, fake_clock_reads);
+  EXPECT_EQ(2 * Deadline::kChecksPerClockRead + 1, checks);
+  EXPECT_TRUE(absl::IsDeadlineExceeded(deadline.status()));
+}
+
+TEST(DeadlineTest, StaysExpired) {
+  CancellationToken token;
+  token.Cancel();
+  Deadline deadline(&token);
+  EXPECT_TRUE(deadline.Expired());
+  EXPECT_TRUE(deadline.Expired());
+  EXPECT_TRUE(absl::IsCancelled(deadline.status()));
+}
+
+}  // namespace
+}  // namespace htmlparser
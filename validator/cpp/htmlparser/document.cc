@@ -12,6 +12,10 @@ Document::Document() :
         ::absl::GetFlag(FLAGS_htmlparser_nodes_allocator_block_size))),
     root_node_(NewNode(NodeType::DOCUMENT_NODE)) {}
 
+Document::Document(std::shared_ptr<Allocator<Node>> node_allocator)
+    : node_allocator_(std::move(node_allocator)),
+      root_node_(NewNode(NodeType::DOCUMENT_NODE)) {}
+
 Node* Document::NewNode(NodeType node_type, Atom atom) {
   return node_allocator_->Construct(node_type, atom);
 }
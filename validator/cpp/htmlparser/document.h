@@ -54,6 +54,10 @@ struct DocumentMetadata {
   // error reporting at the end of the document.
   LineCol document_end_location {0, 0};
 
+  // Whether the contents of <noscript> elements were parsed as markup, see
+  // ParseOptions::parse_noscript_as_markup.
+  bool noscript_parsed_as_markup = false;
+
   // The actual size of html src in bytes.
   std::size_t html_src_bytes = 0;
 
@@ -120,8 +124,13 @@ class Document {
   // destructed.
   Node* CloneNode(const Node* from);
 
-  // The node allocator.
-  std::unique_ptr<Allocator<Node>> node_allocator_;
+  // Creates a document whose nodes are allocated by |node_allocator|, which
+  // it shares with another document.
+  explicit Document(std::shared_ptr<Allocator<Node>> node_allocator);
+
+  // The node allocator, shared by the documents parsed from fragments of
+  // this document, see ParseOptions::parse_noscript_as_markup.
+  std::shared_ptr<Allocator<Node>> node_allocator_;
 
   Node* root_node_;
   std::vector<Node*> fragment_nodes_{};
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 
+#include "cpp/htmlparser/atomutil.h"
 #include "cpp/htmlparser/comparators.h"
 #include "cpp/htmlparser/strings.h"
 
@@ -56,6 +57,7 @@ void AdjustSVGAttributeNames(std::vector<Attribute>* attrs) {
         iter != std::end(kSvgAttributeAdjustments) &&
         iter->first == attr.key) {
       attr.key = iter->second.data();
+      attr.atom = AtomUtil::ToAtom(attr.key);
     }
   }
 }
@@ -70,6 +72,7 @@ void AdjustMathMLAttributeNames(std::vector<Attribute>* attrs) {
         iter != std::end(kMathMLAttributeAdjustments) &&
         iter->first == attr.key) {
       attr.key = iter->second.data();
+      attr.atom = AtomUtil::ToAtom(attr.key);
     }
   }
 }
@@ -87,6 +90,7 @@ void AdjustForeignAttributes(std::vector<Attribute>* attrs) {
       int j = attr.key.find(':');
       attr.name_space = attr.key.substr(0, j);
       attr.key = attr.key.substr(j + 1);
+      attr.atom = Atom::UNKNOWN;
     }
   }
 }
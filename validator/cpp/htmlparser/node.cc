@@ -26,6 +26,9 @@ void Node::AddAttribute(const Attribute& attr) {
 void Node::SortAttributes(bool remove_duplicates) {
   std::stable_sort(attributes_.begin(), attributes_.end(),
             [](const Attribute& left, const Attribute& right) -> bool {
+              // Avoids building the key parts in the common case.
+              if (left.name_space.empty() && right.name_space.empty())
+                return left.key < right.key;
               return left.KeyPart() < right.KeyPart();
             });
   if (remove_duplicates) DropDuplicateAttributes();
@@ -406,24 +409,28 @@ std::string Node::InnerText() const {
   return absl::StrJoin(buffer, " ");
 }
 
-void Node::UpdateChildNodesPositions(Node* relative_node) {
+void Node::UpdateChildNodesPositions(const Node* relative_node) {
   // Cannot proceed if relative node has no positional information.
   if (!relative_node->LineColInHtmlSrc().has_value()) return;
 
   auto [r_line, r_col] = relative_node->LineColInHtmlSrc().value();
-
-  // Update the positions of this node.
-  if (line_col_in_html_src_.has_value()) {
-    auto [line, col] = line_col_in_html_src_.value();
-    int effective_col = line == 1 ?
-        r_col + col + AtomUtil::ToString(
-            relative_node->DataAtom()).size() + 1 /* closing > */ : col;
-    line_col_in_html_src_ = LineCol({line + r_line - 1, effective_col});
-  }
-
-  // Update the positions of this node's children.
-  for (auto c = FirstChild(); c; c = c->NextSibling()) {
-    c->UpdateChildNodesPositions(relative_node);
+  int tag_name_size = AtomUtil::ToString(relative_node->DataAtom()).size();
+
+  // Update the positions of this node and its descendants, in pre-order and
+  // without recursion, so that deeply nested nodes cannot exhaust the stack.
+  for (Node* n = this; n;) {
+    if (n->line_col_in_html_src_.has_value()) {
+      auto [line, col] = n->line_col_in_html_src_.value();
+      int effective_col =
+          line == 1 ? r_col + col + tag_name_size + 1 /* closing > */ : col;
+      n->line_col_in_html_src_ = LineCol({line + r_line - 1, effective_col});
+    }
+    if (n->first_child_) {
+      n = n->first_child_;
+      continue;
+    }
+    while (n != this && !n->next_sibling_) n = n->parent_;
+    n = n == this ? nullptr : n->next_sibling_;
   }
 }
 
@@ -65,7 +65,7 @@ class Node {
   // A) Unit testing.
   // B) When parsing a fragment.
   // C) Custom error/warning reporting.
-  void UpdateChildNodesPositions(Node* relative_node);
+  void UpdateChildNodesPositions(const Node* relative_node);
 
   NodeType Type() const { return node_type_; }
   std::string_view Data() const { return data_; }
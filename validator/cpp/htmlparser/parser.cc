@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <chrono>
 #include <set>
 #include <tuple>
 #ifdef DUMP_NODES
@@ -24,6 +25,24 @@ namespace {
 // Internal functions forward declarations.
 std::string ExtractWhitespace(const std::string& s);
 
+#ifdef HTMLPARSER_STATS
+// Adds the wall time of its scope to |*total|, unless |total| is null.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(std::chrono::nanoseconds* total)
+      : total_(total),
+        start_(total ? std::chrono::steady_clock::now()
+                     : std::chrono::steady_clock::time_point()) {}
+  ~ScopedTimer() {
+    if (total_) *total_ += std::chrono::steady_clock::now() - start_;
+  }
+
+ private:
+  std::chrono::nanoseconds* total_;
+  std::chrono::steady_clock::time_point start_;
+};
+#endif  // HTMLPARSER_STATS
+
 #ifdef DUMP_NODES
 void DumpNode(Node* root_node) {
   for (Node* c = root_node->FirstChild(); c; c = c->NextSibling()) {
@@ -37,6 +56,11 @@ void DumpDocument(Document* doc) { DumpNode(doc->RootNode()); }
 
 #endif  // DUMP_NODES
 
+absl::Status NoscriptTooDeepError() {
+  return absl::InvalidArgumentError(
+      "htmlparser::Parser <noscript> nested too deeply.");
+}
+
 }  // namespace.
 
 std::unique_ptr<Document> Parse(std::string_view html) {
@@ -58,40 +82,8 @@ std::unique_ptr<Document> ParseWithOptions(std::string_view html,
 std::unique_ptr<Document> ParseFragmentWithOptions(std::string_view html,
                                                    const ParseOptions& options,
                                                    Node* fragment_parent) {
-  std::unique_ptr<Parser> parser = std::make_unique<Parser>(
-      html, options, fragment_parent);
-  Node* root = parser->document_->NewNode(NodeType::ELEMENT_NODE, Atom::HTML);
-  parser->document_->root_node_->AppendChild(root);
-  parser->open_elements_stack_.Push(root);
-
-  if (fragment_parent && fragment_parent->DataAtom() == Atom::TEMPLATE) {
-    parser->template_stack_.push_back(std::bind(&Parser::InTemplateIM,
-                                                parser.get()));
-  }
-
-  parser->ResetInsertionMode();
-
-  for (Node* node = fragment_parent; node; node = node->Parent()) {
-    if (node->Type() == NodeType::ELEMENT_NODE &&
-        node->DataAtom() == Atom::FORM) {
-      parser->form_ = node;
-      break;
-    }
-  }
-
-  auto doc = parser->Parse();
-
-  if (doc->status().ok()) {
-    Node* parent = fragment_parent ? root : doc->root_node_;
-    for (Node* c = parent->FirstChild(); c;) {
-      Node* next = c->NextSibling();
-      doc->fragment_nodes_.push_back(std::move(c));
-      parent->RemoveChild(c);
-      c = next;
-    }
-  }
-
-  return doc;
+  return std::make_unique<Parser>(html, options, fragment_parent)
+      ->ParseAsFragment();
 }
 
 std::unique_ptr<Document> ParseFragment(std::string_view html,
@@ -108,52 +100,190 @@ std::unique_ptr<Document> ParseFragment(std::string_view html,
 
 Parser::Parser(std::string_view html, const ParseOptions& options,
                Node* fragment_parent)
+    : Parser(html, options, fragment_parent, std::make_unique<Document>()) {}
+
+Parser::Parser(std::string_view html, const ParseOptions& options,
+               Node* fragment_parent, std::unique_ptr<Document> document)
     : tokenizer_(std::make_unique<Tokenizer>(
           html,
           fragment_parent ? AtomUtil::ToString(fragment_parent->atom_) : "")),
       on_node_callback_(options.on_node_callback),
-      document_(new Document),
+      document_(std::move(document)),
       scope_marker_(document_->NewNode(NodeType::SCOPE_MARKER_NODE)),
       scripting_(options.scripting),
       frameset_ok_(options.frameset_ok),
       record_node_offsets_(options.record_node_offsets),
       record_attribute_offsets_(options.record_attribute_offsets),
       count_num_terms_in_text_node_(options.count_num_terms_in_text_node),
+      parse_noscript_as_markup_(options.parse_noscript_as_markup),
+      deadline_(options.deadline),
+      stats_(options.stats),
       fragment_(fragment_parent != nullptr),
       context_node_(fragment_parent) {
   document_->metadata_.html_src_bytes = html.size();
+  document_->metadata_.noscript_parsed_as_markup =
+      options.scripting && options.parse_noscript_as_markup;
   insertion_mode_ = std::bind(&Parser::InitialIM, this);
 }
 
-std::unique_ptr<Document> Parser::Parse() {
+std::unique_ptr<Document> Parser::ParseAsFragment() {
+  Node* root = document_->NewNode(NodeType::ELEMENT_NODE, Atom::HTML);
+  document_->root_node_->AppendChild(root);
+  open_elements_stack_.Push(root);
+
+  if (context_node_ && context_node_->DataAtom() == Atom::TEMPLATE) {
+    template_stack_.push_back(std::bind(&Parser::InTemplateIM, this));
+  }
+
+  ResetInsertionMode();
+
+  for (Node* node = context_node_; node; node = node->Parent()) {
+    if (node->Type() == NodeType::ELEMENT_NODE &&
+        node->DataAtom() == Atom::FORM) {
+      form_ = node;
+      break;
+    }
+  }
+
+  auto doc = Parse();
+
+  if (doc->status().ok()) {
+    Node* parent = context_node_ ? root : doc->root_node_;
+    for (Node* c = parent->FirstChild(); c;) {
+      Node* next = c->NextSibling();
+      doc->fragment_nodes_.push_back(std::move(c));
+      parent->RemoveChild(c);
+      c = next;
+    }
+  }
+
+  return doc;
+}
+
+void Parser::ParseNoscriptAsMarkup(Node* noscript) {
+  Node* text = noscript->FirstChild();
+  if (!text || text->Type() != NodeType::TEXT_NODE) return;
+  if (noscript_depth_ == kMaxNoscriptDepth) {
+    document_->status_ = NoscriptTooDeepError();
+    return;
+  }
+#ifdef HTMLPARSER_STATS
+  ScopedTimer timer(stats_ ? &stats_->noscript_reparse_time : nullptr);
+#endif
+
+  if (!noscript_context_) {
+    noscript_context_ =
+        document_->NewNode(NodeType::ELEMENT_NODE, Atom::BODY);
+  }
+  // The fragment's nodes are allocated by this document, so they stay alive
+  // after the fragment's document is destroyed.
+  Parser parser(text->Data(),
+                ParseOptions{
+                    .scripting = scripting_,
+                    .frameset_ok = true,
+                    .record_node_offsets = record_node_offsets_,
+                    .record_attribute_offsets = record_attribute_offsets_,
+                    .count_num_terms_in_text_node = true,
+                    .parse_noscript_as_markup = true,
+                    .deadline = deadline_},
+                noscript_context_,
+                std::unique_ptr<Document>(
+                    new Document(document_->node_allocator_)));
+  parser.noscript_depth_ = noscript_depth_ + 1;
+  auto doc = parser.ParseAsFragment();
+  if (!doc->status().ok()) {
+    // Too deep a nesting fails the whole document, rather than leaving the
+    // innermost <noscript> text unparsed.
+    if (doc->status() == NoscriptTooDeepError()) {
+      document_->status_ = doc->status();
+    }
+    return;
+  }
+
+  noscript->RemoveChild(text);
+  for (Node* node : doc->fragment_nodes_) {
+    node->UpdateChildNodesPositions(noscript);
+    noscript->AppendChild(node);
+  }
+}
+
+void Parser::SetInput(std::string_view html, bool input_complete) {
+  tokenizer_->SetInput(html, input_complete);
+  document_->metadata_.html_src_bytes = html.size();
+}
+
+void Parser::ParseTokens() {
+  if (!document_->status_.ok()) return;
   bool eof = tokenizer_->IsEOF();
   while (!eof) {
+    if (deadline_ && deadline_->Expired()) {
+      document_->status_ = deadline_->status();
+      return;
+    }
     Node* node = open_elements_stack_.Top();
     tokenizer_->SetAllowCDATA(node && !node->name_space_.empty());
     // Read and parse the next token.
-    TokenType token_type = tokenizer_->Next(!template_stack_.empty());
+    TokenType token_type;
+    {
+#ifdef HTMLPARSER_STATS
+      ScopedTimer timer(stats_ ? &stats_->tokenize_time : nullptr);
+      if (stats_) ++stats_->tokens;
+#endif
+      token_type = tokenizer_->Next(!template_stack_.empty());
+    }
 
-    // No end of input, but error token. Parsing failed.
     if (token_type == TokenType::ERROR_TOKEN) {
+      // The next token is not complete yet, wait for more input.
+      if (tokenizer_->NeedsMoreInput()) return;
+      // No end of input, but error token. Parsing failed.
       eof = tokenizer_->IsEOF();
       if (!eof && tokenizer_->Error()) {
         document_->status_ = absl::InvalidArgumentError(
             "htmlparser::Parser tokenizer error.");
-        return std::move(document_);
+        return;
       }
     }
     token_ = tokenizer_->token();
+#ifdef HTMLPARSER_STATS
+    ScopedTimer timer(stats_ ? &stats_->tree_construction_time : nullptr);
+#endif
     ParseCurrentToken();
+    if (!document_->status_.ok()) return;
   }
+}
+
+std::unique_ptr<Document> Parser::Parse() {
+  ParseTokens();
+  if (!document_->status_.ok()) return std::move(document_);
 
 #ifdef DUMP_NODES
   DumpDocument(document_.get());
 #endif
 
   document_->metadata_.document_end_location = tokenizer_->CurrentPosition();
+#ifdef HTMLPARSER_STATS
+  if (stats_)
+    stats_->node_bytes_allocated += document_->node_allocator_->BytesAllocated();
+#endif
   return std::move(document_);
 }  // End Parser::Parse.
 
+StreamingParser::StreamingParser(const ParseOptions& options)
+    : parser_(html_, options) {
+  parser_.SetInput(html_, /*input_complete=*/false);
+}
+
+void StreamingParser::Feed(std::string_view chunk) {
+  html_.append(chunk);
+  parser_.SetInput(html_, /*input_complete=*/false);
+  parser_.ParseTokens();
+}
+
+std::unique_ptr<Document> StreamingParser::Finish() {
+  parser_.SetInput(html_, /*input_complete=*/true);
+  return parser_.Parse();
+}
+
 Node* Parser::top() {
   Node* node = open_elements_stack_.Top();
   if (node) {
@@ -1942,6 +2072,11 @@ void Parser::InBodyEndTagOther(Atom tag_atom, std::string_view tag_name) {
 bool Parser::TextIM() {
   switch (token_.token_type) {
     case TokenType::ERROR_TOKEN:
+    case TokenType::END_TAG_TOKEN:
+      if (parse_noscript_as_markup_ &&
+          open_elements_stack_.Top()->atom_ == Atom::NOSCRIPT) {
+        ParseNoscriptAsMarkup(open_elements_stack_.Top());
+      }
       open_elements_stack_.Pop();
       break;
     case TokenType::TEXT_TOKEN: {
@@ -1960,9 +2095,6 @@ bool Parser::TextIM() {
       AddText(data_view.data());
       return true;
     }
-    case TokenType::END_TAG_TOKEN:
-      open_elements_stack_.Pop();
-      break;
     default:
       break;
   }
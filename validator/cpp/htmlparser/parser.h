@@ -2,11 +2,15 @@
 #define CPP_HTMLPARSER_PARSER_H_
 
 #include <array>
+#include <chrono>
+#include <cstdint>
 #include <deque>
 #include <functional>
+#include <string>
 #include <vector>
 
 #include "cpp/htmlparser/atom.h"
+#include "cpp/htmlparser/deadline.h"
 #include "cpp/htmlparser/document.h"
 #include "cpp/htmlparser/node.h"
 #include "cpp/htmlparser/tokenizer.h"
@@ -16,6 +20,25 @@ namespace htmlparser {
 using OnNodeCallback =
     std::function<void(Node* parsed_node, Token original_token)>;
 
+// Where the time of a parse went. Collected only if htmlparser is built with
+// HTMLPARSER_STATS defined (bazel build --define=stats=1) and
+// ParseOptions::stats is set, so that parsing costs nothing more otherwise.
+struct ParseStats {
+  // The number of tokens read, and the time spent reading them.
+  int64_t tokens = 0;
+  std::chrono::nanoseconds tokenize_time{0};
+  // The time spent building the tree from the tokens, which includes
+  // reparsing <noscript> text, see ParseOptions::parse_noscript_as_markup.
+  std::chrono::nanoseconds tree_construction_time{0};
+  std::chrono::nanoseconds noscript_reparse_time{0};
+  // The memory allocated for the nodes of the document.
+  int64_t node_bytes_allocated = 0;
+};
+
+// The deepest nesting of <noscript> elements that is parsed as markup, see
+// ParseOptions::parse_noscript_as_markup.
+inline constexpr int kMaxNoscriptDepth = 32;
+
 struct ParseOptions {
  public:
   // Parsing state flags (section 12.2.4.5).
@@ -42,6 +65,30 @@ struct ParseOptions {
   // entity code &nbsp;
   bool count_num_terms_in_text_node = false;
 
+  // With scripting enabled, the contents of <noscript> elements are parsed as
+  // a single text node. If set, once a <noscript> element is closed its text
+  // is parsed again as an HTML fragment in the context of <body>, by a
+  // nested parser, and the resulting nodes replace the text as the children
+  // of the <noscript> element. This is the same reparse as
+  // ParseFragmentWithOptions() on the text, except that the fragment's nodes
+  // are allocated by this document, which saves a document with a fresh node
+  // allocator per <noscript>. Their positions are those of the text plus the
+  // position of the <noscript> start tag, see
+  // Node::UpdateChildNodesPositions().
+  //
+  // A <noscript> in the reparsed text is reparsed in turn, so each level of
+  // nesting scans the rest of the text again. Parsing fails if <noscript>
+  // elements are nested more than kMaxNoscriptDepth deep.
+  bool parse_noscript_as_markup = false;
+
+  // If set, parsing stops once |deadline| expires, which is checked before
+  // each token. The document then has the status() of the deadline, and the
+  // nodes parsed so far.
+  Deadline* deadline = nullptr;
+
+  // If set, the statistics of the parse are added to |stats|, see ParseStats.
+  ParseStats* stats = nullptr;
+
   // To be used in unit tests only. Callback style parsing is not yet supported.
   OnNodeCallback on_node_callback = nullptr;
 };
@@ -87,6 +134,8 @@ class Parser {
       const std::string_view html, const ParseOptions& options,
       Node* fragment_parent);
 
+  friend class StreamingParser;
+
  private:
   enum class Scope {
     DefaultScope = 0,
@@ -98,13 +147,34 @@ class Parser {
     SelectScope = 6
   };
 
+  // Parses into |document|, which may share the node allocator of another
+  // document, see ParseNoscriptAsMarkup().
+  Parser(std::string_view html, const ParseOptions& options,
+         Node* fragment_parent, std::unique_ptr<Document> document);
+
   // Disallow copy and assign.
   Parser(const Parser&) = delete;
   Parser& operator=(const Parser&) = delete;
 
+  // Replaces the input with |html|, which begins with the input seen so far.
+  // See Tokenizer::SetInput.
+  void SetInput(std::string_view html, bool input_complete);
+
+  // Parses tokens until the end of the input, the end of the input seen so
+  // far if it is incomplete, or a tokenizer error.
+  void ParseTokens();
+
   // Adds a child element based on the current token.
   void AddElement();
 
+  // Parses the input as the children of the fragment parent, if any, and
+  // returns the document whose FragmentNodes() are the top level nodes.
+  [[nodiscard]] std::unique_ptr<Document> ParseAsFragment();
+
+  // Replaces the text child of |noscript| with the nodes parsed from it, see
+  // ParseOptions::parse_noscript_as_markup.
+  void ParseNoscriptAsMarkup(Node* noscript);
+
   // Parses a token as though it had appeared in the parser's input.
   void ParseImpliedToken(TokenType token_type, Atom atom,
                          const std::string& data);
@@ -310,6 +380,17 @@ class Parser {
   // Entities like &nbsp; and other unicode whitespace chars are not taken into
   // account.
   bool count_num_terms_in_text_node_ = false;
+  // See ParseOptions::parse_noscript_as_markup.
+  bool parse_noscript_as_markup_ = false;
+  // The number of reparsed <noscript> elements enclosing the input of this
+  // parser, see ParseNoscriptAsMarkup().
+  int noscript_depth_ = 0;
+  // See ParseOptions::deadline.
+  Deadline* deadline_ = nullptr;
+  // See ParseOptions::stats.
+  ParseStats* stats_ = nullptr;
+  // The <body> context of the <noscript> fragments, created on first use.
+  Node* noscript_context_ = nullptr;
 
   // Whether the parser is parsing an HTML fragment.
   // If the fragment is the InnerHTML of a node, set that node in context_node_.
@@ -355,6 +436,41 @@ class Parser {
   int num_body_tags_ = 0;
 };
 
+// Parses html which arrives in chunks, e.g. over the network. Tokenization
+// and tree construction advance as far as the chunks fed so far allow, so
+// that parsing overlaps with the arrival of the input. The resulting document
+// is identical to the one Parser produces for the concatenated input. Text,
+// comments, scripts and other raw text which span many chunks are scanned
+// on from where the previous chunk ended, so parsing stays linear in the
+// size of the input.
+//
+// Usage:
+//   StreamingParser parser(options);
+//   while (...) parser.Feed(chunk);
+//   std::unique_ptr<Document> doc = parser.Finish();
+class StreamingParser {
+ public:
+  explicit StreamingParser(const ParseOptions& options = {});
+
+  // Appends |chunk| to the input and parses all the tokens that are known
+  // to be complete.
+  void Feed(std::string_view chunk);
+
+  // Parses the remainder of the input and returns the document. No more
+  // chunks may be fed afterwards.
+  [[nodiscard]] std::unique_ptr<Document> Finish();
+
+  // Disallow copy and assign.
+  StreamingParser(const StreamingParser&) = delete;
+  StreamingParser& operator=(const StreamingParser&) = delete;
+
+ private:
+  // All of the input fed so far. Tokens already parsed are kept, as the
+  // tokenizer addresses the input by offset.
+  std::string html_;
+  Parser parser_;
+};
+
 }  // namespace htmlparser
 
 #endif  // CPP_HTMLPARSER_PARSER_H_
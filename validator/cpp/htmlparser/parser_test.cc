@@ -1,10 +1,15 @@
 #include "cpp/htmlparser/parser.h"
 
+#include <string>
+#include <string_view>
+
 #include "gtest/gtest.h"
 #include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
 #include "cpp/htmlparser/atom.h"
 #include "cpp/htmlparser/atomutil.h"
+#include "cpp/htmlparser/deadline.h"
 #include "cpp/htmlparser/node.h"
 #include "cpp/htmlparser/renderer.h"
 #include "cpp/htmlparser/token.h"
@@ -778,3 +783,153 @@ TEST(ParserTest, DocumentMetadataTest) {
   EXPECT_EQ(doc->Metadata().base_url.second, "blank");
   EXPECT_EQ(doc->Metadata().canonical_url, "foo.google.com");
 }
+
+TEST(ParserTest, ParseNoscriptAsMarkup) {
+  const std::string html =
+      "<html><head><noscript><style amp-boilerplate>body{}</style></noscript>"
+      "</head><body>\n<noscript><img src=\"a.png\"></noscript></body></html>";
+  htmlparser::ParseOptions options{
+      .scripting = true,
+      .frameset_ok = true,
+      .record_node_offsets = true,
+      .record_attribute_offsets = true,
+  };
+  auto text_doc = htmlparser::ParseWithOptions(html, options);
+  EXPECT_FALSE(text_doc->Metadata().noscript_parsed_as_markup);
+  htmlparser::Node* head = text_doc->RootNode()->FirstChild()->FirstChild();
+  EXPECT_EQ(head->FirstChild()->FirstChild()->Type(),
+            htmlparser::NodeType::TEXT_NODE);
+
+  options.parse_noscript_as_markup = true;
+  auto doc = htmlparser::ParseWithOptions(html, options);
+  ASSERT_TRUE(doc->status().ok());
+  EXPECT_TRUE(doc->Metadata().noscript_parsed_as_markup);
+  head = doc->RootNode()->FirstChild()->FirstChild();
+  htmlparser::Node* noscript = head->FirstChild();
+  EXPECT_EQ(noscript->DataAtom(), htmlparser::Atom::NOSCRIPT);
+  htmlparser::Node* style = noscript->FirstChild();
+  EXPECT_EQ(style->DataAtom(), htmlparser::Atom::STYLE);
+  EXPECT_EQ(style->FirstChild()->Data(), "body{}");
+  EXPECT_NULL(style->NextSibling());
+
+  htmlparser::Node* body = head->NextSibling();
+  noscript = body->FirstChild()->NextSibling();
+  EXPECT_EQ(noscript->DataAtom(), htmlparser::Atom::NOSCRIPT);
+  htmlparser::Node* img = noscript->FirstChild();
+  EXPECT_EQ(img->DataAtom(), htmlparser::Atom::IMG);
+  EXPECT_EQ(img->Attributes()[0].value, "a.png");
+  EXPECT_NULL(img->NextSibling());
+  // Positions are relative to the <noscript> start tag.
+  EXPECT_EQ(noscript->LineColInHtmlSrc(), htmlparser::LineCol({2, 1}));
+  EXPECT_EQ(img->LineColInHtmlSrc(), htmlparser::LineCol({2, 11}));
+}
+
+TEST(ParserTest, ParseNoscriptAsMarkupFailsOnDeepNesting) {
+  htmlparser::ParseOptions options{
+      .scripting = true,
+      .frameset_ok = true,
+      .parse_noscript_as_markup = true,
+  };
+  auto nested = [](int depth) {
+    std::string html = "<html><body>";
+    for (int i = 0; i < depth; ++i) html += "<noscript>";
+    html += "<img>";
+    for (int i = 0; i < depth; ++i) html += "</noscript>";
+    return html;
+  };
+
+  auto doc = htmlparser::ParseWithOptions(
+      nested(htmlparser::kMaxNoscriptDepth), options);
+  ASSERT_TRUE(doc->status().ok());
+  htmlparser::Node* node = doc->RootNode()->FirstChild()->LastChild();
+  ASSERT_EQ(node->DataAtom(), htmlparser::Atom::BODY);
+  for (int i = 0; i < htmlparser::kMaxNoscriptDepth; ++i) {
+    node = node->LastChild();
+    ASSERT_EQ(node->DataAtom(), htmlparser::Atom::NOSCRIPT);
+  }
+  EXPECT_EQ(node->FirstChild()->DataAtom(), htmlparser::Atom::IMG);
+
+  // Each level of nesting rescans the rest of the input, so an unbounded
+  // nesting would take quadratic time and overflow the stack.
+  doc = htmlparser::ParseWithOptions(
+      nested(htmlparser::kMaxNoscriptDepth + 1), options);
+  EXPECT_FALSE(doc->status().ok());
+  doc = htmlparser::ParseWithOptions(nested(20000), options);
+  EXPECT_FALSE(doc->status().ok());
+}
+
+TEST(ParserTest, StreamingParserMatchesParser) {
+  const std::string html =
+      "<!doctype html>\r\n<html ⚡ lang=en>\r\n<head>\r"
+      "<meta charset=\"utf-8\"><title>Streaming &amp; parsing</title>\n"
+      "<style amp-custom>body { color: red; } /* </styl */</style>\n"
+      "<script type=\"application/json\">{\"a\": \"</scr\"}</script>\n"
+      "<script><!-- <script>a</script> -- b --></script>\n"
+      "<noscript><img src=\"a.png\"></noscript><!-- a -- comment --->\n"
+      "</head><body class=\"a\"><template type=\"amp-mustache\">"
+      "<p {{#cond}}class=foo{{/cond}} id=bar>{{title}}</p></template>\n"
+      "<p>One<b>two<i>three</b>four</i></p><table><tr><td>cell</table>\n"
+      "<svg><![CDATA[x < y]]><circle r=\"1\"/></svg><textarea>\n"
+      "<p>not a tag</p></textarea>\n"
+      "<body data-foo=\"merged\">trailing text\r";
+  htmlparser::ParseOptions options{
+      .scripting = true,
+      .frameset_ok = true,
+      .record_node_offsets = true,
+      .record_attribute_offsets = true,
+  };
+  auto expected_doc = htmlparser::ParseWithOptions(html, options);
+  std::stringbuf expected;
+  htmlparser::Renderer::Render(expected_doc->RootNode(), &expected);
+
+  for (int chunk_size : {1, 2, 3, 7, 64, 4096}) {
+    SCOPED_TRACE(chunk_size);
+    htmlparser::StreamingParser parser(options);
+    for (size_t i = 0; i < html.size(); i += chunk_size)
+      parser.Feed(std::string_view(html).substr(i, chunk_size));
+    auto doc = parser.Finish();
+    ASSERT_TRUE(doc->status().ok());
+    std::stringbuf actual;
+    htmlparser::Renderer::Render(doc->RootNode(), &actual);
+    EXPECT_EQ(expected.str(), actual.str());
+    EXPECT_EQ(html.size(), doc->Metadata().html_src_bytes);
+    EXPECT_EQ(expected_doc->Metadata().document_end_location,
+              doc->Metadata().document_end_location);
+    // Node positions are the same as well.
+    auto expected_it = expected_doc->begin();
+    for (auto it = doc->begin(); it != doc->end(); ++it, ++expected_it) {
+      ASSERT_FALSE(expected_it == expected_doc->end());
+      EXPECT_EQ(expected_it->LineColInHtmlSrc(), it->LineColInHtmlSrc());
+    }
+  }
+}
+
+TEST(ParserTest, StreamingParserParsesLongTokens) {
+  // See TokenizerTest.ScansLongTokensOnce for the scanning itself.
+  const std::string script(1 << 20, 'x');
+  const std::string html =
+      absl::StrCat("<html><head><script>", script, "</script></head></html>");
+  htmlparser::StreamingParser parser;
+  for (size_t i = 0; i < html.size(); i += 1024)
+    parser.Feed(std::string_view(html).substr(i, 1024));
+  auto doc = parser.Finish();
+  ASSERT_TRUE(doc->status().ok());
+  htmlparser::Node* head = doc->RootNode()->FirstChild()->FirstChild();
+  ASSERT_EQ(head->FirstChild()->DataAtom(), htmlparser::Atom::SCRIPT);
+  EXPECT_EQ(head->FirstChild()->FirstChild()->Data(), script);
+}
+
+TEST(ParserTest, ParseStopsAtDeadline) {
+  std::string html = "<html><body>";
+  for (int i = 0; i < 1000; ++i) html += "<p>paragraph</p>";
+  htmlparser::CancellationToken token;
+  htmlparser::Deadline deadline(&token);
+  htmlparser::ParseOptions options{.deadline = &deadline};
+  auto doc = htmlparser::ParseWithOptions(html, options);
+  EXPECT_TRUE(doc->status().ok());
+
+  token.Cancel();
+  doc = htmlparser::ParseWithOptions(html, options);
+  EXPECT_TRUE(absl::IsCancelled(doc->status()));
+  EXPECT_EQ(doc->RootNode()->FirstChild(), nullptr);
+}
@@ -43,6 +43,10 @@ struct Attribute {
   std::string value;
   // Position of the attribute in html source.
   std::optional<LineCol> line_col_in_html_src;
+  // Atom for key, or Atom::UNKNOWN if key is not a known name or the
+  // attribute has a namespace. Lets clients look attributes up by an interned
+  // id instead of by name.
+  Atom atom = Atom::UNKNOWN;
 
   bool operator==(const Attribute& other) const;
   bool operator!=(const Attribute& other) const;
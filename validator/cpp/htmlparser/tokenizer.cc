@@ -24,13 +24,39 @@ Tokenizer::Tokenizer(std::string_view html, std::string context_tag) :
                   kAllowedFragmentContainers.end(),
                   AtomUtil::ToAtom(context_tag)) !=
         kAllowedFragmentContainers.end()) {
-      raw_tag_ = context_tag;
+      raw_tag_ = RawTag(context_tag);
     }
   }
 }
 
+std::string_view Tokenizer::RawTag(std::string_view lower_case_tag) {
+  for (std::string_view raw_tag : kRawTags) {
+    if (raw_tag == lower_case_tag) return raw_tag;
+  }
+  return "";
+}
+
+inline void Tokenizer::MarkScanPoint(ScanKind kind, int state) {
+  // Past a trailing \r, the line and column may still change.
+  if (input_complete_ || needs_more_input_) return;
+  scan_point_ = ScanPoint{.kind = kind,
+                          .raw = raw_,
+                          .data_start = data_.start,
+                          .state = state,
+                          .num_lines = lines_cols_.size(),
+                          .last_line_col = lines_cols_.back(),
+                          .current_line_col = current_line_col_};
+}
+
+int Tokenizer::ResumeState(ScanKind kind, int initial) {
+  if (resume_.kind != kind) return initial;
+  resume_.kind = ScanKind::kNone;
+  return resume_.state;
+}
+
 inline char Tokenizer::ReadByte() {
   if (raw_.end >= buffer_.size()) {
+    if (!input_complete_) needs_more_input_ = true;
     eof_ = true;
     return 0;
   }
@@ -42,6 +68,11 @@ inline char Tokenizer::ReadByte() {
     current_line_col_.second -= (multi_byte - 1);
   }
 
+  // A trailing \r is only a line break if no \n follows, which can't be
+  // known before the rest of the input arrives.
+  if (c == '\r' && raw_.end >= buffer_.size() && !input_complete_)
+    needs_more_input_ = true;
+
   if (c == '\n' || (c == '\r' &&
                     raw_.end < buffer_.size() &&
                     buffer_.at(raw_.end) != '\n')) {
@@ -101,7 +132,10 @@ void Tokenizer::ReadRawOrRCDATA() {
     return;
   }
 
+  // Raw text has no state but the position.
+  ResumeState(ScanKind::kRawText, 0);
   while (!eof_) {
+    MarkScanPoint(ScanKind::kRawText, 0);
     char c = ReadByte();
     if (eof_) break;
     if (c != '<') continue;
@@ -167,8 +201,10 @@ enum ScriptDataState {
 
 void Tokenizer::ReadScript() {
   defer({data_.end = raw_.end;});
-  ScriptDataState state = ScriptDataState::SCRIPT_DATA;
+  ScriptDataState state = static_cast<ScriptDataState>(
+      ResumeState(ScanKind::kScript, ScriptDataState::SCRIPT_DATA));
   while (!eof_ && state != ScriptDataState::DONE) {
+    MarkScanPoint(ScanKind::kScript, state);
     switch (state) {
       case ScriptDataState::SCRIPT_DATA: {
         char c = ReadByte();
@@ -372,15 +408,16 @@ void Tokenizer::ReadScript() {
 }
 
 void Tokenizer::ReadComment() {
-  data_.start = raw_.end;
+  if (resume_.kind != ScanKind::kComment) data_.start = raw_.end;
   defer({
     if (data_.end < data_.start) {
       // It's a comment with no data, like <!-->
       data_.end = data_.start;
     }
   });
-  int dash_count = 2;
+  int dash_count = ResumeState(ScanKind::kComment, 2);
   while (!eof_) {
+    MarkScanPoint(ScanKind::kComment, dash_count);
     char c = ReadByte();
     if (eof_) {
       // Ignore up to two dashes at EOF.
@@ -596,8 +633,9 @@ TokenType Tokenizer::ReadStartTag(bool template_mode) {
 
   if (raw) {
     int size = data_.end - data_.start;
-    raw_tag_ = std::string(buffer_.substr(data_.start, size));
-    Strings::ToLower(&raw_tag_);
+    std::string tag(buffer_.substr(data_.start, size));
+    Strings::ToLower(&tag);
+    raw_tag_ = RawTag(tag);
   }
 
   // Look for a self-closing token like "<br/>".
@@ -707,6 +745,9 @@ void Tokenizer::ReadTagAttributeKey(bool template_mode) {
         // <p {{#mycondition}}class=foo{{/mycondition}} foo=bar> vs.
         // <img {{#mycondition}}class=foo />
         int raw_end = raw_.end;
+        if (raw_.end + mustache_section_name.size() > buffer_.size() &&
+            !input_complete_)
+          needs_more_input_ = true;
         std::string_view close_section =
             buffer_.substr(raw_.end, mustache_section_name.size());
         bool section_name_match = close_section == mustache_section_name;
@@ -725,6 +766,8 @@ void Tokenizer::ReadTagAttributeKey(bool template_mode) {
 
       if (c1 == '{' && c2 == '{' && (c == '#' || c == '^')) {
         auto n = buffer_.find("}}", raw_.end);
+        if (n == std::string_view::npos && !input_complete_)
+          needs_more_input_ = true;
         if (n != std::string_view::npos) {
           mustache_section_name = buffer_.substr(raw_.end, n - raw_.end);
           mustache_inside_section_block = true;
@@ -826,9 +869,78 @@ void Tokenizer::ReadTagAttributeValue() {
   }
 }
 
+void Tokenizer::SetInput(std::string_view html, bool input_complete) {
+  buffer_ = html;
+  input_complete_ = input_complete;
+}
+
+Tokenizer::Checkpoint Tokenizer::SaveCheckpoint() const {
+  return Checkpoint{.raw = raw_,
+                    .data = data_,
+                    .token_type = token_type_,
+                    .raw_tag = raw_tag_,
+                    .text_is_raw = text_is_raw_,
+                    .convert_null = convert_null_,
+                    .eof = eof_,
+                    .err = err_,
+                    .is_token_manufactured = is_token_manufactured_,
+                    .num_lines = lines_cols_.size(),
+                    .last_line_col = lines_cols_.back(),
+                    .current_line_col = current_line_col_,
+                    .token_line_col = token_line_col_,
+                    .resume = resume_};
+}
+
+void Tokenizer::RestoreCheckpoint(const Checkpoint& checkpoint) {
+  raw_ = checkpoint.raw;
+  data_ = checkpoint.data;
+  token_type_ = checkpoint.token_type;
+  raw_tag_ = checkpoint.raw_tag;
+  text_is_raw_ = checkpoint.text_is_raw;
+  convert_null_ = checkpoint.convert_null;
+  eof_ = checkpoint.eof;
+  err_ = checkpoint.err;
+  is_token_manufactured_ = checkpoint.is_token_manufactured;
+  lines_cols_.resize(checkpoint.num_lines);
+  lines_cols_.back() = checkpoint.last_line_col;
+  current_line_col_ = checkpoint.current_line_col;
+  token_line_col_ = checkpoint.token_line_col;
+  resume_ = checkpoint.resume;
+}
+
 TokenType Tokenizer::Next(bool template_mode) {
-  raw_.start = raw_.end;
-  data_.start = raw_.end;
+  needs_more_input_ = false;
+  if (input_complete_) return NextToken(template_mode);
+
+  Checkpoint checkpoint = SaveCheckpoint();
+  scan_point_.kind = ScanKind::kNone;
+  TokenType token_type = NextToken(template_mode);
+  if (!needs_more_input_) return token_type;
+  if (scan_point_.kind != ScanKind::kNone) {
+    // Rewind only to the last scan point, where the next call resumes.
+    checkpoint.raw = scan_point_.raw;
+    checkpoint.num_lines = scan_point_.num_lines;
+    checkpoint.last_line_col = scan_point_.last_line_col;
+    checkpoint.current_line_col = scan_point_.current_line_col;
+    checkpoint.resume = scan_point_;
+    // Text and comments are only scanned once the raw text, if any, is done.
+    if (scan_point_.kind == ScanKind::kText ||
+        scan_point_.kind == ScanKind::kComment)
+      checkpoint.raw_tag = "";
+  }
+  bytes_rescanned_ += raw_.end - checkpoint.raw.end;
+  RestoreCheckpoint(checkpoint);
+  return TokenType::ERROR_TOKEN;
+}
+
+TokenType Tokenizer::NextToken(bool template_mode) {
+  if (resume_.kind != ScanKind::kNone) {
+    raw_.start = resume_.raw.start;
+    data_.start = resume_.data_start;
+  } else {
+    raw_.start = raw_.end;
+    data_.start = raw_.end;
+  }
   data_.end = raw_.end;
   is_token_manufactured_ = false;
 
@@ -841,7 +953,9 @@ TokenType Tokenizer::Next(bool template_mode) {
   if (raw_tag_ != "") {
     if (raw_tag_ == "plaintext") {
       // Read everything up to EOF.
+      ResumeState(ScanKind::kRawText, 0);
       while (!eof_) {
+        MarkScanPoint(ScanKind::kRawText, 0);
         ReadByte();
       }
       data_.end = raw_.end;
@@ -860,7 +974,15 @@ TokenType Tokenizer::Next(bool template_mode) {
   text_is_raw_ = false;
   convert_null_ = false;
 
+  if (resume_.kind == ScanKind::kComment) {
+    ReadComment();
+    token_type_ = TokenType::COMMENT_TOKEN;
+    return token_type_;
+  }
+
+  ResumeState(ScanKind::kText, 0);
   while (!eof_) {
+    MarkScanPoint(ScanKind::kText, 0);
     char c = ReadByte();
 
     if (eof_) {
@@ -1024,11 +1146,13 @@ std::optional<std::tuple<Attribute, bool>> Tokenizer::TagAttr() {
         Strings::ToLower(&key);
         Strings::ConvertNewLines(&val);
         Strings::UnescapeString(&val, true);
+        Atom atom = AtomUtil::ToAtom(key);
         return std::make_tuple<Attribute, bool>(
             {.name_space = "",
              .key = std::move(key),
              .value = std::move(val),
-             .line_col_in_html_src = std::get<LineCol>(attr)},
+             .line_col_in_html_src = std::get<LineCol>(attr),
+             .atom = atom},
             n_attributes_returned_ < attributes_.size());
       }
       default:
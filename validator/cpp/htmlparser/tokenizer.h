@@ -1,8 +1,11 @@
 #ifndef CPP_HTMLPARSER_TOKENIZER_H_
 #define CPP_HTMLPARSER_TOKENIZER_H_
 
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
@@ -89,8 +92,29 @@ class Tokenizer {
   std::string_view Raw();
 
   // Scans the next token and returns its type.
+  //
+  // If the input is incomplete (see SetInput), a token that may continue past
+  // the end of the input seen so far is not returned. Instead the tokenizer
+  // returns ERROR_TOKEN with NeedsMoreInput() set, and the token is scanned
+  // again once more input has arrived. Text, raw text, script and comment
+  // tokens are scanned on from where the previous call stopped, so that
+  // scanning a long token in many chunks takes time linear in its size. Other
+  // tokens are scanned again from their start.
   TokenType Next(bool template_mode = false);
 
+  // Replaces the input with |html|, which must begin with the input seen so
+  // far. |input_complete| is false if more input is yet to arrive, in which
+  // case the tokenizer only returns tokens known to be complete. This allows
+  // tokenizing a document as it arrives in chunks.
+  void SetInput(std::string_view html, bool input_complete);
+
+  // Whether the last call to Next stopped at the end of incomplete input.
+  bool NeedsMoreInput() const { return needs_more_input_; }
+
+  // The number of bytes which were scanned and then rewound, to be scanned
+  // again once more input has arrived.
+  int64_t BytesRescanned() const { return bytes_rescanned_; }
+
   // Returns the unescaped text of a text, comment or doctype token. The
   // contents of the returned slice may change on the next call to Next.
   std::string Text();
@@ -123,6 +147,69 @@ class Tokenizer {
       Atom::TITLE,     Atom::XMP,
   };
 
+  // The names of the elements above, which raw_tag_ points to.
+  inline static constexpr std::array<std::string_view, 10> kRawTags{
+      "iframe", "noembed", "noframes", "noscript", "plaintext",
+      "script", "style",   "textarea", "title",    "xmp",
+  };
+
+  // Returns the element of kRawTags which is |lower_case_tag|, or an empty
+  // string if there is none.
+  static std::string_view RawTag(std::string_view lower_case_tag);
+
+  // The tokens whose scanning can stop at the end of incomplete input and
+  // resume there later, see Next.
+  enum class ScanKind { kNone, kText, kRawText, kScript, kComment };
+
+  // A point at which scanning of the current token may resume: the position
+  // in the input and the state of the scanner of the token's kind, e.g. the
+  // ScriptDataState of ReadScript.
+  struct ScanPoint {
+    ScanKind kind = ScanKind::kNone;
+    Span raw;
+    int data_start = 0;
+    int state = 0;
+    std::size_t num_lines = 0;
+    LineCol last_line_col;
+    LineCol current_line_col;
+  };
+
+  // Records the current position as the point to resume scanning the current
+  // token at, if the input is incomplete. Called by the scanners whenever
+  // none of the bytes they read so far may be scanned differently once more
+  // input arrives.
+  void MarkScanPoint(ScanKind kind, int state);
+
+  // Returns the state to resume scanning a token of |kind| in, or |initial|
+  // if the current token isn't resumed.
+  int ResumeState(ScanKind kind, int initial);
+
+  // The tokenizer state that scanning a token may change. Saved before each
+  // token when the input is incomplete, and restored if the token turns out
+  // to extend beyond the input seen so far.
+  struct Checkpoint {
+    Span raw;
+    Span data;
+    TokenType token_type;
+    std::string_view raw_tag;
+    bool text_is_raw;
+    bool convert_null;
+    bool eof;
+    bool err;
+    bool is_token_manufactured;
+    std::size_t num_lines;
+    LineCol last_line_col;
+    LineCol current_line_col;
+    LineCol token_line_col;
+    ScanPoint resume;
+  };
+
+  Checkpoint SaveCheckpoint() const;
+  void RestoreCheckpoint(const Checkpoint& checkpoint);
+
+  // Scans the next token, assuming all of the input seen so far.
+  TokenType NextToken(bool template_mode);
+
   // Returns the next byte from the input stream, doing a buffered read
   // from z.r into z.buf if necessary. z.buf[z.raw.start:z.raw.end] remains a
   // contiguous byte slice that holds all the bytes read so far for the current
@@ -221,8 +308,8 @@ class Tokenizer {
   // raw_tag_ is the "script" in "</script>" that closes the next token. If
   // non-empty, the subsequent call to Next will return a raw or RCDATA text
   // token: one that treats "<p>" as text instead of an element.
-  // raw_tag_'s contents are lower-cased.
-  std::string raw_tag_;
+  // raw_tag_ is one of kRawTags, so lower-cased.
+  std::string_view raw_tag_;
 
   // text_is_raw_ is whether the current text token's data is not escaped.
   bool text_is_raw_ = false;
@@ -238,6 +325,19 @@ class Tokenizer {
   bool eof_ = false;
   bool err_ = false;
 
+  // Whether buffer_ holds all of the input. See SetInput.
+  bool input_complete_ = true;
+
+  // Set when scanning reached the end of incomplete input.
+  bool needs_more_input_ = false;
+  // See BytesRescanned().
+  int64_t bytes_rescanned_ = 0;
+
+  // The last point at which scanning of the current token may resume, and
+  // the point at which the next call to Next resumes, if any.
+  ScanPoint scan_point_;
+  ScanPoint resume_;
+
   // Tells if the token is manufactured.
   // In a few cases, for example '<' followed by '?', is treated as comment and
   // a comment token is manufactured.
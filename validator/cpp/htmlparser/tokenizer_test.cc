@@ -1,5 +1,8 @@
 #include "cpp/htmlparser/tokenizer.h"
 
+#include <string>
+#include <utility>
+
 #include "gtest/gtest.h"
 #include "cpp/htmlparser/token.h"
 
@@ -360,3 +363,55 @@ TEST(TokenizerTest, TestMustangTemplateCase) {
   }
   EXPECT_EQ(tokens.size(), 11);
 }
+
+TEST(TokenizerTest, AttributesHaveAtoms) {
+  htmlparser::Tokenizer t("<img SRC=\"foo.png\" data-foo=bar width=10>");
+  EXPECT_EQ(t.Next(), htmlparser::TokenType::START_TAG_TOKEN);
+  htmlparser::Token token = t.token();
+  EXPECT_EQ(token.attributes.size(), 3);
+  EXPECT_EQ(token.attributes.at(0).key, "src");
+  EXPECT_EQ(token.attributes.at(0).atom, htmlparser::Atom::SRC);
+  EXPECT_EQ(token.attributes.at(1).key, "data-foo");
+  EXPECT_EQ(token.attributes.at(1).atom, htmlparser::Atom::UNKNOWN);
+  EXPECT_EQ(token.attributes.at(2).key, "width");
+  EXPECT_EQ(token.attributes.at(2).atom, htmlparser::Atom::WIDTH);
+}
+
+TEST(TokenizerTest, ScansLongTokensOnce) {
+  // A token which spans many chunks is scanned on from where the previous
+  // chunk ended, rather than again from its start, which would rescan 512MB
+  // of each of these.
+  const std::string long_data(1 << 20, 'x');
+  const std::pair<std::string, std::string> kTokens[] = {
+      {"<script>", "</script>"}, {"<style>", "</style>"},
+      {"<title>", "</title>"},   {"<!--", "-->"},
+      {"", "<p>"},
+  };
+  for (const auto& [prefix, suffix] : kTokens) {
+    const std::string html = prefix + long_data + suffix;
+    std::string input;
+    htmlparser::Tokenizer t("");
+    int num_long_tokens = 0;
+    for (size_t i = 0; i < html.size(); i += 1024) {
+      input.append(html, i, 1024);
+      t.SetInput(input, /*input_complete=*/input.size() == html.size());
+      while (t.Next() != htmlparser::TokenType::ERROR_TOKEN) {
+        if (t.token().data == long_data) ++num_long_tokens;
+      }
+    }
+    EXPECT_EQ(num_long_tokens, 1) << prefix;
+    EXPECT_LT(t.BytesRescanned(), 1024) << prefix;
+  }
+
+  // Tags are still scanned again from their start.
+  const std::string html = "<a href=\"" + std::string(1 << 16, 'x') + "\">";
+  std::string input;
+  htmlparser::Tokenizer t("");
+  for (size_t i = 0; i < html.size(); i += 1024) {
+    input.append(html, i, 1024);
+    t.SetInput(input, /*input_complete=*/input.size() == html.size());
+    while (t.Next() != htmlparser::TokenType::ERROR_TOKEN) {
+    }
+  }
+  EXPECT_GT(t.BytesRescanned(), 1 << 20);
+}